@@ -8,6 +8,7 @@
 #include <config.h>
 
 #include <solution/solution.h>
+#include "moves.h"
 
 /** Structure for returning prediction results to the user. */
 typedef struct PredResults_ {
@@ -15,6 +16,11 @@ typedef struct PredResults_ {
 	int contactsH;     /**< Number of H contacts */
 	int collisions;    /**< Number of collisions among beads */
 	double bbGyration; /**< Gyration radius for the backbone beads */
+	Solution *archive; /**< Best distinct solutions found (see ARCHIVE_SIZE), to be freed by the caller */
+	int archiveSize;   /**< Number of solutions in 'archive' */
+	long moveProposed[N_MOVES]; /**< Number of solutions generated by each kind of move that were tried (see moves.h) */
+	long moveAccepted[N_MOVES]; /**< Number of those that were accepted */
+	long exactNodes;   /**< Number of partial chains visited by the exact search (see EXACT_MAX_SIZE), or 0 if it wasn't used */
 } PredResults;
 
 /** Given a protein in the HPElem * format, searches the 3D conformation with minimal energy.
@@ -6,17 +6,114 @@
 #include <movchain.h>
 #include <hpchain.h>
 #include <fitness/fitness.h>
+#include <fitness/fitness_cache.h>
 #include <random.h>
 #include <solution/solution_mpi.h>
 
 #include "abc_alg.h"
 #include "hive.h"
+#include "migration.h"
+#include "checkpoint.h"
+#include "seeds.h"
+#include "growth.h"
+#include "exact.h"
+#include "fragments.h"
+#include "replica.h"
 
 struct {
-	MPI_Comm comm;
-	int      size;
+	MPI_Comm  comm;
+	int       size;
+	EvalBatch batch; /**< Chains per node and round of the tree protocol */
 } HIVE_COMM;
 
+/** Number of cycles between two agreements of the hive masters on whether to stop early or save a checkpoint */
+#define AGREE_INTERVAL 10
+
+/** State of the non-blocking agreement of the hive masters on whether to stop early or save a checkpoint */
+static struct {
+	int local[3];        /**< Whether this hive must stop right away, whether it is still improving, and whether it got SIGUSR1 */
+	int global[3];       /**< Maximum of 'local' over all hive masters */
+	MPI_Request request; /**< Request of the reduction in flight */
+	bool pending;        /**< Whether there is a reduction in flight */
+} AGREE;
+
+/** Solutions generated in a phase, and the solutions of the hive they are meant for */
+typedef struct {
+	Solution *sols;
+	const int *indexes; /**< Index of the hive solution each of 'sols' works on */
+	bool force;         /**< Whether each of 'sols' replaces its hive solution unconditionally, as scouts do */
+	int hpSize;
+} PhaseResults;
+
+/* Applies solutions 'first' to 'last' (exclusive) of the PhaseResults 'arg', whose fitness is set, to the hive */
+static
+void apply_results(int first, int last, void *arg){
+	PhaseResults *res = arg;
+	int i;
+
+	for(i = first; i < last; i++){
+		if(res->force){
+			HIVE_force_replace_solution(res->sols[i], res->indexes[i]);
+		} else {
+			HIVE_try_replace_solution(res->sols[i], res->indexes[i], res->hpSize);
+		}
+	}
+}
+
+/* Calculates the fitness of the 'nSols' solutions generated in a phase, and applies them to the hive in order
+ * With the pipelined and work queue protocols (EVAL_PROTOCOL 1 and 2), each range of solutions is applied
+ *   as soon as its fitnesses arrive, while the slaves work on the rest
+ * With the replica protocol (EVAL_PROTOCOL 3), slaves get each solution as the elements in which it differs
+ *   from the hive solution it came from, which scouts don't have
+ */
+static
+void evaluate_phase(Solution *sols, const int *indexes, int nSols, bool force, int hpSize){
+	PhaseResults res = { sols, indexes, force, hpSize };
+
+	if(EVAL_PROTOCOL == 1){
+		Solution_calculate_fitness_master_pipelined(sols, nSols, hpSize, HIVE_COMM.comm, EVAL_PIPELINE_DEPTH, apply_results, &res);
+	} else if(EVAL_PROTOCOL == 2){
+		Solution_calculate_fitness_master_queue(sols, nSols, hpSize, HIVE_COMM.comm, EVAL_PIPELINE_DEPTH, 0, apply_results, &res);
+	} else if(EVAL_PROTOCOL == 3){
+		Replica_calculate_fitness(sols, force ? NULL : indexes, nSols, hpSize);
+		apply_results(0, nSols, &res);
+	} else {
+		Solution_calculate_fitness_master(sols, nSols, hpSize, HIVE_COMM.comm, &HIVE_COMM.batch);
+		apply_results(0, nSols, &res);
+	}
+}
+
+/* Has the nodes of the hive generate and evaluate the solutions of a phase, for the hive solutions in 'indexes',
+ *   and applies them to the hive in order (EVAL_PROTOCOL 4)
+ * Scouts, which replace their hive solution unconditionally ('force'), aren't generated from it
+ */
+static
+void generate_phase(const int *indexes, int nSols, bool force, int hpSize){
+	int i;
+	Solution sols[nSols > 0 ? nSols : 1];
+	int parents[nSols > 0 ? nSols : 1];
+	PhaseResults res = { sols, indexes, force, hpSize };
+
+	for(i = 0; i < nSols; i++)
+		parents[i] = force ? -1 : indexes[i];
+
+	Replica_generate(parents, nSols, hpSize, sols);
+	apply_results(0, nSols, &res);
+}
+
+/** Tag of the messages carrying emigrants among hive masters */
+#define MIGRATION_TAG 1
+
+/** State of the non-blocking migration among hive masters */
+static struct {
+	MPI_Request *requests; /**< Sends of emigrants in flight */
+	char **buffers;        /**< Buffer of each send in flight */
+	int nSends;            /**< Number of sends in flight */
+	int capacity;          /**< Number of sends 'requests' and 'buffers' have room for */
+	int *sent;             /**< Number of messages sent to each master */
+	int received;          /**< Number of messages received */
+} MIGRATION;
+
 /* Performs the forager phase of the searching cycle
  * Procedure idea:
  *   For each solution, generate a new one in the neighborhood
@@ -26,17 +123,23 @@ static
 void parallel_forager_phase(int hpSize){
 	int i;
 	Solution sols[HIVE_nSols()];
+	int indexes[HIVE_nSols()];
 
-	// Generate new random solutions
 	for(i = 0; i < HIVE_nSols(); i++)
-		sols[i] = HIVE_perturb_solution(i, hpSize);
+		indexes[i] = i;
 
-	// Calculate fitnesses
-	Solution_calculate_fitness_master(sols, HIVE_nSols(), hpSize, HIVE_COMM.comm);
+	// The slaves generate the solutions themselves
+	if(EVAL_PROTOCOL == 4){
+		generate_phase(indexes, HIVE_nSols(), false, hpSize);
+		return;
+	}
 
-	// Replace solutions in the HIVE
+	// Generate new random solutions
 	for(i = 0; i < HIVE_nSols(); i++)
-		HIVE_try_replace_solution(sols[i], i, hpSize);
+		sols[i] = HIVE_perturb_solution(i, hpSize);
+
+	// Calculate fitnesses and replace solutions in the HIVE
+	evaluate_phase(sols, indexes, HIVE_nSols(), false, hpSize);
 }
 
 /* Performs the onlooker phase of the searching cycle
@@ -79,20 +182,21 @@ void parallel_onlooker_phase(int hpSize){
 		// Count number of onlookers that should perturb such solution
 		int nIter = round(prob * nOnlookers);
 
-		// Generate perturbations
+		// Generate perturbations (unless the slaves generate them)
 		for(j = 0; j < nIter; j++){
-			sols[nSols] = HIVE_perturb_solution(i, hpSize);
+			if(EVAL_PROTOCOL != 4)
+				sols[nSols] = HIVE_perturb_solution(i, hpSize);
 			indexes[nSols] = i;
 			nSols++;
 		}
 	}
 
-	// Calculate fitness
-	Solution_calculate_fitness_master(sols, nSols, hpSize, HIVE_COMM.comm);
-
-	// Replace solutions where due
-	for(i = 0; i < nSols; i++)
-		HIVE_try_replace_solution(sols[i], indexes[i], hpSize);
+	// Calculate fitness and replace solutions where due
+	if(EVAL_PROTOCOL == 4){
+		generate_phase(indexes, nSols, false, hpSize);
+	} else {
+		evaluate_phase(sols, indexes, nSols, false, hpSize);
+	}
 }
 
 /* Performs the scout phase of the searching cycle
@@ -117,105 +221,256 @@ void parallel_scout_phase(int hpSize){
 			indexes[nSols++] = i;
 	}
 
-	// Generate random solutions
+	if(EVAL_PROTOCOL == 4){
+		generate_phase(indexes, nSols, true, hpSize);
+		return;
+	}
+
+	// Generate random solutions (or seeds, see SEED_SCOUTS)
 	for(i = 0; i < nSols; i++)
-		sols[i] = Solution_random(hpSize);
+		sols[i] = Seeds_scout(hpSize);
 
-	// Calculate fitness
-	Solution_calculate_fitness_master(sols, nSols, hpSize, HIVE_COMM.comm);
+	// Calculate fitness and replace solutions
+	evaluate_phase(sols, indexes, nSols, true, hpSize);
+}
 
-	// Replace solutions
-	for(i = 0; i < nSols; i++)
-		HIVE_force_replace_solution(sols[i], indexes[i]);
+/* Returns the number of cycles between two migrations, for a run of 'nCycles' cycles */
+static
+int migration_interval(int nCycles){
+	return MIGRATION_INTERVAL > 0 ? MIGRATION_INTERVAL : nCycles * 0.1;
 }
 
-/* Exchanges solutions among the hives.
+/* Receives the emigrants other hives sent to this one so far, without waiting for any.
  * 'ringComm' should be the communicator containing the masters of each hive.
+ * Solutions received that the hive already has are dropped (see HIVE_immigrate).
  */
 static
-void ring_exchange(MPI_Comm ringComm, int hpSize){
-	int commSize, myRank;
+void ring_receive(MPI_Comm ringComm, int hpSize){
+	int flag;
+	MPI_Status status;
+
+	while(true){
+		MPI_Iprobe(MPI_ANY_SOURCE, MIGRATION_TAG, ringComm, &flag, &status);
+		if(!flag) return;
+
+		int size;
+		MPI_Get_count(&status, MPI_PACKED, &size);
+		char *buf = malloc(size);
+		MPI_Recv(buf, size, MPI_PACKED, status.MPI_SOURCE, MIGRATION_TAG, ringComm, MPI_STATUS_IGNORE);
+		MIGRATION.received++;
+
+		int position = 0;
+		while(position < size)
+			HIVE_immigrate(Solution_unpack(hpSize, buf, size, &position, ringComm));
+		free(buf);
+	}
+}
+
+/* Completes the sends of emigrants whose messages already left, and frees their buffers */
+static
+void ring_complete_sends(){
+	int i, done, nLeft = 0;
+
+	for(i = 0; i < MIGRATION.nSends; i++){
+		MPI_Test(&MIGRATION.requests[i], &done, MPI_STATUS_IGNORE);
+		if(done){
+			free(MIGRATION.buffers[i]);
+		} else {
+			MIGRATION.requests[nLeft] = MIGRATION.requests[i];
+			MIGRATION.buffers[nLeft] = MIGRATION.buffers[i];
+			nLeft++;
+		}
+	}
+	MIGRATION.nSends = nLeft;
+}
+
+/* Exchanges solutions among the hives, after the hive of this master finished its 'cycle'-th cycle.
+ * 'ringComm' should be the communicator containing the masters of each hive.
+ * Procedure idea:
+ *   Emigrants that arrived in the meantime are integrated into the hive
+ *   Every 'interval' cycles, the best solution and N_MIGRANTS-1 random solutions are posted with MPI_Isend
+ *     to the destinations given by MIGRATION_TOPOLOGY (see migration.h)
+ *   No master ever waits for another: the hive goes on cycling while messages travel
+ */
+static
+void ring_migrate(MPI_Comm ringComm, int cycle, int interval, int hpSize){
+	int i, j, commSize, myRank;
 	MPI_Comm_size(ringComm, &commSize);
 	MPI_Comm_rank(ringComm, &myRank);
 
-	// If there is only 1 process, it's not a ring.
+	// If there is only 1 process, there is no one to migrate to.
 	if(commSize == 1) return;
 
-	// Get solutions to send
-	Solution randSol = HIVE_solutions()[urandom_max(HIVE_nSols())];
-	Solution bestSol = HIVE_best_sol();
+	ring_receive(ringComm, hpSize);
+	ring_complete_sends();
 
-	// Create input/output buffers
-	int maxSize = 2 * hpSize + sizeof(double) * 2 + 32; // We overestimate a bit
-	char inBuf[maxSize];
-	char outBuf[maxSize];
+	if(interval <= 0 || cycle == 0 || cycle % interval != 0) return;
 
-	// Pack data
-	int position = 0;
-	Solution_pack(bestSol, hpSize, outBuf, maxSize, &position, ringComm);
-	Solution_pack(randSol, hpSize, outBuf, maxSize, &position, ringComm);
+	int dests[MIGRATION_MAX_DESTS];
+	int nDests = Migration_destinations(MIGRATION_TOPOLOGY, myRank, commSize, cycle / interval - 1, dests);
 
-	// Send data
-	int src, dest;
-	if(myRank % 2 == 0){
-		dest = (myRank+1) % commSize;
-		MPI_Send(outBuf, position, MPI_PACKED, dest, 0, ringComm);
+	int packSize, chainSize;
+	MPI_Pack_size(1, MPI_DOUBLE, ringComm, &packSize);
+	MPI_Pack_size(hpSize - 1, MPI_CHAR, ringComm, &chainSize);
+	int maxSize = N_MIGRANTS * (packSize + chainSize);
 
-		src = myRank == 0 ? commSize-1 : myRank-1;
-		MPI_Recv(inBuf, position, MPI_PACKED, src, 0, ringComm, MPI_STATUS_IGNORE);
-	} else {
-		src = myRank-1;
-		MPI_Recv(inBuf, position, MPI_PACKED, src, 0, ringComm, MPI_STATUS_IGNORE);
+	for(i = 0; i < nDests; i++){
+		char *buf = malloc(maxSize);
+		int position = 0;
+		for(j = 0; j < N_MIGRANTS; j++){
+			Solution sol = j == 0 ? HIVE_best_sol() : HIVE_solution(urandom_max(HIVE_nSols()));
+			Solution_pack(sol, hpSize, buf, maxSize, &position, ringComm);
+		}
+
+		if(MIGRATION.nSends == MIGRATION.capacity){
+			MIGRATION.capacity = 2 * MIGRATION.capacity + 4;
+			MIGRATION.requests = realloc(MIGRATION.requests, sizeof(MPI_Request) * MIGRATION.capacity);
+			MIGRATION.buffers = realloc(MIGRATION.buffers, sizeof(char *) * MIGRATION.capacity);
+		}
+		MPI_Isend(buf, position, MPI_PACKED, dests[i], MIGRATION_TAG, ringComm, &MIGRATION.requests[MIGRATION.nSends]);
+		MIGRATION.buffers[MIGRATION.nSends++] = buf;
+		MIGRATION.sent[dests[i]]++;
+	}
+}
+
+/* Receives every emigrant still on its way to this master, and completes all sends.
+ * Must be called by all masters once they stop cycling, before anything else is sent among them.
+ * Procedure idea:
+ *   Masters tell each other how many messages they sent to each one, so each master knows how many more
+ *     it has to wait for
+ */
+static
+void ring_migrate_finish(MPI_Comm ringComm, int hpSize){
+	int i, commSize;
+	MPI_Comm_size(ringComm, &commSize);
+	if(commSize == 1) return;
+
+	int expected[commSize];
+	MPI_Alltoall(MIGRATION.sent, 1, MPI_INT, expected, 1, MPI_INT, ringComm);
+
+	int total = 0;
+	for(i = 0; i < commSize; i++)
+		total += expected[i];
 
-		dest = (myRank+1) % commSize;
-		MPI_Send(outBuf, position, MPI_PACKED, dest, 0, ringComm);
+	while(MIGRATION.received < total){
+		MPI_Probe(MPI_ANY_SOURCE, MIGRATION_TAG, ringComm, MPI_STATUS_IGNORE);
+		ring_receive(ringComm, hpSize);
 	}
 
-	// Unpack data
-	position = 0;
-	Solution sol1 = Solution_unpack(hpSize, inBuf, maxSize, &position, ringComm);
-	Solution sol2 = Solution_unpack(hpSize, inBuf, maxSize, &position, ringComm);
+	for(i = 0; i < MIGRATION.nSends; i++){
+		MPI_Wait(&MIGRATION.requests[i], MPI_STATUS_IGNORE);
+		free(MIGRATION.buffers[i]);
+	}
 
-	int ridx1 = urandom_max(HIVE_nSols());
-	HIVE_force_replace_solution(sol1, ridx1);
+	free(MIGRATION.requests);
+	free(MIGRATION.buffers);
+	free(MIGRATION.sent);
+}
 
-	int ridx2 = urandom_max(HIVE_nSols());
-	HIVE_force_replace_solution(sol2, ridx2);
+/* Returns whether all hives should stop, after the hive of this master finished 'cycle' cycles.
+ * '*save' is set to whether all hives should save a checkpoint, because some master got SIGUSR1.
+ * 'ringComm' should be the communicator containing the masters of each hive, which must all call this
+ *   procedure for the same cycles.
+ * Procedure idea:
+ *   Every AGREE_INTERVAL cycles, each master posts its flags in a MPI_Iallreduce
+ *   The result is only waited for in the next check, by which time it has most likely arrived,
+ *     so the masters act together (in the same cycle) without ever waiting for each other
+ *   All hives stop if any of them ran out of time or reached the target fitness, or if none is still improving
+ */
+static
+bool ring_agree(int cycle, MPI_Comm ringComm, Checkpoint ckpt, bool *save){
+	bool stop = false;
+	*save = false;
+
+	if(TIME_BUDGET <= 0 && TARGET_FITNESS == 0 && STAGNATION_LIMIT <= 0 && !CHECKPOINT_SIGNAL) return false;
+	if(cycle % AGREE_INTERVAL != 0) return false;
+
+	if(AGREE.pending){
+		MPI_Wait(&AGREE.request, MPI_STATUS_IGNORE);
+		AGREE.pending = false;
+		stop = AGREE.global[0] || !AGREE.global[1];
+		*save = AGREE.global[2];
+	}
+
+	if(!stop){
+		int reasons = HIVE_stop_reasons();
+		AGREE.local[0] = (reasons & (HIVE_STOP_TIME | HIVE_STOP_TARGET)) != 0;
+		AGREE.local[1] = (reasons & HIVE_STOP_STAGNATION) == 0;
+		AGREE.local[2] = Checkpoint_signaled(ckpt);
+		MPI_Iallreduce(AGREE.local, AGREE.global, 3, MPI_INT, MPI_MAX, ringComm, &AGREE.request);
+		AGREE.pending = true;
+	}
+
+	return stop;
+}
+
+/* Completes the reduction posted by ring_agree(), if any. */
+static
+void ring_agree_finish(){
+	if(AGREE.pending){
+		MPI_Wait(&AGREE.request, MPI_STATUS_IGNORE);
+		AGREE.pending = false;
+	}
+}
+
+/* Resumes the hive of this master from its checkpoint, if RESTART is set.
+ * Hive masters must resume from the same cycle, as they exchange solutions in the same cycles,
+ *   so the program is terminated if their checkpoints don't agree.
+ */
+static
+void ring_restart(MPI_Comm ringComm, Checkpoint ckpt){
+	if(!RESTART) return;
+
+	Checkpoint_load(ckpt);
+
+	int cycles[2] = { HIVE_cycle(), -HIVE_cycle() };
+	MPI_Allreduce(MPI_IN_PLACE, cycles, 2, MPI_INT, MPI_MIN, ringComm);
+
+	if(cycles[0] != -cycles[1]){
+		fprintf(stderr, "Checkpoints of the hives were saved in different cycles (%d to %d).\n", cycles[0], -cycles[1]);
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+	}
 }
 
 /* Gathers the best solutions among the hives in node 0.
  * 'ringComm' should be the communicator containing the masters of each hive.
  * The HIVE in node 0 is altered so that HIVE.best is the best among all best solutions
- *   of all hives.
+ *   of all hives, and its archive (if any) holds the best among all archived solutions.
  */
 static
 void ring_gather(MPI_Comm ringComm, int hpSize){
-	int i, commSize, myRank;
+	int i, j, commSize, myRank;
 	MPI_Comm_size(ringComm, &commSize);
 	MPI_Comm_rank(ringComm, &myRank);
 
 	// If there is only one process, there is nothing to be done.
 	if(commSize == 1) return;
 
-	// Get my solution
+	// Get my solutions
 	Solution sol = HIVE_best_sol();
+	Archive archive = HIVE_archive();
+	int nArchived = archive ? Archive_size(archive) : 0;
 
-	// Create gather buffer
-	int maxSize = commSize * (hpSize + sizeof(double) + 32); // We overestimate a bit
+	// Create gather buffer. Every node fills a block of the same size, whatever the size of its archive.
+	int solSize = hpSize + sizeof(double) + 32; // We overestimate a bit
+	int blockSize = sizeof(int) + 32 + solSize * (1 + (archive ? ARCHIVE_SIZE : 0));
+	int maxSize = commSize * blockSize;
 	char *gatBuf = malloc(maxSize);
 
-	// Pack my solution
+	// Pack my solutions
 	int position = 0;
 	Solution_pack(sol, hpSize, gatBuf, maxSize, &position, ringComm);
+	MPI_Pack(&nArchived, 1, MPI_INT, gatBuf, maxSize, &position, ringComm);
+	for(i = 0; i < nArchived; i++)
+		Solution_pack(Archive_solution(archive, i), hpSize, gatBuf, maxSize, &position, ringComm);
 
 	// Gather solutions
-	int byteCount = position;
-	ElfTreeComm_gather(gatBuf, byteCount, MPI_PACKED, ringComm);
+	ElfTreeComm_gather(gatBuf, blockSize, MPI_PACKED, ringComm);
 
 	// Find best solution
 	if(myRank == 0){
-		position = 0;
 		for(i = 0; i < commSize; i++){
+			position = i * blockSize;
 			sol = Solution_unpack(hpSize, gatBuf, maxSize, &position, ringComm);
 
 			if(Solution_fitness(sol) > Solution_fitness(HIVE_best_sol())){
@@ -223,18 +478,175 @@ void ring_gather(MPI_Comm ringComm, int hpSize){
 			} else {
 				Solution_free(sol);
 			}
+
+			MPI_Unpack(gatBuf, maxSize, &position, &nArchived, 1, MPI_INT, ringComm);
+			for(j = 0; j < nArchived; j++){
+				sol = Solution_unpack(hpSize, gatBuf, maxSize, &position, ringComm);
+				if(i != 0)
+					Archive_insert(archive, sol, Solution_fitness(sol));
+				Solution_free(sol);
+			}
 		}
 	}
 
 	free(gatBuf);
 }
 
+/* Performs the migration, checkpoint and stop check that parallel_steady_state() does when the hive finishes its 'cycle'-th cycle.
+ * Returns whether the masters agreed to stop.
+ */
+static
+bool steady_cycle_end(int cycle, int interval, MPI_Comm ringComm, int hpSize, Checkpoint ckpt){
+	bool save;
+
+	// The cycle that just ended is the one the phased version would have migrated at
+	ring_migrate(ringComm, cycle - 1, interval, hpSize);
+
+	HIVE_local_search();
+
+	bool stop = ring_agree(cycle, ringComm, ckpt, &save);
+
+	if(save || Checkpoint_due(ckpt, cycle))
+		Checkpoint_save(ckpt);
+
+	if(stop){
+		HIVE_steady_stop();
+		return true;
+	}
+
+	return false;
+}
+
+/* Runs 'nCycles' cycles of the hive in steady-state mode
+ * Procedure idea:
+ *   Every slave always holds one bee (see HIVE_steady_step), talking directly to the master
+ *   Whenever a fitness arrives, it is applied to the hive and the slave gets the next bee right away
+ *   Migration happens when the hive cycle counter crosses the migration cycle, as in the phased version
+ *   Once the masters agree to stop, no more bees are dispatched, and neither migration nor checks happen
+ *     while the bees in flight are applied, since each master may have a different number of them
+ */
+static
+void parallel_steady_state(int hpSize, int nCycles, MPI_Comm ringComm, Checkpoint ckpt){
+	int nOnlookers = COLONY_SIZE - (COLONY_SIZE * FORAGER_RATIO);
+	const int interval = migration_interval(nCycles);
+	int commSize = HIVE_COMM.size;
+	int cycle = HIVE_cycle();
+	bool stopped = false;
+
+	HiveBee bees[commSize];
+	int src, busy = 0;
+
+	HIVE_steady_start((long) (nCycles - HIVE_cycle()) * (HIVE_nSols() + nOnlookers));
+
+	for(src = 0; src < commSize; src++)
+		bees[src].index = -1;
+
+	// Without slaves, the master goes through the bees itself
+	if(commSize == 1){
+		while(HIVE_steady_step(&bees[0], hpSize)){
+			Solution_calculate_fitness(&bees[0].sol, 1);
+
+			if(HIVE_cycle() != cycle && !stopped){
+				cycle = HIVE_cycle();
+				stopped = steady_cycle_end(cycle, interval, ringComm, hpSize, ckpt);
+			}
+		}
+		return;
+	}
+
+	for(src = 1; src < commSize; src++){
+		if(HIVE_steady_step(&bees[src], hpSize)){
+			Solution_send_async(bees[src].sol, hpSize, src, 0, HIVE_COMM.comm);
+			busy++;
+		}
+	}
+
+	while(busy > 0){
+		double fit;
+		MPI_Status status;
+		MPI_Recv(&fit, 1, MPI_DOUBLE, MPI_ANY_SOURCE, 0, HIVE_COMM.comm, &status);
+
+		src = status.MPI_SOURCE;
+		Solution_set_fitness(&bees[src].sol, fit);
+
+		if(HIVE_steady_step(&bees[src], hpSize)){
+			Solution_send_async(bees[src].sol, hpSize, src, 0, HIVE_COMM.comm);
+		} else {
+			busy--;
+		}
+
+		if(HIVE_cycle() != cycle && !stopped){
+			cycle = HIVE_cycle();
+			stopped = steady_cycle_end(cycle, interval, ringComm, hpSize, ckpt);
+		}
+	}
+}
+
+/* Folds the fragments of the protein (see fragments.h) among all nodes
+ * Procedure idea:
+ *   Fragments are dealt round-robin among the nodes, each folding its own in N_THREADS threads
+ *   The conformations of each fragment are then broadcast from the node that folded it, so every node
+ *     assembles the same seeds
+ */
+static
+void fold_fragments(int myRank, int commSize){
+	int i;
+	Fragments_fold(myRank, commSize, N_THREADS);
+
+	for(i = 0; i < Fragments_count(); i++){
+		int count = FRAGMENT_SEEDS * (Fragments_size(i) - 1);
+		MPI_Bcast(Fragments_chains(i), count * sizeof(MovElem), MPI_BYTE, i % commSize, MPI_COMM_WORLD);
+	}
+}
+
+/* Solves the protein with Exact_search(), in the threads of node 0 alone */
+static
+Solution exact_prediction(const HPElem * hpChain, int hpSize, int myRank, PredResults *results){
+	Solution retval = Solution_blank(hpSize);
+	FitnessCalc_initialize(hpChain, hpSize);
+
+	if(myRank == 0){
+		Solution_free(retval);
+		long nodes;
+		retval = Exact_search(hpChain, hpSize, &nodes);
+
+		if(results){
+			results->fitness = Solution_fitness(retval);
+			FitnessCalc_measures(Solution_chain(retval), &results->contactsH, &results->collisions, &results->bbGyration);
+			results->archive = NULL;
+			results->archiveSize = 0;
+			memset(results->moveProposed, 0, sizeof(results->moveProposed));
+			memset(results->moveAccepted, 0, sizeof(results->moveAccepted));
+			results->exactNodes = nodes;
+		}
+	} else if(results){
+		// Only node 0 reports the prediction
+		results->fitness = -1;
+		results->contactsH = -1;
+		results->collisions = -1;
+		results->bbGyration = -1;
+	}
+
+	FitnessCalc_cleanup();
+	return retval;
+}
+
 Solution ABC_predict_structure(const HPElem * hpChain, int hpSize, int nCycles, PredResults *results){
-	MPI_Init(NULL, NULL);
+	// Only the thread that called MPI_Init talks to other nodes, other threads just calculate fitnesses
+	int provided;
+	MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
 	int commSize, myRank;
 	MPI_Comm_size(MPI_COMM_WORLD, &commSize);
 	MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
 
+	if(hpSize <= EXACT_MAX_SIZE){
+		Solution retval = exact_prediction(hpChain, hpSize, myRank, results);
+		MPI_Finalize();
+		return retval;
+	}
+
+	Checkpoint_initialize();
+
 	/* We will divide COMM_WORLD into N_HIVES groups with same number of nodes each.
 	 * If COMM_WORLD has the nodes:
 	 * 0 1 2 3 4 5
@@ -264,10 +676,27 @@ Solution ABC_predict_structure(const HPElem * hpChain, int hpSize, int nCycles,
 	int myColor = myRank / nodesPerHive;
 	MPI_Comm_split(MPI_COMM_WORLD, myColor, myRank, &hiveComm);
 
-	HIVE_initialize();
+	FitnessCalc_initialize(hpChain, hpSize);
+	Growth_initialize(hpChain, hpSize);
+
+	Fragments_initialize(hpChain, hpSize);
+	if(Fragments_count() > 0)
+		fold_fragments(myRank, commSize);
+
+	if(strcmp(SEED_FILE, "none") != 0)
+		Seeds_load(SEED_FILE, hpSize);
+	Fragments_assemble();
+
+	HIVE_initialize(hpSize);
 	HIVE_COMM.comm = hiveComm;
 	HIVE_COMM.size = nodesPerHive;
-	FitnessCalc_initialize(hpChain, hpSize);
+	HIVE_COMM.batch = EvalBatch_create(EVAL_BATCH);
+	if(EVAL_SHARED_MEMORY && !STEADY_STATE && EVAL_PROTOCOL == 0)
+		HIVE_COMM.batch.shared = EvalShared_create(hiveComm, COLONY_SIZE + HIVE_nSols(), hpSize);
+	if(EVAL_TREE_TOPOLOGY && !STEADY_STATE && EVAL_PROTOCOL == 0)
+		HIVE_COMM.batch.topology = ElfTreeComm_topology_create(hiveComm);
+	Replica_initialize(hpSize, hiveComm);
+	FitnessCache_initialize(hpSize);
 
 	int myHiveRank, myWorldRank;
 	MPI_Comm_rank(hiveComm, &myHiveRank);
@@ -280,15 +709,49 @@ Solution ABC_predict_structure(const HPElem * hpChain, int hpSize, int nCycles,
 
 	Solution retval;
 	if(myHiveRank != 0){
-		Solution_calculate_fitness_slave(hpChain, hpSize, HIVE_COMM.comm);
+		if(!STEADY_STATE && EVAL_PROTOCOL >= 3){
+			Replica_slave(hpSize);
+		} else if(STEADY_STATE || EVAL_PROTOCOL != 0){
+			Solution_calculate_fitness_slave_async(hpChain, hpSize, HIVE_COMM.comm);
+		} else {
+			Solution_calculate_fitness_slave(hpChain, hpSize, HIVE_COMM.comm, &HIVE_COMM.batch);
+		}
 		results->fitness = -1;
 		results->contactsH = -1;
 		results->collisions = -1;
 		results->bbGyration = -1;
 	} else {
 		int i;
+		bool save;
+		Checkpoint ckpt = Checkpoint_create(myColor);
+		MIGRATION.sent = calloc(N_HIVES, sizeof(int));
+
+		// Calculate the fitness of the initial solutions at once, so seeded solutions can be the best right away
+		if(STEADY_STATE){
+			Solution_calculate_fitness_master_async(HIVE_solutions(), HIVE_nSols(), hpSize, HIVE_COMM.comm);
+		} else if(EVAL_PROTOCOL == 1){
+			Solution_calculate_fitness_master_pipelined(HIVE_solutions(), HIVE_nSols(), hpSize, HIVE_COMM.comm,
+				EVAL_PIPELINE_DEPTH, NULL, NULL);
+		} else if(EVAL_PROTOCOL == 2){
+			Solution_calculate_fitness_master_queue(HIVE_solutions(), HIVE_nSols(), hpSize, HIVE_COMM.comm,
+				EVAL_PIPELINE_DEPTH, 0, NULL, NULL);
+		} else if(EVAL_PROTOCOL >= 3){
+			// Each solution is its own parent, so its chain is sent once, to bring the replicas up to date
+			int parents[HIVE_nSols()];
+			for(i = 0; i < HIVE_nSols(); i++)
+				parents[i] = i;
+			Replica_calculate_fitness(HIVE_solutions(), parents, HIVE_nSols(), hpSize);
+		} else {
+			Solution_calculate_fitness_master(HIVE_solutions(), HIVE_nSols(), hpSize, HIVE_COMM.comm, &HIVE_COMM.batch);
+		}
+		HIVE_check_best();
+
+		ring_restart(ringComm, ckpt);
+
+		if(STEADY_STATE)
+			parallel_steady_state(hpSize, nCycles, ringComm, ckpt);
 
-		for(i = 0; i < nCycles; i++){
+		for(i = HIVE_cycle(); i < nCycles && !STEADY_STATE; i++){
 
 			parallel_forager_phase(hpSize);
 
@@ -299,31 +762,69 @@ Solution ABC_predict_structure(const HPElem * hpChain, int hpSize, int nCycles,
 			 */
 			parallel_scout_phase(hpSize);
 
-			const int migCycle = nCycles * 0.1; // Migration cycle
-			if( i != 0 && (i % migCycle == 0) ){
-				ring_exchange(ringComm, hpSize);
-			}
+			ring_migrate(ringComm, i, migration_interval(nCycles), hpSize);
 
 			HIVE_increment_cycle();
+			HIVE_local_search();
+			bool stop = ring_agree(HIVE_cycle(), ringComm, ckpt, &save);
+
+			if(save || Checkpoint_due(ckpt, HIVE_cycle()))
+				Checkpoint_save(ckpt);
+
+			if(stop)
+				break;
 		}
 
+		ring_agree_finish();
+		ring_migrate_finish(ringComm, hpSize);
+		Checkpoint_free(ckpt);
 		ring_gather(ringComm, hpSize);
 
+		long moveCounts[2 * N_MOVES] = {0};
+		HIVE_move_counts(moveCounts, moveCounts + N_MOVES);
+		MPI_Reduce(myWorldRank == 0 ? MPI_IN_PLACE : moveCounts, moveCounts, 2 * N_MOVES, MPI_LONG, MPI_SUM, 0, ringComm);
+
 		retval = HIVE_best_sol();
 		double fit = Solution_fitness(retval);
 
 		if(results && myWorldRank == 0){
 			results->fitness = fit;
 			FitnessCalc_measures(Solution_chain(retval), &results->contactsH, &results->collisions, &results->bbGyration);
+			results->archive = NULL;
+			results->archiveSize = HIVE_archive() ? Archive_export(HIVE_archive(), &results->archive) : 0;
+			memcpy(results->moveProposed, moveCounts, sizeof(results->moveProposed));
+			memcpy(results->moveAccepted, moveCounts + N_MOVES, sizeof(results->moveAccepted));
+			results->exactNodes = 0;
+		} else if(results){
+			// Only node 0 reports the prediction
+			results->fitness = -1;
+			results->contactsH = -1;
+			results->collisions = -1;
+			results->bbGyration = -1;
+			Solution_free(retval);
 		}
 
 		// Tell slaves to stop
-		Solution_calculate_fitness_master_kill_slaves(hpSize, HIVE_COMM.comm);
+		if(!STEADY_STATE && EVAL_PROTOCOL >= 3){
+			Replica_kill_slaves();
+		} else if(STEADY_STATE || EVAL_PROTOCOL != 0){
+			Solution_calculate_fitness_master_kill_slaves_async(hpSize, HIVE_COMM.comm);
+		} else {
+			Solution_calculate_fitness_master_kill_slaves(hpSize, HIVE_COMM.comm, &HIVE_COMM.batch);
+		}
 	}
 
 	MPI_Barrier(hiveComm);
+	if(HIVE_COMM.batch.shared)
+		EvalShared_free(HIVE_COMM.batch.shared);
+	if(HIVE_COMM.batch.topology)
+		ElfTreeComm_topology_free(HIVE_COMM.batch.topology);
+	FitnessCache_cleanup();
+	Replica_free();
 	FitnessCalc_cleanup();
 	HIVE_destroy();
+	Seeds_free();
+	Fragments_free();
 	MPI_Comm_free(&hiveComm);
 	MPI_Finalize();
 
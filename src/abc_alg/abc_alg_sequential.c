@@ -1,15 +1,34 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <omp.h>
+#include <stdatomic.h>
 
 #include <movchain.h>
 #include <hpchain.h>
 #include <fitness/fitness.h>
+#include <fitness/fitness_cache.h>
 #include <random.h>
 
 #include "abc_alg.h"
 #include "hive.h"
+#include "migration.h"
+#include "checkpoint.h"
+#include "seeds.h"
+#include "growth.h"
+#include "exact.h"
+#include "fragments.h"
 
+/** State of the island model, in which each hive runs in its own thread */
+static struct {
+	MigrationQueue *queues; /**< queues[src * nHives + dest] carries solutions from hive 'src' to hive 'dest' */
+	int nHives;             /**< Number of hives */
+	int interval;           /**< Number of cycles between migrations */
+
+	atomic_bool stop;       /**< Whether all islands should stop */
+	atomic_int nStagnant;   /**< Number of islands whose hive is stagnated */
+	bool *stagnant;         /**< Whether each island counts in 'nStagnant' */
+} ISLANDS;
 
 /******************************************/
 /****** OTHER PROCEDURES           ********/
@@ -31,6 +50,26 @@ void forager_phase(int hpSize){
 	}
 }
 
+/* Performs the work of 'nIter' onlooker bees on the solution at 'index', speculatively
+ * Procedure idea:
+ *   All perturbations are generated at once from the current solution, and evaluated in parallel
+ *   They are then tried in order, which keeps the best of them and counts idle iterations
+ *     exactly as the loop of improve-or-discard in onlooker_phase does
+ */
+static
+void speculative_onlookers(int index, int nIter, int hpSize){
+	int j;
+	Solution alts[nIter];
+
+	for(j = 0; j < nIter; j++)
+		alts[j] = HIVE_perturb_solution(index, hpSize);
+
+	Solution_calculate_fitness(alts, nIter);
+
+	for(j = 0; j < nIter; j++)
+		HIVE_try_replace_solution(alts[j], index, hpSize);
+}
+
 /* Performs the onlooker phase of the searching cycle
  * Procedure idea;
  *   Calculate the SUM of fitnesses for all solutions
@@ -67,6 +106,11 @@ void onlooker_phase(int hpSize){
 		// Count number of onlookers that should perturb such solution
 		int nIter = round(prob * nOnlookers);
 
+		if(SPECULATIVE_ONLOOKERS && nIter > 1){
+			speculative_onlookers(i, nIter, hpSize);
+			continue;
+		}
+
 		for(j = 0; j < nIter; j++){
 			// Change a random element of the solution
 			Solution alt = HIVE_perturb_solution(i, hpSize);
@@ -87,33 +131,288 @@ void scout_phase(int hpSize){
 	for(i = 0; i < HIVE_nSols(); i++){
 		int idle = Solution_idle_iterations(HIVE_solution(i));
 		if(idle > IDLE_LIMIT){
-            Solution sol = Solution_random(hpSize);
+            Solution sol = Seeds_scout(hpSize);
 			HIVE_force_replace_solution(sol, i);
 		}
 	}
 }
 
-Solution ABC_predict_structure(const HPElem * hpChain, int hpSize, int nCycles, PredResults *results){
-	HIVE_initialize();
-	FitnessCalc_initialize(hpChain, hpSize);
+/* Exchanges solutions with the other islands, after the hive of island 'me' finished its 'cycle'-th cycle
+ * Procedure idea:
+ *   Solutions that arrived from other islands in the meantime replace random solutions of the hive,
+ *     unless the hive already has them (see HIVE_immigrate)
+ *   Every ISLANDS.interval cycles, copies of the best solution and N_MIGRANTS-1 random solutions
+ *     are sent to the destinations given by MIGRATION_TOPOLOGY
+ *   No island ever waits for another: if a destination's queue is full, the copy is dropped
+ */
+static
+void island_migrate(int me, int cycle, int hpSize){
+	int i, j;
+	Solution sol;
+
+	for(i = 0; i < ISLANDS.nHives; i++){
+		if(i == me) continue;
+		while(MigrationQueue_pop(ISLANDS.queues[i * ISLANDS.nHives + me], &sol))
+			HIVE_immigrate(sol);
+	}
+
+	if(cycle == 0 || cycle % ISLANDS.interval != 0) return;
+
+	int dests[MIGRATION_MAX_DESTS];
+	int nDests = Migration_destinations(MIGRATION_TOPOLOGY, me, ISLANDS.nHives, cycle / ISLANDS.interval - 1, dests);
+
+	for(i = 0; i < nDests; i++){
+		for(j = 0; j < N_MIGRANTS; j++){
+			sol = j == 0 ? HIVE_best_sol() : HIVE_solution(urandom_max(HIVE_nSols()));
+			sol = Solution_copy(sol, hpSize);
+			Solution_reset_idle_iterations(&sol);
+
+			if(!MigrationQueue_push(ISLANDS.queues[me * ISLANDS.nHives + dests[i]], sol))
+				Solution_free(sol);
+		}
+	}
+}
+
+/* Returns whether the hive of the calling thread should stop before running all its cycles
+ * 'island' is the index of the hive in the island model, or -1 if there is a single hive.
+ * Procedure idea:
+ *   A hive that ran out of time or reached the target fitness makes all islands stop
+ *   A stagnated hive only stops when all islands are stagnated, as the others may still send it better solutions
+ */
+static
+bool should_stop(int island){
+	int reasons = HIVE_stop_reasons();
+	if(island < 0) return reasons != 0;
+
+	if(reasons & (HIVE_STOP_TIME | HIVE_STOP_TARGET))
+		atomic_store(&ISLANDS.stop, true);
+
+	bool stagnant = reasons & HIVE_STOP_STAGNATION;
+	if(stagnant != ISLANDS.stagnant[island]){
+		ISLANDS.stagnant[island] = stagnant;
+		atomic_fetch_add(&ISLANDS.nStagnant, stagnant ? 1 : -1);
+	}
+
+	return atomic_load(&ISLANDS.stop) || atomic_load(&ISLANDS.nStagnant) == ISLANDS.nHives;
+}
+
+/* Runs 'nCycles' cycles of the hive in steady-state mode
+ * Procedure idea:
+ *   Each of the N_THREADS threads repeatedly takes the hive lock, applies the result of
+ *     its previous bee and takes the next bee (see HIVE_steady_step)
+ *   Fitness is calculated outside of the lock, so no thread waits for the others to finish a phase
+ *   If the hive is island 'island' (not -1), whichever thread finishes a cycle also performs the migration
+ *   Whichever thread finishes a cycle also checks whether the hive should stop, in which case
+ *     no more bees are dispatched, and the threads finish once their bees are applied
+ *   Checkpoints are saved by the thread that owns the hive (thread 0), which holds the random
+ *     stream of the hive, the next time it takes the lock after a cycle asks for one
+ */
+static
+void steady_state(int hpSize, int nCycles, int island, Checkpoint ckpt){
+	int nOnlookers = COLONY_SIZE - (COLONY_SIZE * FORAGER_RATIO);
+	Hive hive = HIVE_current();
+	bool savePending = false;
+
+	HIVE_steady_start((long) (nCycles - HIVE_cycle()) * (HIVE_nSols() + nOnlookers));
+
+	#pragma omp parallel num_threads(N_THREADS)
+	{
+		HiveBee bee = { .index = -1 };
+		bool more = true;
+
+		HIVE_use(hive);
+
+		while(more){
+			HIVE_lock();
+			int cycle = HIVE_cycle();
+			more = HIVE_steady_step(&bee, hpSize);
+			if(HIVE_cycle() != cycle){
+				if(island >= 0)
+					island_migrate(island, cycle, hpSize);
+				HIVE_local_search();
+				if(Checkpoint_due(ckpt, HIVE_cycle()) || Checkpoint_signaled(ckpt))
+					savePending = true;
+				if(should_stop(island))
+					HIVE_steady_stop();
+			}
+			if(savePending && omp_get_thread_num() == 0){
+				Checkpoint_save(ckpt);
+				savePending = false;
+			}
+			HIVE_unlock();
 
+			if(more)
+				Solution_calculate_fitness(&bee.sol, 1);
+		}
+	}
+
+	// Thread 0 may have finished before the last cycle asked for a checkpoint
+	if(savePending)
+		Checkpoint_save(ckpt);
+}
+
+/* Runs 'nCycles' cycles of the hive of the calling thread.
+ * 'island' is the index of the hive in the island model, or -1 if there is a single hive.
+ * With RESTART, the hive resumes from its checkpoint and only runs the cycles left.
+ */
+static
+void run_hive(int hpSize, int nCycles, int island){
+	Checkpoint ckpt = Checkpoint_create(island < 0 ? 0 : island);
+
+	// Calculate the fitness of the initial solutions at once, so seeded solutions can be the best right away
+	Solution_calculate_fitness(HIVE_solutions(), HIVE_nSols());
+	HIVE_check_best();
+
+	if(RESTART)
+		Checkpoint_load(ckpt);
+
+	if(STEADY_STATE){
+		steady_state(hpSize, nCycles, island, ckpt);
+	} else {
+		int i;
+		for(i = HIVE_cycle(); i < nCycles; i++){
+			forager_phase(hpSize);
+			onlooker_phase(hpSize);
+			scout_phase(hpSize);
+
+			if(island >= 0)
+				island_migrate(island, i, hpSize);
+
+			HIVE_increment_cycle();
+			HIVE_local_search();
+			if(Checkpoint_due(ckpt, HIVE_cycle()) || Checkpoint_signaled(ckpt))
+				Checkpoint_save(ckpt);
+			if(should_stop(island))
+				break;
+		}
+	}
+
+	Checkpoint_free(ckpt);
+}
+
+/* Runs the island model with N_HIVES hives, and returns the best solution among all of them
+ * Procedure idea:
+ *   Each hive lives in its own thread, with its own random stream and up to N_THREADS threads of its own
+ *   Hives exchange solutions through lock-free queues, one per ordered pair of hives (see island_migrate)
+ *   The archives of all hives are merged into 'archive', if it isn't NULL
+ *   The move counts of all hives are added to 'moveProposed' and 'moveAccepted' (see HIVE_move_counts)
+ */
+static
+Solution islands(int hpSize, int nCycles, Archive archive, long *moveProposed, long *moveAccepted){
 	int i;
-	for(i = 0; i < nCycles; i++){
-		forager_phase(hpSize);
-		onlooker_phase(hpSize);
-		scout_phase(hpSize);
+	int nQueues = N_HIVES * N_HIVES;
+	Solution best;
+	bool hasBest = false;
+
+	ISLANDS.nHives = N_HIVES;
+	ISLANDS.interval = MIGRATION_INTERVAL > 0 ? MIGRATION_INTERVAL : nCycles * 0.1;
+	if(ISLANDS.interval < 1)
+		ISLANDS.interval = 1;
+
+	atomic_init(&ISLANDS.stop, false);
+	atomic_init(&ISLANDS.nStagnant, 0);
+	ISLANDS.stagnant = calloc(N_HIVES, sizeof(bool));
+
+	ISLANDS.queues = malloc(sizeof(MigrationQueue) * nQueues);
+	for(i = 0; i < nQueues; i++)
+		ISLANDS.queues[i] = MigrationQueue_create(4 * N_MIGRANTS);
+
+	omp_set_max_active_levels(2);
+
+	#pragma omp parallel num_threads(N_HIVES)
+	{
+		int me = omp_get_thread_num();
+		Hive previous = HIVE_current();
+		Hive hive = HIVE_create();
+
+		random_use_stream(me);
+		HIVE_use(hive);
+		HIVE_initialize(hpSize);
+
+		run_hive(hpSize, nCycles, me);
+
+		Solution sol = HIVE_best_sol();
+		#pragma omp critical(ISLANDS)
+		{
+			if(!hasBest || Solution_fitness(sol) > Solution_fitness(best)){
+				if(hasBest) Solution_free(best);
+				best = sol;
+				hasBest = true;
+			} else {
+				Solution_free(sol);
+			}
+
+			if(archive)
+				Archive_merge(archive, HIVE_archive());
+			HIVE_move_counts(moveProposed, moveAccepted);
+		}
+
+		HIVE_destroy();
+		HIVE_use(previous);
+		HIVE_delete(hive);
 	}
 
-	Solution retval = HIVE_best_sol();
+	for(i = 0; i < nQueues; i++)
+		MigrationQueue_free(ISLANDS.queues[i]);
+	free(ISLANDS.queues);
+	free(ISLANDS.stagnant);
+
+	return best;
+}
+
+Solution ABC_predict_structure(const HPElem * hpChain, int hpSize, int nCycles, PredResults *results){
+	Solution retval;
+	Archive archive = ARCHIVE_SIZE > 1 ? Archive_create(ARCHIVE_SIZE, hpSize) : NULL;
+	long moveProposed[N_MOVES] = {0};
+	long moveAccepted[N_MOVES] = {0};
+	long exactNodes = 0;
+
+	Checkpoint_initialize();
+	FitnessCalc_initialize(hpChain, hpSize);
+	Growth_initialize(hpChain, hpSize);
+
+	// Fragments are folded before anything else, as they must not see the seed library nor the fitness cache
+	Fragments_initialize(hpChain, hpSize);
+	if(hpSize > EXACT_MAX_SIZE && Fragments_count() > 0)
+		Fragments_fold(0, 1, N_HIVES * N_THREADS);
+
+	if(strcmp(SEED_FILE, "none") != 0)
+		Seeds_load(SEED_FILE, hpSize);
+	if(hpSize > EXACT_MAX_SIZE)
+		Fragments_assemble();
+	FitnessCache_initialize(hpSize);
+
+	if(hpSize <= EXACT_MAX_SIZE){
+		retval = Exact_search(hpChain, hpSize, &exactNodes);
+	} else if(N_HIVES > 1){
+		retval = islands(hpSize, nCycles, archive, moveProposed, moveAccepted);
+	} else {
+		HIVE_initialize(hpSize);
+		run_hive(hpSize, nCycles, -1);
+		retval = HIVE_best_sol();
+		if(archive)
+			Archive_merge(archive, HIVE_archive());
+		HIVE_move_counts(moveProposed, moveAccepted);
+		HIVE_destroy();
+	}
 
 	if(results){
 		results->fitness = Solution_fitness(retval);
 		FitnessCalc_measures(Solution_chain(retval), &results->contactsH, &results->collisions, &results->bbGyration);
+		results->archive = NULL;
+		results->archiveSize = archive ? Archive_export(archive, &results->archive) : 0;
+		memcpy(results->moveProposed, moveProposed, sizeof(moveProposed));
+		memcpy(results->moveAccepted, moveAccepted, sizeof(moveAccepted));
+		results->exactNodes = exactNodes;
 	}
 
+	if(archive)
+		Archive_free(archive);
+
+	FitnessCache_cleanup();
 	FitnessCalc_cleanup();
-	HIVE_destroy();
+	Seeds_free();
+	Fragments_free();
 
 	return retval;
 }
-
@@ -0,0 +1,127 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <movchain.h>
+
+#include "archive.h"
+
+struct Archive_ {
+	Solution *sols;   /**< Solutions, sorted by decreasing fitness */
+	double *fits;     /**< Fitness of each solution */
+	MovElem **canons; /**< Canonical form of the chain of each solution (see MovChain_canonical) */
+	uint64_t *hashes; /**< Hash of the canonical form of each solution */
+	int size;         /**< Number of solutions held */
+	int capacity;     /**< Maximum number of solutions held */
+	int hpSize;       /**< Size of the HP chain of the protein */
+};
+
+// Documented in header file
+Archive Archive_create(int capacity, int hpSize){
+	Archive archive = malloc(sizeof(struct Archive_));
+	archive->sols = malloc(sizeof(Solution) * capacity);
+	archive->fits = malloc(sizeof(double) * capacity);
+	archive->hashes = malloc(sizeof(uint64_t) * capacity);
+	archive->canons = malloc(sizeof(MovElem *) * capacity);
+	archive->size = 0;
+
+	int i;
+	for(i = 0; i < capacity; i++)
+		archive->canons[i] = malloc(sizeof(MovElem) * (hpSize - 1));
+
+	archive->capacity = capacity;
+	archive->hpSize = hpSize;
+	return archive;
+}
+
+// Documented in header file
+void Archive_free(Archive archive){
+	int i;
+	for(i = 0; i < archive->size; i++)
+		Solution_free(archive->sols[i]);
+
+	for(i = 0; i < archive->capacity; i++)
+		free(archive->canons[i]);
+
+	free(archive->sols);
+	free(archive->fits);
+	free(archive->hashes);
+	free(archive->canons);
+	free(archive);
+}
+
+// Documented in header file
+int Archive_size(Archive archive){
+	return archive->size;
+}
+
+// Documented in header file
+Solution Archive_solution(Archive archive, int idx){
+	return archive->sols[idx];
+}
+
+// Documented in header file
+bool Archive_admits(Archive archive, double fitness){
+	if(archive->capacity <= 0) return false;
+	if(archive->size < archive->capacity) return true;
+	return fitness > archive->fits[archive->size - 1];
+}
+
+// Documented in header file
+void Archive_insert(Archive archive, Solution sol, double fitness){
+	if(!Archive_admits(archive, fitness)) return;
+
+	int chainSize = archive->hpSize - 1;
+	MovElem canon[chainSize];
+	MovChain_canonical(Solution_chain(sol), chainSize, canon);
+	uint64_t hash = MovChain_hash(canon, chainSize);
+
+	// Rotated or mirrored copies of an archived solution are duplicates too
+	int i;
+	for(i = 0; i < archive->size; i++){
+		if(archive->hashes[i] == hash && memcmp(archive->canons[i], canon, sizeof(MovElem) * chainSize) == 0)
+			return;
+	}
+
+	// Drop the worst solution if needed
+	if(archive->size == archive->capacity){
+		archive->size--;
+		Solution_free(archive->sols[archive->size]);
+	}
+
+	// Shift worse solutions down, and reuse the buffer of the canonical form past the last one
+	MovElem *canonBuf = archive->canons[archive->size];
+	for(i = archive->size; i > 0 && archive->fits[i-1] < fitness; i--){
+		archive->sols[i] = archive->sols[i-1];
+		archive->fits[i] = archive->fits[i-1];
+		archive->hashes[i] = archive->hashes[i-1];
+		archive->canons[i] = archive->canons[i-1];
+	}
+
+	archive->sols[i] = Solution_copy(sol, archive->hpSize);
+	Solution_set_fitness(&archive->sols[i], fitness);
+	Solution_reset_idle_iterations(&archive->sols[i]);
+	archive->fits[i] = fitness;
+	archive->hashes[i] = hash;
+	archive->canons[i] = canonBuf;
+	memcpy(canonBuf, canon, sizeof(MovElem) * chainSize);
+	archive->size++;
+}
+
+// Documented in header file
+void Archive_merge(Archive dest, Archive src){
+	int i;
+	for(i = 0; i < src->size; i++)
+		Archive_insert(dest, src->sols[i], src->fits[i]);
+}
+
+// Documented in header file
+int Archive_export(Archive archive, Solution **sols){
+	*sols = malloc(sizeof(Solution) * archive->size);
+
+	int i;
+	for(i = 0; i < archive->size; i++)
+		(*sols)[i] = Solution_copy(archive->sols[i], archive->hpSize);
+
+	return archive->size;
+}
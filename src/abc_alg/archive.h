@@ -0,0 +1,45 @@
+#ifndef _ARCHIVE_H_
+#define _ARCHIVE_H_
+
+/** \file archive.h Routines for keeping the best distinct solutions found by a hive.
+ *
+ * An archive holds up to a fixed number of solutions, sorted by decreasing fitness.
+ * Solutions with the same movement chain, or whose conformations are rotated or mirrored copies of each other,
+ *   are kept only once. This is checked through the canonical form of the chain (see MovChain_canonical()).
+ */
+
+#include <stdbool.h>
+#include <solution/solution.h>
+
+/** Handle to an archive. */
+typedef struct Archive_ *Archive;
+
+/** Creates an empty archive that keeps up to 'capacity' solutions of proteins with 'hpSize' beads. */
+Archive Archive_create(int capacity, int hpSize);
+
+/** Frees the archive and all solutions within it. */
+void Archive_free(Archive archive);
+
+/** Returns the number of solutions in the archive. */
+int Archive_size(Archive archive);
+
+/** Returns the idx-th best solution in the archive. */
+Solution Archive_solution(Archive archive, int idx);
+
+/** Returns whether a solution with fitness 'fitness' would be kept, if it isn't a duplicate. */
+bool Archive_admits(Archive archive, double fitness);
+
+/** Inserts a deep copy of 'sol', whose fitness is 'fitness', unless it isn't admitted or is already in the archive.
+ * If the archive is full, its worst solution is dropped.
+ */
+void Archive_insert(Archive archive, Solution sol, double fitness);
+
+/** Inserts all solutions of 'src' into 'dest'. */
+void Archive_merge(Archive dest, Archive src);
+
+/** Stores in '*sols' a newly allocated vector with deep copies of all solutions in the archive.
+ * Returns the number of solutions.
+ */
+int Archive_export(Archive archive, Solution **sols);
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <random.h>
+#include <config.h>
+
+#include "hive.h"
+#include "checkpoint.h"
+
+static const char MAGIC[8] = "ELFCKPT";
+static const uint32_t VERSION = 1;
+
+/** Header of a checkpoint file. The state of the hive and the RandomState follow. */
+typedef struct CheckpointHeader_ {
+	char magic[8];
+	uint32_t version;
+	uint32_t randomSize; /**< sizeof(RandomState) of the writer */
+	uint64_t hiveSize;   /**< Number of bytes of the state of the hive */
+} CheckpointHeader;
+
+struct Checkpoint_ {
+	char *path;        /**< Name of the checkpoint file */
+	char *tmpPath;     /**< Name of the temporary file written before renaming */
+	int seenSignals;   /**< Value of SIGNALS in the last call to Checkpoint_signaled() */
+
+	pthread_t writer;  /**< Thread writing the last checkpoint */
+	bool writing;      /**< Whether 'writer' must be joined */
+	char *buf;         /**< Contents being written by 'writer' */
+	size_t bufSize;    /**< Number of bytes in 'buf' */
+};
+
+/** Number of SIGUSR1 received */
+static volatile sig_atomic_t SIGNALS = 0;
+
+static
+void signal_handler(int sig){
+	SIGNALS++;
+}
+
+// Documented in header file
+void Checkpoint_initialize(){
+	if(!CHECKPOINT_SIGNAL) return;
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = signal_handler;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGUSR1, &action, NULL);
+}
+
+// Documented in header file
+Checkpoint Checkpoint_create(int hive){
+	Checkpoint ckpt = malloc(sizeof(struct Checkpoint_));
+	int len = strlen(CHECKPOINT_FILE) + 32;
+
+	ckpt->path = malloc(len);
+	ckpt->tmpPath = malloc(len);
+	sprintf(ckpt->path, "%s.%d", CHECKPOINT_FILE, hive);
+	sprintf(ckpt->tmpPath, "%s.%d.tmp", CHECKPOINT_FILE, hive);
+
+	ckpt->seenSignals = SIGNALS;
+	ckpt->writing = false;
+	ckpt->buf = NULL;
+	return ckpt;
+}
+
+/* Waits for the write in progress, if any */
+static
+void wait_writer(Checkpoint ckpt){
+	if(ckpt->writing){
+		pthread_join(ckpt->writer, NULL);
+		ckpt->writing = false;
+		free(ckpt->buf);
+		ckpt->buf = NULL;
+	}
+}
+
+// Documented in header file
+void Checkpoint_free(Checkpoint ckpt){
+	wait_writer(ckpt);
+	free(ckpt->path);
+	free(ckpt->tmpPath);
+	free(ckpt);
+}
+
+// Documented in header file
+bool Checkpoint_due(Checkpoint ckpt, int cycle){
+	return CHECKPOINT_INTERVAL > 0 && cycle > 0 && cycle % CHECKPOINT_INTERVAL == 0;
+}
+
+// Documented in header file
+bool Checkpoint_signaled(Checkpoint ckpt){
+	int signals = SIGNALS;
+	if(signals == ckpt->seenSignals) return false;
+	ckpt->seenSignals = signals;
+	return true;
+}
+
+/* Body of the writer thread */
+static
+void *write_file(void *arg){
+	Checkpoint ckpt = arg;
+
+	FILE *fp = fopen(ckpt->tmpPath, "wb");
+	if(!fp){
+		fprintf(stderr, "Could not write checkpoint file '%s'.\n", ckpt->tmpPath);
+		return NULL;
+	}
+
+	size_t written = fwrite(ckpt->buf, 1, ckpt->bufSize, fp);
+	fflush(fp);
+	fsync(fileno(fp));
+	fclose(fp);
+
+	if(written != ckpt->bufSize || rename(ckpt->tmpPath, ckpt->path) != 0)
+		fprintf(stderr, "Could not write checkpoint file '%s'.\n", ckpt->path);
+
+	return NULL;
+}
+
+// Documented in header file
+void Checkpoint_save(Checkpoint ckpt){
+	wait_writer(ckpt);
+
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.randomSize = sizeof(RandomState);
+	header.hiveSize = HIVE_serialized_size();
+
+	ckpt->bufSize = sizeof(header) + header.hiveSize + sizeof(RandomState);
+	ckpt->buf = malloc(ckpt->bufSize);
+
+	char *pos = ckpt->buf;
+	memcpy(pos, &header, sizeof(header));
+	pos += sizeof(header);
+	pos += HIVE_serialize(pos);
+	memcpy(pos, &RANDOM_STATE, sizeof(RandomState));
+
+	if(pthread_create(&ckpt->writer, NULL, write_file, ckpt) == 0){
+		ckpt->writing = true;
+	} else {
+		write_file(ckpt);
+		free(ckpt->buf);
+		ckpt->buf = NULL;
+	}
+}
+
+// Documented in header file
+bool Checkpoint_load(Checkpoint ckpt){
+	FILE *fp = fopen(ckpt->path, "rb");
+	if(!fp){
+		fprintf(stderr, "Checkpoint file '%s' not found. Starting from scratch.\n", ckpt->path);
+		return false;
+	}
+
+	CheckpointHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1
+	       && memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+	       && header.version == VERSION
+	       && header.randomSize == sizeof(RandomState);
+
+	char *buf = NULL;
+	RandomState state;
+	if(ok){
+		buf = malloc(header.hiveSize);
+		ok = fread(buf, header.hiveSize, 1, fp) == 1
+		  && fread(&state, sizeof(RandomState), 1, fp) == 1
+		  && HIVE_deserialize(buf, header.hiveSize);
+	}
+
+	free(buf);
+	fclose(fp);
+
+	if(!ok){
+		fprintf(stderr, "Checkpoint file '%s' is invalid or doesn't match the configuration.\n", ckpt->path);
+		exit(EXIT_FAILURE);
+	}
+
+	RANDOM_STATE = state;
+	return true;
+}
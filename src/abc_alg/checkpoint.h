@@ -0,0 +1,47 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+/** \file checkpoint.h Routines for saving the state of a hive to a file, and restoring it.
+ *
+ * A checkpoint file holds a small header, the state of the hive (see HIVE_serialize()) and the
+ *   state of the random number generator of the thread that runs the hive.
+ * The file of hive H is named CHECKPOINT_FILE.H.
+ *
+ * Files are written by a background thread to a temporary file, which is then renamed,
+ *   so a crash in the middle of a write never destroys the previous checkpoint.
+ */
+
+#include <stdbool.h>
+
+/** Handle to the checkpoint file of a hive. */
+typedef struct Checkpoint_ *Checkpoint;
+
+/** Makes SIGUSR1 request a checkpoint, if CHECKPOINT_SIGNAL is set.
+ * Should be called by every process before its work begins, so that the signal doesn't terminate it.
+ */
+void Checkpoint_initialize();
+
+/** Creates the handle to the checkpoint file of the hive with index 'hive'. */
+Checkpoint Checkpoint_create(int hive);
+
+/** Waits for the write in progress, if any, and frees the handle. */
+void Checkpoint_free(Checkpoint ckpt);
+
+/** Returns whether a checkpoint is due after the hive finished its 'cycle'-th cycle, according to CHECKPOINT_INTERVAL. */
+bool Checkpoint_due(Checkpoint ckpt, int cycle);
+
+/** Returns whether SIGUSR1 was received since the last call for this handle. */
+bool Checkpoint_signaled(Checkpoint ckpt);
+
+/** Saves the hive of the calling thread, along with the generator of the calling thread.
+ * The state is copied right away, and written in the background.
+ */
+void Checkpoint_save(Checkpoint ckpt);
+
+/** Restores the hive of the calling thread, which must be initialized, and the generator of the calling thread.
+ * Returns false if the file doesn't exist, in which case a message is printed and nothing is restored.
+ * If the file is invalid or doesn't match the hive, the program is terminated.
+ */
+bool Checkpoint_load(Checkpoint ckpt);
+
+#endif
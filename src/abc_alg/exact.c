@@ -0,0 +1,704 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include <int3d.h>
+#include <movchain.h>
+#include <fitness/fitness.h>
+#include <config.h>
+
+#include "exact.h"
+
+/** Kinds of beads in the lattice */
+enum BeadKind { BEAD_FREE = 0, BEAD_BB = 1, BEAD_H = 2, BEAD_P = 3 };
+
+/** Kinds of contacts between beads, each weighted by its own epsilon */
+enum ContactKind { CONTACT_HH, CONTACT_PP, CONTACT_HP, CONTACT_HB, CONTACT_PB, CONTACT_BB, N_CONTACTS };
+
+static const int3d UNIT[6] = {
+	{ 1, 0, 0}, {-1, 0, 0},
+	{ 0, 1, 0}, { 0,-1, 0},
+	{ 0, 0, 1}, { 0, 0,-1},
+};
+
+/* Index in UNIT of the direction opposite to UNIT[d] */
+#define OPPOSITE(d) ((d) ^ 1)
+
+/** Number of pairs of directions (d, e) an element can take, stored as d * 6 + e */
+#define N_OPTIONS 36
+
+/** Number of rotations and reflections that keep the X axis in place */
+#define N_SYMMETRIES 8
+
+/** Bit set of all symmetries but the identity (symmetry 0) */
+#define OTHER_SYMMETRIES (((1 << N_SYMMETRIES) - 1) & ~1)
+
+/** Maximum number of contacts a bead makes with the beads placed before it, besides the one it is bound to */
+#define MAX_NEW_CONTACTS 5
+
+/** Added to upper bounds, see upper_bound() */
+#define BOUND_SLACK 1E-9
+
+/** Number of partial chains to split among each thread */
+#define PREFIXES_PER_THREAD 64
+
+/** Protein being searched, and what all threads share */
+static struct {
+	const HPElem *hpChain;
+	int hpSize;
+	int chainSize;
+	int eps[N_CONTACTS];
+	int *root;                /**< root[c]: square root of 'c' contacts, rounded down as in the fitness */
+	int (*reach)[N_CONTACTS]; /**< reach[E][k]: most contacts of kind k made by the beads of elements E onwards */
+	double maxRG_H;           /**< See FitnessCalc_max_gyration() */
+	double minFactor;         /**< Lower bound of the gyration factors the energy is multiplied by, which may be negative */
+	int nH;                   /**< Number of H beads */
+	long *apartPairs;         /**< apartPairs[E]: least sum of squared distances of the pairs of H side chain beads
+	                           *     not both placed by the first E elements */
+	unsigned char symmetry[N_SYMMETRIES][N_OPTIONS]; /**< Each option of an element, under each symmetry */
+	int side;                 /**< Number of points along each axis of the lattices */
+	int step[6];              /**< Offset in the lattices of each direction of UNIT */
+
+	_Atomic double best;      /**< Fitness of the best chain found so far */
+	unsigned char *bestOpts;  /**< Options taken by the elements of that chain */
+	long nodes;
+} EXACT;
+
+/** State of the search of one thread */
+typedef struct {
+	unsigned char *lattice; /**< Kind of bead in each point */
+	int3d *bb, *sc;         /**< Beads placed so far */
+	int *bbDir;             /**< Direction (index in UNIT) from each backbone bead to the next */
+	unsigned char *opts;    /**< Option taken by each element placed so far */
+	int contacts[N_CONTACTS]; /**< Contacts of each kind among the beads placed so far, except trivial ones */
+	long *hPairs;           /**< hPairs[E]: sum of squared distances of the pairs of H side chain beads placed by
+	                         *     the first E elements */
+	long nodes;
+} Searcher;
+
+/** Option an element can take, with what it would change */
+typedef struct {
+	int opt;
+	int symmetric;          /**< Symmetries under which the chain would still be equal to its copy */
+	int3d p1, p2;           /**< Beads the element places */
+	int delta[N_CONTACTS];  /**< Contacts the beads would make */
+	int gain;               /**< Energy of those contacts */
+} Option;
+
+/** Partial chain to be searched by some thread */
+typedef struct {
+	unsigned char *opts;
+	int symmetric;
+	double bound;
+} Prefix;
+
+/** Prefixes left to a thread, which other threads may steal */
+typedef struct {
+	int next, end;
+	omp_lock_t lock;
+} WorkRange;
+
+/******************************************/
+/****** SETUP PROCEDURES           ********/
+/******************************************/
+
+static inline
+int side_chain_kind(int bead){
+	return EXACT.hpChain[bead] == 'H' ? BEAD_H : BEAD_P;
+}
+
+/* Kind of contact between beads of kinds 'a' and 'b' */
+static inline
+int contact_kind(int a, int b){
+	static const int KIND[4][4] = {
+		{ -1, -1,         -1,         -1         },
+		{ -1, CONTACT_BB, CONTACT_HB, CONTACT_PB },
+		{ -1, CONTACT_HB, CONTACT_HH, CONTACT_HP },
+		{ -1, CONTACT_PB, CONTACT_HP, CONTACT_PP },
+	};
+	return KIND[a][b];
+}
+
+/* Fills EXACT.symmetry
+ * Procedure idea:
+ *   Symmetry 's' negates Y if bit 0 is set, negates Z if bit 1 is set, and swaps them (after negating) if bit 2 is set
+ *   Symmetry 0 is the identity
+ */
+static
+void init_symmetries(){
+	int s, d, e;
+	for(s = 0; s < N_SYMMETRIES; s++){
+		int map[6];
+		for(d = 0; d < 6; d++){
+			int3d v = UNIT[d];
+			if(s & 1) v.y = -v.y;
+			if(s & 2) v.z = -v.z;
+			if(s & 4){ int t = v.y; v.y = v.z; v.z = t; }
+			for(e = 0; e < 6; e++)
+				if(int3d_equal(v, UNIT[e]))
+					map[d] = e;
+		}
+		for(d = 0; d < 6; d++)
+			for(e = 0; e < 6; e++)
+				EXACT.symmetry[s][d * 6 + e] = map[d] * 6 + map[e];
+	}
+}
+
+/* Fills EXACT.reach
+ * Procedure idea:
+ *   Beads are placed in the order BB0, BB1, SC0, SC1 (element 0), then BB[E+1], SC[E+1] (element E)
+ *   A bead only touches points of the other color of the lattice: BB[i] and SC[i+1] are on one color, SC[i]
+ *     and BB[i+1] on the other. So the contacts of kind k a bead makes when placed are at most the earlier
+ *     beads of the matching kind and the other color, other than the one it is bound to, and at most 5
+ *   Each contact is counted once, by the later of its two beads
+ */
+static
+void init_reach(){
+	int nBeads = 2 * EXACT.hpSize;
+	int kind[nBeads], color[nBeads], bound[nBeads], elem[nBeads];
+	int t, u, k;
+
+	for(t = 0; t < nBeads; t++){
+		int bead = t < 2 ? t : (t < 4 ? t - 2 : t / 2);
+		bool isBB = t < 2 || (t >= 4 && t % 2 == 0);
+
+		kind[t] = isBB ? BEAD_BB : side_chain_kind(bead);
+		color[t] = isBB ? (bead + 1) % 2 : bead % 2;
+		elem[t] = t < 4 ? 0 : bead - 1;
+		if(t < 4)
+			bound[t] = t % 2 - (t < 2);
+		else
+			bound[t] = isBB && bead == 2 ? 1 : t - 1 - isBB;
+	}
+
+	EXACT.reach = calloc(EXACT.chainSize + 1, sizeof(*EXACT.reach));
+	for(t = 2; t < nBeads; t++){
+		int made[N_CONTACTS] = {0};
+		for(u = 0; u < t; u++)
+			if(u != bound[t] && color[u] != color[t])
+				made[contact_kind(kind[t], kind[u])]++;
+		for(k = 0; k < N_CONTACTS; k++)
+			EXACT.reach[elem[t]][k] += made[k] < MAX_NEW_CONTACTS ? made[k] : MAX_NEW_CONTACTS;
+	}
+
+	for(t = EXACT.chainSize - 1; t >= 0; t--)
+		for(k = 0; k < N_CONTACTS; k++)
+			EXACT.reach[t][k] += EXACT.reach[t + 1][k];
+}
+
+/* Sets EXACT.minFactor and EXACT.apartPairs
+ * Procedure idea:
+ *   The fitness is the energy times (maxRG_H - RG_H) times a factor in (0, 1] for the P beads, and
+ *     RG_H^2 is the sum of the squared distances of all pairs of H beads divided by nH^2
+ *   No two H beads i, j are farther apart than |i - j| + 2 (the length of the path between them along the chain),
+ *     which gives the lower bound of the factors
+ *   No two are closer than 1, or than sqrt(2) if they are on the same color of the lattice (|i - j| even),
+ *     which gives the least distances of the pairs not placed yet
+ */
+static
+void init_factors(){
+	double farthest = 0;
+	int i, j, elem;
+
+	EXACT.nH = 0;
+	EXACT.apartPairs = calloc(EXACT.chainSize + 1, sizeof(long));
+	for(i = 0; i < EXACT.hpSize; i++){
+		if(EXACT.hpChain[i] != 'H') continue;
+		EXACT.nH++;
+		for(j = i + 1; j < EXACT.hpSize; j++){
+			if(EXACT.hpChain[j] != 'H') continue;
+			farthest += (j - i + 2) * (double) (j - i + 2);
+
+			// Side chain bead j is placed by element j - 1, or 0 for j = 1
+			int placedBy = j > 1 ? j - 1 : 0;
+			for(elem = 0; elem <= placedBy; elem++)
+				EXACT.apartPairs[elem] += (j - i) % 2 == 0 ? 2 : 1;
+		}
+	}
+
+	EXACT.maxRG_H = FitnessCalc_max_gyration();
+	double least = EXACT.maxRG_H - sqrt(farthest / (EXACT.nH * (double) EXACT.nH));
+	EXACT.minFactor = least < 0 ? least : 0;
+}
+
+/******************************************/
+/****** SEARCH PROCEDURES          ********/
+/******************************************/
+
+static inline
+long lattice_index(int3d p){
+	int offset = EXACT.side / 2;
+	return (p.x + offset) + EXACT.side * ((p.y + offset) + EXACT.side * (long) (p.z + offset));
+}
+
+static
+void searcher_init(Searcher *s){
+	long points = EXACT.side * (long) EXACT.side * EXACT.side;
+	s->lattice = calloc(points, sizeof(unsigned char));
+	s->bb = malloc(sizeof(int3d) * EXACT.hpSize);
+	s->sc = malloc(sizeof(int3d) * EXACT.hpSize);
+	s->bbDir = malloc(sizeof(int) * EXACT.hpSize);
+	s->opts = malloc(EXACT.chainSize + 1);
+	memset(s->contacts, 0, sizeof(s->contacts));
+	s->hPairs = calloc(EXACT.chainSize + 1, sizeof(long));
+	s->nodes = 0;
+
+	s->bb[0] = int3d_make(1, 0, 0);
+	s->bb[1] = int3d_make(2, 0, 0);
+	s->bbDir[1] = 0;
+	s->lattice[lattice_index(s->bb[0])] = BEAD_BB;
+	s->lattice[lattice_index(s->bb[1])] = BEAD_BB;
+}
+
+static
+void searcher_free(Searcher *s){
+	free(s->lattice);
+	free(s->bb);
+	free(s->sc);
+	free(s->bbDir);
+	free(s->opts);
+	free(s->hPairs);
+}
+
+/* Adds to 'delta' the contacts a bead of kind 'kind' would make in 'p', except with the bead in 'bound' */
+static inline
+void count_contacts(const Searcher *s, int3d p, int kind, int3d bound, int *delta){
+	long idx = lattice_index(p);
+	long skip = lattice_index(bound) - idx;
+	int i;
+	for(i = 0; i < 6; i++){
+		int other = s->lattice[idx + EXACT.step[i]];
+		if(other != BEAD_FREE && EXACT.step[i] != skip)
+			delta[contact_kind(kind, other)]++;
+	}
+}
+
+/* Fills 'o' with option 'opt' of element 'elem'. Returns false if the option isn't possible:
+ *   it goes right back over the bead it comes from, or one of its beads would collide
+ * Element 0 places side chain beads 0 and 1, and element E > 0 places backbone and side chain beads E+1.
+ */
+static
+bool option_make(const Searcher *s, int elem, int opt, Option *o){
+	int d = opt / 6;
+	int e = opt % 6;
+
+	o->opt = opt;
+	memset(o->delta, 0, sizeof(o->delta));
+
+	if(elem == 0){
+		// Backbone bead 1 is at +x of backbone bead 0
+		if(d == 0 || e == 1)
+			return false;
+		o->p1 = int3d_add(s->bb[0], UNIT[d]);
+		o->p2 = int3d_add(s->bb[1], UNIT[e]);
+
+		int k1 = side_chain_kind(0), k2 = side_chain_kind(1);
+		count_contacts(s, o->p1, k1, s->bb[0], o->delta);
+		count_contacts(s, o->p2, k2, s->bb[1], o->delta);
+		if(int3d_isDist1(o->p1, o->p2))
+			o->delta[contact_kind(k1, k2)]++;
+	} else {
+		if(d == OPPOSITE(s->bbDir[elem]) || e == OPPOSITE(d))
+			return false;
+		o->p1 = int3d_add(s->bb[elem], UNIT[d]);
+		o->p2 = int3d_add(o->p1, UNIT[e]);
+		if(s->lattice[lattice_index(o->p1)] != BEAD_FREE || s->lattice[lattice_index(o->p2)] != BEAD_FREE)
+			return false;
+
+		count_contacts(s, o->p1, BEAD_BB, s->bb[elem], o->delta);
+		count_contacts(s, o->p2, side_chain_kind(elem + 1), o->p1, o->delta);
+	}
+
+	int k;
+	o->gain = 0;
+	for(k = 0; k < N_CONTACTS; k++)
+		o->gain += EXACT.eps[k] * o->delta[k];
+	return true;
+}
+
+/* Returns false if a symmetric copy of the chain would come first with option 'opt' of the next element.
+ * Otherwise, takes out of 'symmetric' the symmetries whose copy would come after it.
+ */
+static inline
+bool option_unbroken(int opt, int *symmetric){
+	int sym;
+	for(sym = 1; sym < N_SYMMETRIES; sym++){
+		if(!(*symmetric & (1 << sym)))
+			continue;
+		int other = EXACT.symmetry[sym][opt];
+		if(other < opt)
+			return false;
+		if(other > opt)
+			*symmetric &= ~(1 << sym);
+	}
+	return true;
+}
+
+static inline
+long squared_distance(int3d a, int3d b){
+	int dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+	return dx * dx + dy * dy + dz * dz;
+}
+
+static
+void place(Searcher *s, int elem, const Option *o){
+	int k;
+	for(k = 0; k < N_CONTACTS; k++)
+		s->contacts[k] += o->delta[k];
+	s->opts[elem] = o->opt;
+
+	if(elem == 0){
+		s->sc[0] = o->p1;
+		s->sc[1] = o->p2;
+		s->lattice[lattice_index(o->p1)] = side_chain_kind(0);
+		s->lattice[lattice_index(o->p2)] = side_chain_kind(1);
+
+		s->hPairs[1] = 0;
+		if(side_chain_kind(0) == BEAD_H && side_chain_kind(1) == BEAD_H)
+			s->hPairs[1] = squared_distance(o->p1, o->p2);
+	} else {
+		s->bb[elem + 1] = o->p1;
+		s->sc[elem + 1] = o->p2;
+		s->bbDir[elem + 1] = o->opt / 6;
+		s->lattice[lattice_index(o->p1)] = BEAD_BB;
+		s->lattice[lattice_index(o->p2)] = side_chain_kind(elem + 1);
+
+		s->hPairs[elem + 1] = s->hPairs[elem];
+		if(side_chain_kind(elem + 1) == BEAD_H){
+			int i;
+			for(i = 0; i <= elem; i++)
+				if(side_chain_kind(i) == BEAD_H)
+					s->hPairs[elem + 1] += squared_distance(o->p2, s->sc[i]);
+		}
+	}
+}
+
+static
+void unplace(Searcher *s, int elem, const Option *o){
+	int k;
+	for(k = 0; k < N_CONTACTS; k++)
+		s->contacts[k] -= o->delta[k];
+	s->lattice[lattice_index(o->p1)] = BEAD_FREE;
+	s->lattice[lattice_index(o->p2)] = BEAD_FREE;
+}
+
+/* Upper bound of the fitness of any chain starting with the elements placed in 's', up to 'elem' (exclusive)
+ * Procedure idea:
+ *   Each kind of contact ends up between its current count and that plus its reach (see init_reach), so the
+ *     energy is within [low, high]
+ *   RG_H is at least what the H beads placed so far and the least distances of the others give (see init_factors),
+ *     so the gyration factors are within [minFactor, most], and as minFactor <= 0, the fitness is at most
+ *     high * most or low * minFactor
+ *   BOUND_SLACK keeps rounding in the fitness calculation from pruning a chain just as good as the bound
+ */
+static
+double upper_bound(const Searcher *s, int elem){
+	int low = 0, high = 0;
+	int k;
+	for(k = 0; k < N_CONTACTS; k++){
+		int least = EXACT.root[s->contacts[k]];
+		int most = EXACT.root[s->contacts[k] + EXACT.reach[elem][k]];
+		if(EXACT.eps[k] >= 0){
+			low += EXACT.eps[k] * least;
+			high += EXACT.eps[k] * most;
+		} else {
+			low += EXACT.eps[k] * most;
+			high += EXACT.eps[k] * least;
+		}
+	}
+
+	double spread = (s->hPairs[elem] + EXACT.apartPairs[elem]) / (EXACT.nH * (double) EXACT.nH);
+	double most = fmax(EXACT.maxRG_H - sqrt(spread), 0);
+	return fmax(high * most, low * EXACT.minFactor) + BOUND_SLACK;
+}
+
+static inline
+double best_so_far(){
+	return atomic_load_explicit(&EXACT.best, memory_order_relaxed);
+}
+
+/* Offers the complete chain placed in 's' as the best one */
+static
+void offer(Searcher *s){
+	double fit = FitnessCalc_run(s->bb, s->sc);
+	if(fit <= best_so_far())
+		return;
+
+	#pragma omp critical(EXACT)
+	{
+		if(fit > best_so_far()){
+			atomic_store_explicit(&EXACT.best, fit, memory_order_relaxed);
+			memcpy(EXACT.bestOpts, s->opts, EXACT.chainSize);
+		}
+	}
+}
+
+/* Options of element 'elem' not broken by symmetry, sorted by decreasing energy of the contacts they make
+ *   (so good chains are found early and prune the rest). Returns their number.
+ */
+static
+int list_options(const Searcher *s, int elem, int symmetric, Option *options){
+	int n = 0;
+	int opt;
+	for(opt = 0; opt < N_OPTIONS; opt++){
+		int sym = symmetric;
+		if(!option_unbroken(opt, &sym) || !option_make(s, elem, opt, &options[n]))
+			continue;
+		options[n].symmetric = sym;
+
+		// Insertion sort
+		Option o = options[n];
+		int i = n++;
+		while(i > 0 && options[i - 1].gain < o.gain){
+			options[i] = options[i - 1];
+			i--;
+		}
+		options[i] = o;
+	}
+	return n;
+}
+
+/* Searches all chains starting with the 'elem' elements placed in 's' */
+static
+void search(Searcher *s, int elem, int symmetric){
+	s->nodes++;
+	if(elem == EXACT.chainSize){
+		offer(s);
+		return;
+	}
+
+	Option options[N_OPTIONS];
+	int n = list_options(s, elem, symmetric, options);
+	int i;
+	for(i = 0; i < n; i++){
+		place(s, elem, &options[i]);
+		if(upper_bound(s, elem + 1) > best_so_far())
+			search(s, elem + 1, options[i].symmetric);
+		unplace(s, elem, &options[i]);
+	}
+}
+
+/******************************************/
+/****** PARALLEL PROCEDURES        ********/
+/******************************************/
+
+/* Appends to '*prefixes' all partial chains with 'depth' elements starting with the 'elem' elements placed in 's' */
+static
+void collect(Searcher *s, int elem, int depth, int symmetric, Prefix **prefixes, int *count, int *alloc){
+	if(elem == depth){
+		if(*count == *alloc){
+			*alloc = *alloc * 2 + 16;
+			*prefixes = realloc(*prefixes, sizeof(Prefix) * *alloc);
+		}
+		Prefix *p = &(*prefixes)[(*count)++];
+		p->opts = malloc(depth + 1);
+		memcpy(p->opts, s->opts, depth);
+		p->symmetric = symmetric;
+		p->bound = upper_bound(s, elem);
+		return;
+	}
+
+	Option options[N_OPTIONS];
+	int n = list_options(s, elem, symmetric, options);
+	int i;
+	for(i = 0; i < n; i++){
+		place(s, elem, &options[i]);
+		collect(s, elem + 1, depth, options[i].symmetric, prefixes, count, alloc);
+		unplace(s, elem, &options[i]);
+	}
+}
+
+/* Places in 's' the 'depth' elements of 'opts' */
+static
+void replay(Searcher *s, const unsigned char *opts, int depth, Option *placed){
+	int elem;
+	for(elem = 0; elem < depth; elem++){
+		option_make(s, elem, opts[elem], &placed[elem]);
+		place(s, elem, &placed[elem]);
+	}
+}
+
+static
+int by_bound(const void *a, const void *b){
+	double x = ((const Prefix *) a)->bound, y = ((const Prefix *) b)->bound;
+	return (x < y) - (x > y);
+}
+
+/* Returns the index of the next prefix for thread 'me', or -1 if there are none left to any thread
+ * Procedure idea:
+ *   A thread takes its prefixes from the front of its range
+ *   Once it's empty, it steals the back half of the largest range left
+ */
+static
+int next_prefix(WorkRange *ranges, int nThreads, int me){
+	int got = -1;
+
+	omp_set_lock(&ranges[me].lock);
+	if(ranges[me].next < ranges[me].end)
+		got = ranges[me].next++;
+	omp_unset_lock(&ranges[me].lock);
+
+	while(got < 0){
+		int victim = -1, most = 0;
+		int i;
+		for(i = 0; i < nThreads; i++){
+			omp_set_lock(&ranges[i].lock);
+			int left = ranges[i].end - ranges[i].next;
+			omp_unset_lock(&ranges[i].lock);
+			if(left > most){
+				most = left;
+				victim = i;
+			}
+		}
+		if(victim < 0)
+			return -1;
+
+		int from = -1, to = -1;
+		omp_set_lock(&ranges[victim].lock);
+		int left = ranges[victim].end - ranges[victim].next;
+		if(left > 0){
+			to = ranges[victim].end;
+			from = to - (left + 1) / 2;
+			ranges[victim].end = from;
+		}
+		omp_unset_lock(&ranges[victim].lock);
+
+		if(from >= 0){
+			omp_set_lock(&ranges[me].lock);
+			ranges[me].next = from + 1;
+			ranges[me].end = to;
+			omp_unset_lock(&ranges[me].lock);
+			got = from;
+		}
+	}
+
+	return got;
+}
+
+/* Splits the search into prefixes and searches them with N_THREADS threads
+ * Procedure idea:
+ *   Prefixes are made one element longer until there are PREFIXES_PER_THREAD per thread
+ *   They are sorted by decreasing bound and dealt one at a time to each thread's range, so every thread starts
+ *     with the most promising ones
+ */
+static
+void search_parallel(){
+	int nThreads = N_THREADS > 0 ? N_THREADS : 1;
+	Prefix *sorted = NULL;
+	int count = 0, alloc = 0;
+	int depth = 0;
+	int i;
+
+	Searcher s;
+	searcher_init(&s);
+	collect(&s, 0, depth, OTHER_SYMMETRIES, &sorted, &count, &alloc);
+	while(count < PREFIXES_PER_THREAD * nThreads && depth < EXACT.chainSize){
+		for(i = 0; i < count; i++)
+			free(sorted[i].opts);
+		count = 0;
+		depth++;
+		collect(&s, 0, depth, OTHER_SYMMETRIES, &sorted, &count, &alloc);
+	}
+	EXACT.nodes = 0;
+	searcher_free(&s);
+
+	qsort(sorted, count, sizeof(Prefix), by_bound);
+
+	Prefix *prefixes = malloc(sizeof(Prefix) * (count + 1));
+	WorkRange *ranges = malloc(sizeof(WorkRange) * nThreads);
+	int at = 0, t;
+	for(t = 0; t < nThreads; t++){
+		ranges[t].next = at;
+		for(i = t; i < count; i += nThreads)
+			prefixes[at++] = sorted[i];
+		ranges[t].end = at;
+		omp_init_lock(&ranges[t].lock);
+	}
+	free(sorted);
+
+	#pragma omp parallel num_threads(nThreads)
+	{
+		int me = omp_get_thread_num();
+		Option placed[depth + 1];
+		Searcher mine;
+		searcher_init(&mine);
+
+		int p;
+		while((p = next_prefix(ranges, nThreads, me)) >= 0){
+			if(prefixes[p].bound <= best_so_far())
+				continue;
+			replay(&mine, prefixes[p].opts, depth, placed);
+			search(&mine, depth, prefixes[p].symmetric);
+			for(i = depth - 1; i >= 0; i--)
+				unplace(&mine, i, &placed[i]);
+		}
+
+		#pragma omp critical(EXACT)
+		EXACT.nodes += mine.nodes;
+		searcher_free(&mine);
+	}
+
+	for(t = 0; t < nThreads; t++)
+		omp_destroy_lock(&ranges[t].lock);
+	for(i = 0; i < count; i++)
+		free(prefixes[i].opts);
+	free(prefixes);
+	free(ranges);
+}
+
+// Documented in header file
+Solution Exact_search(const HPElem *hpChain, int hpSize, long *nodes){
+	EXACT.hpChain = hpChain;
+	EXACT.hpSize = hpSize;
+	EXACT.chainSize = hpSize - 1;
+	EXACT.eps[CONTACT_HH] = EPS_HH;
+	EXACT.eps[CONTACT_PP] = EPS_PP;
+	EXACT.eps[CONTACT_HP] = EPS_HP;
+	EXACT.eps[CONTACT_HB] = EPS_HB;
+	EXACT.eps[CONTACT_PB] = EPS_PB;
+	EXACT.eps[CONTACT_BB] = EPS_BB;
+
+	// Beads never get farther than the protein size from the origin, and the lattice has a margin around them
+	EXACT.side = 2 * hpSize + 8;
+	int i;
+	for(i = 0; i < 6; i++)
+		EXACT.step[i] = UNIT[i].x + EXACT.side * (UNIT[i].y + EXACT.side * UNIT[i].z);
+
+	// Each of the 2 * hpSize beads has 6 neighbors, and reaches are at most 5 per bead
+	EXACT.root = malloc(sizeof(int) * (16 * hpSize + 1));
+	for(i = 0; i <= 16 * hpSize; i++)
+		EXACT.root[i] = sqrt(i);
+
+	init_symmetries();
+	init_reach();
+	init_factors();
+
+	atomic_init(&EXACT.best, -INFINITY);
+	EXACT.bestOpts = malloc(EXACT.chainSize + 1);
+
+	search_parallel();
+
+	// Rebuilds the best chain
+	Searcher s;
+	Option placed[EXACT.chainSize + 1];
+	searcher_init(&s);
+	replay(&s, EXACT.bestOpts, EXACT.chainSize, placed);
+
+	MovElem chain[EXACT.chainSize + 1];
+	MovChain_from_3d(s.bb, s.sc, EXACT.chainSize, chain);
+	Solution sol = Solution_from_chain(chain, hpSize);
+	Solution_set_fitness(&sol, best_so_far());
+
+	searcher_free(&s);
+	free(EXACT.bestOpts);
+	free(EXACT.root);
+	free(EXACT.reach);
+	free(EXACT.apartPairs);
+
+	if(nodes)
+		*nodes = EXACT.nodes;
+	return sol;
+}
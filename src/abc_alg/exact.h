@@ -0,0 +1,35 @@
+#ifndef _EXACT_H_
+#define _EXACT_H_
+
+/** \file exact.h Exhaustive branch-and-bound search for the best conformation of short proteins.
+ *
+ * The ABC can't tell whether it found the best conformation. For short proteins, this search can:
+ *   movement chains are enumerated depth first, one element at a time, over a lattice of occupied points,
+ *   so only conformations without collisions are ever built.
+ * - Symmetry breaking: of the 8 rotated and mirrored copies of a conformation (see MovChain_canonical()),
+ *     only the one whose directions come first lexicographically is enumerated, and a partial chain is dropped
+ *     as soon as a copy of it would come first.
+ * - Bounding: each bead placed later makes at most 5 new contacts, and only with earlier beads on the other
+ *     color of the lattice (which is bipartite), so the contacts of each kind a partial chain can still reach
+ *     are bounded. The H beads placed so far, and the least distances between the others, bound the gyration
+ *     factors as well. This gives an upper bound on the fitness of any completion, and partial chains that
+ *     can't beat the best conformation found so far are dropped.
+ * - Parallelism: partial chains a few elements long are split among N_THREADS threads, and a thread that runs
+ *     out of them steals half of those left to another thread.
+ *
+ * The fitness of complete chains is calculated by FitnessCalc_run(), so it is exactly the one the ABC optimizes,
+ *   restricted to conformations without collisions.
+ * The number of chains grows exponentially with the protein size; see EXACT_MAX_SIZE.
+ */
+
+#include <hpchain.h>
+#include <solution/solution.h>
+
+/** Returns a Solution with the highest fitness among all conformations without collisions of the protein
+ *   'hpChain', with 'hpSize' beads, which must be registered with FitnessCalc_initialize().
+ * The fitness of the Solution is set.
+ * If 'nodes' is not NULL, it receives the number of partial chains visited by the search.
+ */
+Solution Exact_search(const HPElem *hpChain, int hpSize, long *nodes);
+
+#endif
@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include <int3d.h>
+#include <movchain.h>
+#include <fitness/fitness.h>
+#include <random.h>
+#include <config.h>
+
+#include "fragments.h"
+#include "hive.h"
+#include "growth.h"
+#include "seeds.h"
+
+/** Fragments of the protein being predicted */
+static struct {
+	const HPElem *hpChain;
+	int hpSize;
+	int count;       /**< Number of fragments */
+	int *start;      /**< Index of the first bead of each fragment */
+	int size;        /**< Number of beads of each fragment */
+	MovElem *chains; /**< FRAGMENT_SEEDS conformations of each fragment, one fragment after the other */
+} FRAGMENTS;
+
+/** Number of rotations and mirrorings of the lattice */
+#define N_ISOMETRIES 48
+
+/** The 6 permutations of the axes */
+static const int PERMS[6][3] = {
+	{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0},
+};
+
+/* Returns 'p' rotated or mirrored by the iso-th isometry: a permutation of the axes followed by flipping
+ *   the signs of some of them
+ */
+static inline
+int3d isometry(int iso, int3d p){
+	int c[3] = { p.x, p.y, p.z };
+	const int *perm = PERMS[iso / 8];
+	int sign = iso % 8;
+	return int3d_make(
+		(sign & 1 ? -1 : 1) * c[perm[0]],
+		(sign & 2 ? -1 : 1) * c[perm[1]],
+		(sign & 4 ? -1 : 1) * c[perm[2]]
+	);
+}
+
+static inline
+int3d sub(int3d a, int3d b){
+	return int3d_make(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline
+int dist2(int3d a, int3d b){
+	int3d d = sub(a, b);
+	return d.x * d.x + d.y * d.y + d.z * d.z;
+}
+
+// Documented in header file
+void Fragments_initialize(const HPElem *hpChain, int hpSize){
+	int i;
+	FRAGMENTS.hpChain = hpChain;
+	FRAGMENTS.hpSize = hpSize;
+	FRAGMENTS.count = 0;
+	FRAGMENTS.start = NULL;
+	FRAGMENTS.chains = NULL;
+
+	int size = FRAGMENT_SIZE < 4 ? 4 : FRAGMENT_SIZE;
+	if(FRAGMENT_SIZE <= 0 || size >= hpSize || FRAGMENT_SEEDS <= 0) return;
+
+	// Joining needs two shared beads, and each fragment must reach past the previous one
+	int overlap = FRAGMENT_OVERLAP;
+	if(overlap < 2) overlap = 2;
+	if(overlap > size - 1) overlap = size - 1;
+
+	int stride = size - overlap;
+	FRAGMENTS.size = size;
+	FRAGMENTS.count = (hpSize - overlap + stride - 1) / stride;
+	FRAGMENTS.start = malloc(sizeof(int) * FRAGMENTS.count);
+	for(i = 0; i < FRAGMENTS.count; i++)
+		FRAGMENTS.start[i] = i * stride;
+
+	// The last fragment ends with the protein, so it may overlap the one before it more
+	FRAGMENTS.start[FRAGMENTS.count - 1] = hpSize - size;
+
+	FRAGMENTS.chains = malloc(sizeof(MovElem) * FRAGMENTS.count * FRAGMENT_SEEDS * (size - 1));
+}
+
+// Documented in header file
+void Fragments_free(){
+	free(FRAGMENTS.start);
+	free(FRAGMENTS.chains);
+	FRAGMENTS.start = NULL;
+	FRAGMENTS.chains = NULL;
+	FRAGMENTS.count = 0;
+}
+
+// Documented in header file
+int Fragments_count(){
+	return FRAGMENTS.count;
+}
+
+// Documented in header file
+int Fragments_size(int idx){
+	(void) idx;
+	return FRAGMENTS.size;
+}
+
+// Documented in header file
+MovElem *Fragments_chains(int idx){
+	return FRAGMENTS.chains + (size_t) idx * FRAGMENT_SEEDS * (FRAGMENTS.size - 1);
+}
+
+/** A solution of a hive and its fitness, for sorting */
+typedef struct {
+	double fitness;
+	int index;
+} Ranked;
+
+static
+int ranked_compare(const void *a, const void *b){
+	double fa = ((const Ranked *) a)->fitness;
+	double fb = ((const Ranked *) b)->fitness;
+	return (fa < fb) - (fa > fb);
+}
+
+/* Folds fragment 'idx' in a hive of its own, in the calling thread
+ * Procedure idea:
+ *   The thread registers the fragment with the fitness calculation and the growth of chains, and runs
+ *     FRAGMENT_CYCLES cycles of the hive in steady-state mode
+ *   The best solution found is kept, followed by the solutions of the hive from best to worst
+ */
+static
+void fold(int idx){
+	int i;
+	int size = FRAGMENTS.size;
+	int nOnlookers = COLONY_SIZE - (COLONY_SIZE * FORAGER_RATIO);
+	Hive previous = HIVE_current();
+	Hive hive = HIVE_create();
+
+	random_use_stream(RANDOM_EXPLICIT_STREAMS - 1 - idx % (RANDOM_EXPLICIT_STREAMS / 2));
+	FitnessCalc_use_protein(FRAGMENTS.hpChain + FRAGMENTS.start[idx], size);
+	Growth_use_protein(FRAGMENTS.hpChain + FRAGMENTS.start[idx], size);
+
+	HIVE_use(hive);
+	HIVE_initialize(size);
+	Solution_calculate_fitness(HIVE_solutions(), HIVE_nSols());
+	HIVE_check_best();
+
+	HiveBee bee = { .index = -1 };
+	HIVE_steady_start((long) FRAGMENT_CYCLES * (HIVE_nSols() + nOnlookers));
+	while(true){
+		int cycle = HIVE_cycle();
+		if(!HIVE_steady_step(&bee, size))
+			break;
+		if(HIVE_cycle() != cycle)
+			HIVE_local_search();
+		Solution_calculate_fitness(&bee.sol, 1);
+	}
+
+	int nSols = HIVE_nSols();
+	Ranked ranked[nSols];
+	for(i = 0; i < nSols; i++){
+		ranked[i].fitness = Solution_fitness(HIVE_solution(i));
+		ranked[i].index = i;
+	}
+	qsort(ranked, nSols, sizeof(Ranked), ranked_compare);
+
+	Solution best = HIVE_best_sol();
+	MovElem *chains = Fragments_chains(idx);
+	for(i = 0; i < FRAGMENT_SEEDS; i++){
+		Solution sol = i == 0 ? best : HIVE_solution(ranked[(i - 1) % nSols].index);
+		memcpy(chains + (size_t) i * (size - 1), Solution_chain(sol), sizeof(MovElem) * (size - 1));
+	}
+
+	Solution_free(best);
+	HIVE_destroy();
+	HIVE_use(previous);
+	HIVE_delete(hive);
+
+	FitnessCalc_use_protein(NULL, 0);
+	Growth_use_protein(NULL, 0);
+}
+
+// Documented in header file
+void Fragments_fold(int first, int step, int nThreads){
+	int i;
+	if(nThreads < 1) nThreads = 1;
+
+	// Each fragment takes a single thread, so parallel fitness calculations within it run sequentially
+	int levels = omp_get_max_active_levels();
+	omp_set_max_active_levels(1);
+
+	#pragma omp parallel for schedule(dynamic, 1) num_threads(nThreads)
+	for(i = first; i < FRAGMENTS.count; i += step)
+		fold(i);
+
+	omp_set_max_active_levels(levels);
+
+	// Fragments took explicit streams, so the calling thread goes back to its own
+	random_use_stream(0);
+}
+
+/* Places the beads of the idx-th fragment whose conformation is 'fragBB' and 'fragSC' onto 'bb' and 'sc',
+ *   which hold the beads placed so far up to bead 'end' (exclusive)
+ * Procedure idea:
+ *   The fragment and the beads placed share beads start to end - 1, and the fragment is joined at bead
+ *     'join', in the middle of them: bead join - 1 is kept, and beads 'join' onwards are taken from the fragment
+ *   Each isometry of the lattice is tried, translated so the backbone bead join - 1 of the fragment falls over
+ *     the one placed. The chosen one makes the fewest collisions with the beads placed before 'join', and then
+ *     follows the shared beads most closely
+ */
+static
+void place_fragment(int idx, const int3d *fragBB, const int3d *fragSC, int end, int3d *bb, int3d *sc){
+	int i, j, iso;
+	int size = FRAGMENTS.size;
+	int start = FRAGMENTS.start[idx];
+	int join = (start + end) / 2;
+	if(join <= start) join = start + 1;
+
+	int bestIso = -1;
+	long bestCollisions = 0, bestDeviation = 0;
+	int3d bestShift = int3d_make(0, 0, 0);
+
+	for(iso = 0; iso < N_ISOMETRIES; iso++){
+		int3d shift = sub(bb[join - 1], isometry(iso, fragBB[join - 1 - start]));
+		int3d first = int3d_add(isometry(iso, fragBB[join - start]), shift);
+
+		// The chain can't turn right back over the backbone
+		if(join >= 2 && int3d_equal(first, bb[join - 2]))
+			continue;
+
+		long deviation = 0;
+		for(i = start; i < join; i++){
+			deviation += dist2(int3d_add(isometry(iso, fragBB[i - start]), shift), bb[i]);
+			deviation += dist2(int3d_add(isometry(iso, fragSC[i - start]), shift), sc[i]);
+		}
+
+		long collisions = 0;
+		for(i = join; i < start + size; i++){
+			int3d pBB = int3d_add(isometry(iso, fragBB[i - start]), shift);
+			int3d pSC = int3d_add(isometry(iso, fragSC[i - start]), shift);
+			for(j = 0; j < join; j++){
+				collisions += int3d_equal(pBB, bb[j]) + int3d_equal(pBB, sc[j]);
+				collisions += int3d_equal(pSC, bb[j]) + int3d_equal(pSC, sc[j]);
+			}
+		}
+
+		if(bestIso < 0 || collisions < bestCollisions || (collisions == bestCollisions && deviation < bestDeviation)){
+			bestIso = iso;
+			bestCollisions = collisions;
+			bestDeviation = deviation;
+			bestShift = shift;
+		}
+	}
+
+	for(i = join; i < start + size; i++){
+		bb[i] = int3d_add(isometry(bestIso, fragBB[i - start]), bestShift);
+		sc[i] = int3d_add(isometry(bestIso, fragSC[i - start]), bestShift);
+	}
+}
+
+// Documented in header file
+void Fragments_assemble(){
+	int i, k;
+	int size = FRAGMENTS.size;
+	int hpSize = FRAGMENTS.hpSize;
+	if(FRAGMENTS.count == 0) return;
+
+	int3d *bb = malloc(sizeof(int3d) * hpSize);
+	int3d *sc = malloc(sizeof(int3d) * hpSize);
+	MovElem *chain = malloc(sizeof(MovElem) * (hpSize - 1));
+
+	for(i = 0; i < FRAGMENT_SEEDS; i++){
+		int3d *fragBB, *fragSC;
+
+		for(k = 0; k < FRAGMENTS.count; k++){
+			const MovElem *fragChain = Fragments_chains(k) + (size_t) i * (size - 1);
+			MovChain_build_3d(fragChain, size - 1, &fragBB, &fragSC);
+
+			if(k == 0){
+				memcpy(bb, fragBB, sizeof(int3d) * size);
+				memcpy(sc, fragSC, sizeof(int3d) * size);
+			} else {
+				place_fragment(k, fragBB, fragSC, FRAGMENTS.start[k - 1] + size, bb, sc);
+			}
+
+			free(fragBB);
+			free(fragSC);
+		}
+
+		if(MovChain_from_3d(bb, sc, hpSize - 1, chain) == 0)
+			Seeds_add(chain, hpSize);
+	}
+
+	free(bb);
+	free(sc);
+	free(chain);
+}
@@ -0,0 +1,56 @@
+#ifndef _FRAGMENTS_H_
+#define _FRAGMENTS_H_
+
+/** \file fragments.h Divide-and-conquer folding of long proteins by overlapping fragments.
+ *
+ * A hive folding a long protein from random conformations spends most of its cycles arranging local structure
+ *   that a short protein settles quickly. Here the protein is split into fragments of FRAGMENT_SIZE beads,
+ *   each sharing FRAGMENT_OVERLAP beads with the next, and each fragment is folded by an independent hive
+ *   for FRAGMENT_CYCLES cycles, all of them at once.
+ * The conformations found are then assembled into full-length conformations, which are added to the seed library
+ *   (see seeds.h), so the hives of the protein start from them and refine them.
+ *
+ * Assembly is done over the coordinates of the beads (movement chains are relative to the frame of the first
+ *   beads, so concatenating them wouldn't keep the shape of each fragment). Each fragment is placed by the
+ *   rotation or mirroring of the lattice that makes the fewest collisions with the beads already placed,
+ *   and then follows them most closely over the overlap, and the two are joined in the middle of the overlap.
+ */
+
+#include <hpchain.h>
+#include <movelem.h>
+
+/** Splits the protein 'hpChain', with 'hpSize' beads, into fragments.
+ * There are no fragments if FRAGMENT_SIZE is not positive, or the protein isn't longer than it.
+ */
+void Fragments_initialize(const HPElem *hpChain, int hpSize);
+
+/** Frees the fragments and their conformations. */
+void Fragments_free();
+
+/** Returns the number of fragments. */
+int Fragments_count();
+
+/** Returns the number of beads of the idx-th fragment. */
+int Fragments_size(int idx);
+
+/** Folds fragments 'first', 'first' + 'step', 'first' + 2 * 'step', and so on, in up to 'nThreads' threads.
+ * Each fragment has a hive of its own, which runs in a single thread drawing from a random stream of its own,
+ *   so the conformations found don't depend on how fragments are spread among threads or processes.
+ * The protein must have been registered with FitnessCalc_initialize() and Growth_initialize(), and the seed
+ *   library must still be empty.
+ */
+void Fragments_fold(int first, int step, int nThreads);
+
+/** Returns the FRAGMENT_SEEDS conformations kept of the idx-th fragment, best first, one after the other,
+ *   each with Fragments_size(idx) - 1 elements.
+ * They are written by Fragments_fold(), and may be overwritten to share them among processes.
+ */
+MovElem *Fragments_chains(int idx);
+
+/** Assembles FRAGMENT_SEEDS full-length conformations from the conformations of the fragments, which must all
+ *   have been folded, and adds them to the seed library.
+ * The i-th conformation joins the i-th conformation of each fragment.
+ */
+void Fragments_assemble();
+
+#endif
@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include <int3d.h>
+#include <movchain.h>
+#include <random.h>
+#include <config.h>
+
+#include "growth.h"
+
+/** A protein to grow chains for */
+typedef struct {
+	const HPElem *hpChain;
+	int hpSize;
+} Protein;
+
+/** Protein being predicted */
+static Protein GROWTH;
+
+/** Protein of the calling thread, if set by Growth_use_protein() */
+static _Thread_local Protein THREAD_PROTEIN;
+
+/** Kinds of beads held by a PointSet */
+enum PointKind { POINT_FREE = 0, POINT_BB = 1, POINT_H = 2, POINT_P = 3 };
+
+/** Set of occupied points of the lattice, with the kind of bead in each point.
+ * It is an open addressing hash table with linear probing.
+ */
+typedef struct {
+	uint64_t *keys;      /**< Packed coordinates of each slot */
+	unsigned char *kind; /**< Kind of bead in each slot, or POINT_FREE if the slot is empty */
+	unsigned int mask;   /**< Number of slots minus 1 (a power of 2) */
+	int shift;           /**< 64 minus log2 of the number of slots */
+} PointSet;
+
+static const int3d UNIT[6] = {
+	{ 1, 0, 0}, {-1, 0, 0},
+	{ 0, 1, 0}, { 0,-1, 0},
+	{ 0, 0, 1}, { 0, 0,-1},
+};
+
+/* Index in UNIT of the direction opposite to UNIT[d] */
+#define OPPOSITE(d) ((d) ^ 1)
+
+/** Number of pairs of directions (d, e) an element can take, stored as d * 6 + e */
+#define N_OPTIONS 36
+
+/******************************************/
+/****** POINT SET PROCEDURES       ********/
+/******************************************/
+
+/* Packs coordinates into a key. Coordinates never get farther than the protein size from the origin */
+static inline
+uint64_t point_key(int3d p){
+	const int64_t OFFSET = 1 << 20;
+	return ((uint64_t) (p.x + OFFSET) << 42) | ((uint64_t) (p.y + OFFSET) << 21) | (uint64_t) (p.z + OFFSET);
+}
+
+static inline
+unsigned int point_home(const PointSet *set, uint64_t key){
+	return (key * 0x9E3779B97F4A7C15ULL) >> set->shift;
+}
+
+static
+void set_init(PointSet *set, int nPoints){
+	unsigned int size = 16;
+	int shift = 60;
+	while(size < 4 * (unsigned int) nPoints){
+		size *= 2;
+		shift--;
+	}
+
+	set->keys = calloc(size, sizeof(uint64_t));
+	set->kind = calloc(size, sizeof(unsigned char));
+	set->mask = size - 1;
+	set->shift = shift;
+}
+
+static
+void set_free(PointSet *set){
+	free(set->keys);
+	free(set->kind);
+}
+
+/* Returns the slot of 'p', or the empty slot where it would be inserted */
+static inline
+unsigned int set_slot(const PointSet *set, int3d p){
+	uint64_t key = point_key(p);
+	unsigned int slot = point_home(set, key);
+	while(set->kind[slot] != POINT_FREE && set->keys[slot] != key)
+		slot = (slot + 1) & set->mask;
+	return slot;
+}
+
+/* Returns the kind of bead in 'p', or POINT_FREE */
+static inline
+int set_get(const PointSet *set, int3d p){
+	return set->kind[set_slot(set, p)];
+}
+
+/* Puts a bead of the given kind in 'p', replacing the kind of bead already there, if any */
+static inline
+void set_insert(PointSet *set, int3d p, int kind){
+	unsigned int slot = set_slot(set, p);
+	set->keys[slot] = point_key(p);
+	set->kind[slot] = kind;
+}
+
+/* Takes the bead away from 'p', which must be occupied
+ * Procedure idea:
+ *   Entries after the emptied slot are shifted back into it when their probe sequence passes through it,
+ *     so no probe sequence is broken (backward shift deletion)
+ */
+static
+void set_remove(PointSet *set, int3d p){
+	unsigned int hole = set_slot(set, p);
+	unsigned int slot = hole;
+	set->kind[hole] = POINT_FREE;
+
+	while(true){
+		slot = (slot + 1) & set->mask;
+		if(set->kind[slot] == POINT_FREE)
+			return;
+
+		// The entry can fill the hole if its home isn't cyclically in (hole, slot]
+		unsigned int home = point_home(set, set->keys[slot]);
+		bool between = hole < slot ? (home > hole && home <= slot) : (home > hole || home <= slot);
+		if(!between){
+			set->keys[hole] = set->keys[slot];
+			set->kind[hole] = set->kind[slot];
+			set->kind[slot] = POINT_FREE;
+			hole = slot;
+		}
+	}
+}
+
+/******************************************/
+/****** GROWTH PROCEDURES          ********/
+/******************************************/
+
+/** State of a chain being grown */
+typedef struct {
+	int3d *bb, *sc; /**< Beads placed so far */
+	PointSet set;   /**< Points occupied by the beads placed so far */
+} Walk;
+
+/* Protein the calling thread grows chains for */
+static inline
+const Protein *protein(){
+	return THREAD_PROTEIN.hpChain ? &THREAD_PROTEIN : &GROWTH;
+}
+
+static inline
+int side_chain_kind(int bead){
+	return protein()->hpChain[bead] == 'H' ? POINT_H : POINT_P;
+}
+
+/* Stores in 'p1' and 'p2' the two beads placed by element 'elem' taking option 'opt'.
+ * Returns false if the option goes right back over the bead it comes from.
+ * Element 0 places side chain beads 0 and 1, and element E > 0 places backbone and side chain beads E+1.
+ */
+static
+bool option_beads(const Walk *walk, int elem, int opt, int3d *p1, int3d *p2){
+	int d = opt / 6;
+	int e = opt % 6;
+
+	if(elem == 0){
+		// Backbone bead 1 is at +x of backbone bead 0
+		if(d == 0 || e == 1)
+			return false;
+		*p1 = int3d_add(walk->bb[0], UNIT[d]);
+		*p2 = int3d_add(walk->bb[1], UNIT[e]);
+		return true;
+	}
+
+	*p1 = int3d_add(walk->bb[elem], UNIT[d]);
+	if(int3d_equal(*p1, walk->bb[elem - 1]) || e == OPPOSITE(d))
+		return false;
+	*p2 = int3d_add(*p1, UNIT[e]);
+	return true;
+}
+
+/* Number of H side chain beads next to 'p' */
+static
+int h_neighbors(const Walk *walk, int3d p){
+	int i, count = 0;
+	for(i = 0; i < 6; i++)
+		count += set_get(&walk->set, int3d_add(p, UNIT[i])) == POINT_H;
+	return count;
+}
+
+/* Rosenbluth weight of placing a side chain bead of kind 'kind' in 'p' */
+static inline
+double contact_weight(const Walk *walk, int3d p, int kind){
+	if(kind != POINT_H || GROWTH_BIAS == 0)
+		return 1;
+	return exp(GROWTH_BIAS * h_neighbors(walk, p));
+}
+
+/* Returns the weight of element 'elem' taking option 'opt', or 0 if any of its beads would collide
+ * Procedure idea:
+ *   The weight is the number of free neighbors left to the backbone bead placed (so the walk doesn't turn into
+ *     a dead end), times exp(GROWTH_BIAS) for each new H-H contact
+ */
+static
+double option_weight(const Walk *walk, int elem, int opt){
+	int3d p1, p2;
+	if(!option_beads(walk, elem, opt, &p1, &p2))
+		return 0;
+	if(set_get(&walk->set, p1) != POINT_FREE || set_get(&walk->set, p2) != POINT_FREE || int3d_equal(p1, p2))
+		return 0;
+
+	if(elem == 0){
+		double w = contact_weight(walk, p1, side_chain_kind(0)) * contact_weight(walk, p2, side_chain_kind(1));
+		if(side_chain_kind(0) == POINT_H && side_chain_kind(1) == POINT_H && int3d_isDist1(p1, p2))
+			w *= exp(GROWTH_BIAS);
+		return w;
+	}
+
+	int bead = elem + 1;
+	int free = 1;
+	if(bead < protein()->hpSize - 1){
+		int i;
+		free = 0;
+		for(i = 0; i < 6; i++){
+			int3d n = int3d_add(p1, UNIT[i]);
+			if(!int3d_equal(n, p2) && set_get(&walk->set, n) == POINT_FREE)
+				free++;
+		}
+	}
+
+	return free * contact_weight(walk, p2, side_chain_kind(bead));
+}
+
+/* Places the beads of element 'elem' taking option 'opt' */
+static
+void place(Walk *walk, int elem, int opt){
+	int3d p1, p2;
+	option_beads(walk, elem, opt, &p1, &p2);
+
+	if(elem == 0){
+		walk->sc[0] = p1;
+		walk->sc[1] = p2;
+		set_insert(&walk->set, p1, side_chain_kind(0));
+		set_insert(&walk->set, p2, side_chain_kind(1));
+	} else {
+		walk->bb[elem + 1] = p1;
+		walk->sc[elem + 1] = p2;
+		set_insert(&walk->set, p1, POINT_BB);
+		set_insert(&walk->set, p2, side_chain_kind(elem + 1));
+	}
+}
+
+/* Takes away the beads placed by element 'elem' */
+static
+void unplace(Walk *walk, int elem){
+	if(elem == 0){
+		set_remove(&walk->set, walk->sc[0]);
+		set_remove(&walk->set, walk->sc[1]);
+	} else {
+		set_remove(&walk->set, walk->bb[elem + 1]);
+		set_remove(&walk->set, walk->sc[elem + 1]);
+	}
+}
+
+/* Grows the beads of 'walk' as described in the header file */
+static
+void grow(Walk *walk){
+	int chainSize = protein()->hpSize - 1;
+	uint64_t *tried = malloc(sizeof(uint64_t) * chainSize); // Options already taken by each element
+	int backtracks = GROWTH_BACKTRACK;
+	int elem = 0;
+	int opt;
+
+	tried[0] = 0;
+	while(elem < chainSize){
+		double weights[N_OPTIONS];
+		double total = 0;
+
+		for(opt = 0; opt < N_OPTIONS; opt++){
+			weights[opt] = (tried[elem] >> opt) & 1 ? 0 : option_weight(walk, elem, opt);
+			total += weights[opt];
+		}
+
+		if(total > 0){
+			double r = drandom_x() * total;
+			int chosen = -1;
+			for(opt = 0; opt < N_OPTIONS; opt++){
+				if(weights[opt] <= 0) continue;
+				chosen = opt;
+				if(r < weights[opt]) break;
+				r -= weights[opt];
+			}
+
+			tried[elem] |= 1ULL << chosen;
+			place(walk, elem, chosen);
+			elem++;
+			if(elem < chainSize)
+				tried[elem] = 0;
+		} else if(backtracks > 0 && elem > 0){
+			// Dead end: the previous element takes another option
+			backtracks--;
+			elem--;
+			unplace(walk, elem);
+		} else {
+			break;
+		}
+	}
+
+	// Out of backtracking: the rest of the chain is random
+	for(; elem < chainSize; elem++){
+		int3d p1, p2;
+		do {
+			opt = urandom_max(N_OPTIONS);
+		} while(!option_beads(walk, elem, opt, &p1, &p2));
+		place(walk, elem, opt);
+	}
+
+	free(tried);
+}
+
+// Documented in header file
+void Growth_initialize(const HPElem *hpChain, int hpSize){
+	GROWTH.hpChain = hpChain;
+	GROWTH.hpSize = hpSize;
+}
+
+// Documented in header file
+void Growth_use_protein(const HPElem *hpChain, int hpSize){
+	THREAD_PROTEIN.hpChain = hpChain;
+	THREAD_PROTEIN.hpSize = hpSize;
+}
+
+// Documented in header file
+Solution Growth_solution(int hpSize){
+	if(!INIT_GROWTH)
+		return Solution_random(hpSize);
+
+	Walk walk;
+	walk.bb = malloc(sizeof(int3d) * hpSize);
+	walk.sc = malloc(sizeof(int3d) * hpSize);
+	set_init(&walk.set, 2 * hpSize);
+
+	walk.bb[0] = int3d_make(1, 0, 0);
+	walk.bb[1] = int3d_make(2, 0, 0);
+	set_insert(&walk.set, walk.bb[0], POINT_BB);
+	set_insert(&walk.set, walk.bb[1], POINT_BB);
+
+	grow(&walk);
+
+	MovElem chain[hpSize - 1];
+	MovChain_from_3d(walk.bb, walk.sc, hpSize - 1, chain);
+
+	set_free(&walk.set);
+	free(walk.bb);
+	free(walk.sc);
+	return Solution_from_chain(chain, hpSize);
+}
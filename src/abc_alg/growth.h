@@ -0,0 +1,32 @@
+#ifndef _GROWTH_H_
+#define _GROWTH_H_
+
+/** \file growth.h Random solutions grown bead by bead as self-avoiding walks.
+ *
+ * A uniformly random movement chain of a long protein is full of collisions, so a hive starting from them
+ *   spends many cycles just to become feasible.
+ * Here the protein is grown from its first bead onwards over a lattice of occupied points, and each element
+ *   of the chain is chosen only among the ones that place its two beads on free points.
+ * The choice is weighted as in Rosenbluth sampling: an element is more likely if the backbone bead it places has
+ *   more free neighbors (so the walk avoids dead ends), and, with GROWTH_BIAS, if it makes new H-H contacts.
+ * When no element is possible, growth steps back and tries another element, up to GROWTH_BACKTRACK times.
+ *   After that, the rest of the chain is random and may have collisions.
+ */
+
+#include <hpchain.h>
+#include <solution/solution.h>
+
+/** Registers the protein being predicted, with 'hpSize' beads. */
+void Growth_initialize(const HPElem *hpChain, int hpSize);
+
+/** Makes the calling thread grow chains for the protein 'hpChain', with 'hpSize' beads, instead of the registered one.
+ * With a NULL 'hpChain', the thread goes back to the registered protein.
+ */
+void Growth_use_protein(const HPElem *hpChain, int hpSize);
+
+/** Returns a new Solution with a chain grown as described above, without its fitness calculated.
+ * If INIT_GROWTH is 0, returns Solution_random() instead.
+ */
+Solution Growth_solution(int hpSize);
+
+#endif
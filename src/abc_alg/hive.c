@@ -2,10 +2,13 @@
 #include <string.h>
 #include <math.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <movchain.h>
 #include <hpchain.h>
 #include <fitness/fitness.h>
+#include <fitness/fitness_delta.h>
 #include <random.h>
 #include <config.h>
 #include <string.h>
@@ -14,6 +17,11 @@
 
 #include "abc_alg.h"
 #include "hive.h"
+#include "archive.h"
+#include "seeds.h"
+#include "growth.h"
+#include "local_search.h"
+#include "moves.h"
 
 /** Encapsulates a hive that develops a number of solutions using a number of bees. */
 struct HIVE_ {
@@ -22,109 +30,576 @@ struct HIVE_ {
 	int cycle;      /**< Keeps track of what cycle we are running */
 	int hpSize;     /**< Stores size of the HP chain of the protein being predicted. */
 	Solution best;  /**< Best solution found so far */
+	int bestCycle;  /**< Cycle in which 'best' was found */
+	struct timespec start; /**< When the hive was initialized */
+	Archive archive; /**< Best distinct solutions found so far, or NULL if ARCHIVE_SIZE <= 1 */
+
+	FitnessDelta *deltas;       /**< Incremental evaluation of each solution, for moves (see moves.h), or NULL until needed */
+	long moveProposed[N_MOVES]; /**< Number of solutions of each kind of move tried by HIVE_try_replace_solution() */
+	long moveAccepted[N_MOVES]; /**< Number of those that replaced the solution they came from */
+
+	double weightMin;  /**< Fitness taken as zero for onlooker weights */
+	double weightSum;  /**< Sum of the fitnesses of all solutions */
+	bool weightsValid; /**< Whether the two fields above are being kept up to date */
+
+	long steadyBees;       /**< Number of bees to dispatch in steady-state mode */
+	long steadyDispatched; /**< Number of bees dispatched so far */
+	long steadyApplied;    /**< Number of bees whose result has been applied so far */
+
+	pthread_mutex_t lock; /**< Lock for threads that share the hive (see HIVE_lock()) */
 };
 
-/** Our global HIVE */
-struct HIVE_ HIVE;
+/** Our global HIVE, used by every thread that hasn't been told otherwise with HIVE_use() */
+static struct HIVE_ GLOBAL_HIVE;
+
+/** The HIVE manipulated by the calling thread */
+static _Thread_local struct HIVE_ *HIVE = &GLOBAL_HIVE;
 
 /******************************************/
 /****** HIVE PROCEDURES            ********/
 /******************************************/
 
+/* Keeps onlooker weights up to date after a solution with fitness 'oldFit' is replaced by one with 'newFit'.
+ * If the replaced solution held the lowest fitness, 'weightMin' becomes stale (lower than needed),
+ *   which still yields valid weights until the next HIVE_refresh_weights().
+ */
+static
+void update_weights(double oldFit, double newFit){
+	if(!HIVE->weightsValid) return;
+
+	HIVE->weightSum += newFit - oldFit;
+	if(newFit < HIVE->weightMin)
+		HIVE->weightMin = newFit;
+}
+
+// Documented in header file
+Hive HIVE_create(){
+	return calloc(1, sizeof(struct HIVE_));
+}
+
+// Documented in header file
+void HIVE_delete(Hive hive){
+	if(hive != &GLOBAL_HIVE)
+		free(hive);
+}
+
+// Documented in header file
+void HIVE_use(Hive hive){
+	HIVE = hive;
+}
+
+// Documented in header file
+Hive HIVE_current(){
+	return HIVE;
+}
+
+// Documented in header file
+void HIVE_lock(){
+	pthread_mutex_lock(&HIVE->lock);
+}
+
+// Documented in header file
+void HIVE_unlock(){
+	pthread_mutex_unlock(&HIVE->lock);
+}
+
 // Documented in header file
-void HIVE_initialize(){
-	HIVE.nSols = COLONY_SIZE * FORAGER_RATIO;
-	HIVE.sols = malloc(sizeof(Solution) * HIVE.nSols);
-	HIVE.hpSize = strlen(HP_CHAIN);
+void HIVE_initialize(int hpSize){
+	HIVE->nSols = COLONY_SIZE * FORAGER_RATIO;
+	HIVE->sols = malloc(sizeof(Solution) * HIVE->nSols);
+	HIVE->hpSize = hpSize;
+
+	// The first solutions come from the seed library, in order
+	int nSeeded = SEED_FRACTION * HIVE->nSols;
+	if(nSeeded > Seeds_count())
+		nSeeded = Seeds_count();
 
 	int i;
-	for(i = 0; i < HIVE.nSols; i++)
-		HIVE.sols[i] = Solution_random(HIVE.hpSize);
+	for(i = 0; i < HIVE->nSols; i++)
+		HIVE->sols[i] = i < nSeeded ? Seeds_solution(i) : Growth_solution(HIVE->hpSize);
 
-	HIVE.cycle = 0;
-	HIVE.best = Solution_random(HIVE.hpSize);
+	HIVE->cycle = 0;
+	HIVE->best = Solution_random(HIVE->hpSize);
+	HIVE->bestCycle = 0;
+	clock_gettime(CLOCK_MONOTONIC, &HIVE->start);
+	HIVE->archive = ARCHIVE_SIZE > 1 ? Archive_create(ARCHIVE_SIZE, HIVE->hpSize) : NULL;
+	HIVE->weightsValid = false;
+	HIVE->deltas = NULL;
+	memset(HIVE->moveProposed, 0, sizeof(HIVE->moveProposed));
+	memset(HIVE->moveAccepted, 0, sizeof(HIVE->moveAccepted));
+	pthread_mutex_init(&HIVE->lock, NULL);
 }
 
 // Documented in header file
 void HIVE_destroy(){
 	int i;
-	for(i = 0; i < HIVE.nSols; i++){
-		Solution_free(HIVE.sols[i]);
+	for(i = 0; i < HIVE->nSols; i++){
+		Solution_free(HIVE->sols[i]);
 	}
-	free(HIVE.sols);
+	free(HIVE->sols);
+	if(HIVE->archive)
+		Archive_free(HIVE->archive);
+	if(HIVE->deltas){
+		for(i = 0; i < HIVE->nSols; i++)
+			if(HIVE->deltas[i]) FitnessDelta_free(HIVE->deltas[i]);
+		free(HIVE->deltas);
+	}
+	pthread_mutex_destroy(&HIVE->lock);
 }
 
 int HIVE_nSols(){
-	return HIVE.nSols;
+	return HIVE->nSols;
 }
 
 int HIVE_cycle(){
-	return HIVE.cycle;
+	return HIVE->cycle;
 }
 
 Solution *HIVE_solutions(){
-	return HIVE.sols;
+	return HIVE->sols;
 }
 
 Solution HIVE_solution(int idx){
-	return HIVE.sols[idx];
+	return HIVE->sols[idx];
 }
 
 Solution HIVE_best_sol(){
-	return HIVE.best;
+	return HIVE->best;
+}
+
+Archive HIVE_archive(){
+	return HIVE->archive;
 }
 
 int HIVE_hp_size(){
-	return HIVE.hpSize;
+	return HIVE->hpSize;
 }
 
 // Documented in header file
 void HIVE_increment_cycle(){
-	HIVE.cycle++;
+	HIVE->cycle++;
 }
 
 // Documented in header file
 void HIVE_increment_idle(int index){
-	Solution_inc_idle_iterations(&HIVE.sols[index]);
+	Solution_inc_idle_iterations(&HIVE->sols[index]);
+}
+
+// Documented in header file
+FitnessDelta HIVE_solution_delta(int index){
+	#pragma omp critical(hive_deltas)
+	if(!HIVE->deltas)
+		HIVE->deltas = calloc(HIVE->nSols, sizeof(FitnessDelta));
+
+	FitnessDelta fd = HIVE->deltas[index];
+	const MovElem *chain = Solution_chain(HIVE->sols[index]);
+
+	if(fd && memcmp(FitnessDelta_chain(fd), chain, sizeof(MovElem) * (HIVE->hpSize - 1)) == 0)
+		return fd;
+
+	if(fd)
+		FitnessDelta_free(fd);
+	HIVE->deltas[index] = FitnessDelta_create(chain);
+	return HIVE->deltas[index];
+}
+
+/* Whether 'alt', which differs from the solution at 'index' in at most one element, has more collisions than it */
+static
+bool adds_collisions(int index, Solution alt){
+	FitnessDelta fd = HIVE_solution_delta(index);
+	const MovElem *cur = FitnessDelta_chain(fd);
+	const MovElem *chain = Solution_chain(alt);
+	int i;
+
+	for(i = 0; i < HIVE->hpSize - 1; i++){
+		if(chain[i] != cur[i]){
+			int limit = FitnessDelta_collisions(fd);
+			return FitnessDelta_try_collisions(fd, i, chain[i], limit) > limit;
+		}
+	}
+
+	return false;
 }
 
 // Documented in header file
 Solution HIVE_perturb_solution(int index, int hpSize){
-	int other;
+	int other, attempt;
+
+	int kind = Moves_choose();
+	if(kind != MOVE_RELATIVE){
+		Solution alt;
+		if(Moves_propose(HIVE_solution_delta(index), kind, hpSize, &alt))
+			return alt;
+	}
 
-	do {
-		other = urandom_max(HIVE.nSols);
-	} while(other == index);
+	for(attempt = 0; ; attempt++){
+		do {
+			other = urandom_max(HIVE->nSols);
+		} while(other == index);
 
-	return Solution_perturb_relative(HIVE.sols[index], HIVE.sols[other], hpSize);
+		Solution alt = Solution_perturb_relative(HIVE->sols[index], HIVE->sols[other], hpSize);
+		if(attempt >= FEASIBLE_RETRIES || !adds_collisions(index, alt))
+			return alt;
+
+		Solution_free(alt);
+	}
 }
 
 void HIVE_try_replace_solution(Solution alt, int index, int hpSize){
 	double altFit = Solution_fitness(alt);
-	double curFit = Solution_fitness(HIVE.sols[index]);
+	double curFit = Solution_fitness(HIVE->sols[index]);
+	int move = Solution_move(alt);
+
+	HIVE->moveProposed[move]++;
 
     if(altFit > curFit){
-		Solution_free(HIVE.sols[index]);
-		HIVE.sols[index] = alt;
+		HIVE->moveAccepted[move]++;
+		Solution_free(HIVE->sols[index]);
+		HIVE->sols[index] = alt;
+		update_weights(curFit, altFit);
+
+		if(HIVE->archive)
+			Archive_insert(HIVE->archive, alt, altFit);
 
-		double bestFit = Solution_fitness(HIVE.best);
+		double bestFit = Solution_fitness(HIVE->best);
 		if(altFit > bestFit){
-			Solution_free(HIVE.best);
-			HIVE.best = Solution_copy(alt, hpSize);
+			Solution_free(HIVE->best);
+			HIVE->best = Solution_copy(alt, hpSize);
+			Solution_set_fitness(&HIVE->best, altFit);
+			HIVE->bestCycle = HIVE->cycle;
 		}
     } else {
 		Solution_free(alt);
-		Solution_inc_idle_iterations(&HIVE.sols[index]);
+		Solution_inc_idle_iterations(&HIVE->sols[index]);
 	}
 }
 
 void HIVE_force_replace_solution(Solution alt, int index){
-	Solution_free(HIVE.sols[index]);
-	HIVE.sols[index] = alt;
+	if(HIVE->weightsValid)
+		update_weights(Solution_fitness(HIVE->sols[index]), Solution_fitness(alt));
+	Solution_free(HIVE->sols[index]);
+	HIVE->sols[index] = alt;
+}
+
+// Documented in header file
+bool HIVE_immigrate(Solution sol){
+	int chainSize = HIVE->hpSize - 1;
+	MovElem canon[chainSize], other[chainSize];
+	int i;
+
+	MovChain_canonical(Solution_chain(sol), chainSize, canon);
+	for(i = 0; i < HIVE->nSols; i++){
+		MovChain_canonical(Solution_chain(HIVE->sols[i]), chainSize, other);
+		if(memcmp(canon, other, sizeof(MovElem) * chainSize) == 0){
+			Solution_free(sol);
+			return false;
+		}
+	}
+
+	HIVE_force_replace_solution(sol, urandom_max(HIVE->nSols));
+	return true;
+}
+
+// Documented in header file
+void HIVE_check_best(){
+	int i;
+	double bestFit = Solution_fitness(HIVE->best);
+
+	for(i = 0; i < HIVE->nSols; i++){
+		double fit = Solution_fitness(HIVE->sols[i]);
+		if(fit > bestFit){
+			Solution_free(HIVE->best);
+			HIVE->best = Solution_copy(HIVE->sols[i], HIVE->hpSize);
+			HIVE->bestCycle = HIVE->cycle;
+			bestFit = fit;
+		}
+
+		if(HIVE->archive)
+			Archive_insert(HIVE->archive, HIVE->sols[i], fit);
+	}
+}
+
+/* Offers 'sol', with fitness 'fit', to the archive and to the best solution of the hive */
+static
+void offer_refined(Solution sol, double fit){
+	if(HIVE->archive)
+		Archive_insert(HIVE->archive, sol, fit);
+
+	if(fit > Solution_fitness(HIVE->best)){
+		Solution_free(HIVE->best);
+		HIVE->best = Solution_copy(sol, HIVE->hpSize);
+		HIVE->bestCycle = HIVE->cycle;
+	}
+}
+
+// Documented in header file
+void HIVE_local_search(){
+	if(LOCAL_SEARCH_INTERVAL <= 0 || HIVE->cycle == 0 || HIVE->cycle % LOCAL_SEARCH_INTERVAL != 0)
+		return;
+
+	int hpSize = HIVE->hpSize;
+	Solution best = Solution_copy(HIVE->best, hpSize);
+	Solution refined = Solution_copy(best, hpSize);
+
+	if(LocalSearch_run(&refined, hpSize)){
+		// The refined solution takes the place of the worst one, so bees can keep working on it
+		int i, worst = 0;
+		for(i = 1; i < HIVE->nSols; i++)
+			if(Solution_fitness(HIVE->sols[i]) < Solution_fitness(HIVE->sols[worst]))
+				worst = i;
+
+		HIVE_force_replace_solution(Solution_copy(refined, hpSize), worst);
+		offer_refined(refined, Solution_fitness(refined));
+	}
+	Solution_free(refined);
+
+	if(LOCAL_SEARCH_ARCHIVE && HIVE->archive){
+		// Archived solutions change as refined ones are inserted, so we refine copies
+		Solution *elite;
+		int i, nElite = Archive_export(HIVE->archive, &elite);
+
+		for(i = 0; i < nElite; i++){
+			bool isBest = memcmp(Solution_chain(elite[i]), Solution_chain(best), sizeof(MovElem) * (hpSize - 1)) == 0;
+			if(!isBest && LocalSearch_run(&elite[i], hpSize))
+				offer_refined(elite[i], Solution_fitness(elite[i]));
+			Solution_free(elite[i]);
+		}
+		free(elite);
+	}
+
+	Solution_free(best);
 }
 
 // Documented in header file
 void HIVE_replace_best(Solution newBest){
-	Solution_free(HIVE.best);
-	HIVE.best = newBest;
+	Solution_free(HIVE->best);
+	HIVE->best = newBest;
+}
+
+/* Copies 'size' bytes of 'data' to '*buf' and advances '*buf' */
+static
+void put_bytes(char **buf, const void *data, size_t size){
+	memcpy(*buf, data, size);
+	*buf += size;
+}
+
+/* Copies 'size' bytes of '*buf' to 'data' and advances '*buf' */
+static
+void get_bytes(const char **buf, void *data, size_t size){
+	memcpy(data, *buf, size);
+	*buf += size;
+}
+
+/* Writes the fitness, idle iterations and chain of 'sol' */
+static
+void put_solution(char **buf, Solution sol){
+	double fit = Solution_fitness(sol);
+	int idle = Solution_idle_iterations(sol);
+	put_bytes(buf, &fit, sizeof(double));
+	put_bytes(buf, &idle, sizeof(int));
+	put_bytes(buf, Solution_chain(sol), sizeof(MovElem) * (HIVE->hpSize - 1));
+}
+
+/* Reads a solution written by put_solution() */
+static
+Solution get_solution(const char **buf){
+	double fit;
+	int idle;
+	get_bytes(buf, &fit, sizeof(double));
+	get_bytes(buf, &idle, sizeof(int));
+
+	Solution sol = Solution_from_chain((const MovElem *) *buf, HIVE->hpSize);
+	*buf += sizeof(MovElem) * (HIVE->hpSize - 1);
+
+	Solution_set_fitness(&sol, fit);
+	Solution_set_idle_iterations(&sol, idle);
+	return sol;
+}
+
+// Documented in header file
+void HIVE_move_counts(long *proposed, long *accepted){
+	int i;
+	for(i = 0; i < N_MOVES; i++){
+		proposed[i] += HIVE->moveProposed[i];
+		accepted[i] += HIVE->moveAccepted[i];
+	}
+}
+
+// Documented in header file
+size_t HIVE_serialized_size(){
+	int nArchived = HIVE->archive ? Archive_size(HIVE->archive) : 0;
+	size_t solSize = sizeof(double) + sizeof(int) + sizeof(MovElem) * (HIVE->hpSize - 1);
+	return 5 * sizeof(int) + solSize * (1 + HIVE->nSols + nArchived);
+}
+
+// Documented in header file
+size_t HIVE_serialize(char *buf){
+	char *start = buf;
+	int i;
+
+	int nArchived = HIVE->archive ? Archive_size(HIVE->archive) : 0;
+
+	put_bytes(&buf, &HIVE->hpSize, sizeof(int));
+	put_bytes(&buf, &HIVE->nSols, sizeof(int));
+	put_bytes(&buf, &HIVE->cycle, sizeof(int));
+	put_bytes(&buf, &HIVE->bestCycle, sizeof(int));
+	put_solution(&buf, HIVE->best);
+
+	for(i = 0; i < HIVE->nSols; i++)
+		put_solution(&buf, HIVE->sols[i]);
+
+	put_bytes(&buf, &nArchived, sizeof(int));
+	for(i = 0; i < nArchived; i++)
+		put_solution(&buf, Archive_solution(HIVE->archive, i));
+
+	return buf - start;
+}
+
+// Documented in header file
+bool HIVE_deserialize(const char *buf, size_t size){
+	const char *end = buf + size;
+	int i, hpSize, nSols, nArchived;
+
+	if(size < 2 * sizeof(int)) return false;
+	get_bytes(&buf, &hpSize, sizeof(int));
+	get_bytes(&buf, &nSols, sizeof(int));
+	if(hpSize != HIVE->hpSize || nSols != HIVE->nSols) return false;
+
+	// Every solution takes the same number of bytes
+	size_t solSize = sizeof(double) + sizeof(int) + sizeof(MovElem) * (hpSize - 1);
+	if(end - buf < (long) (2 * sizeof(int) + solSize * (1 + nSols) + sizeof(int))) return false;
+
+	get_bytes(&buf, &HIVE->cycle, sizeof(int));
+	get_bytes(&buf, &HIVE->bestCycle, sizeof(int));
+
+	Solution_free(HIVE->best);
+	HIVE->best = get_solution(&buf);
+
+	for(i = 0; i < nSols; i++){
+		Solution_free(HIVE->sols[i]);
+		HIVE->sols[i] = get_solution(&buf);
+	}
+
+	get_bytes(&buf, &nArchived, sizeof(int));
+	if(end - buf < (long) (solSize * nArchived)) return false;
+
+	for(i = 0; i < nArchived; i++){
+		Solution sol = get_solution(&buf);
+		if(HIVE->archive)
+			Archive_insert(HIVE->archive, sol, Solution_fitness(sol));
+		Solution_free(sol);
+	}
+
+	HIVE->weightsValid = false;
+	return true;
+}
+
+// Documented in header file
+int HIVE_stop_reasons(){
+	int reasons = 0;
+
+	if(TIME_BUDGET > 0){
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = (now.tv_sec - HIVE->start.tv_sec) + (now.tv_nsec - HIVE->start.tv_nsec) / (double) 1E9;
+		if(elapsed >= TIME_BUDGET)
+			reasons |= HIVE_STOP_TIME;
+	}
+
+	if(TARGET_FITNESS != 0 && Solution_fitness(HIVE->best) >= TARGET_FITNESS)
+		reasons |= HIVE_STOP_TARGET;
+
+	if(STAGNATION_LIMIT > 0 && HIVE->cycle - HIVE->bestCycle >= STAGNATION_LIMIT)
+		reasons |= HIVE_STOP_STAGNATION;
+
+	return reasons;
+}
+
+// Documented in header file
+void HIVE_refresh_weights(){
+	int i;
+
+	// Find the minimum (If no negative numbers, min should be 0)
+	HIVE->weightMin = 0;
+	HIVE->weightSum = 0;
+	for(i = 0; i < HIVE->nSols; i++){
+		double fit = Solution_fitness(HIVE->sols[i]);
+		if(fit < HIVE->weightMin)
+			HIVE->weightMin = fit;
+		HIVE->weightSum += fit;
+	}
+
+	HIVE->weightsValid = true;
+}
+
+// Documented in header file
+int HIVE_select_onlooker(){
+	double total = HIVE->weightSum - HIVE->nSols * HIVE->weightMin;
+	if(total <= 0)
+		return urandom_max(HIVE->nSols);
+
+	double target = drandom_x() * total;
+
+	int i;
+	for(i = 0; i < HIVE->nSols - 1; i++){
+		target -= Solution_fitness(HIVE->sols[i]) - HIVE->weightMin;
+		if(target < 0) break;
+	}
+
+	return i;
+}
+
+// Documented in header file
+void HIVE_steady_start(long nBees){
+	HIVE->steadyBees = nBees;
+	HIVE->steadyDispatched = 0;
+	HIVE->steadyApplied = 0;
+	HIVE_refresh_weights();
+}
+
+// Documented in header file
+void HIVE_steady_stop(){
+	HIVE->steadyBees = HIVE->steadyDispatched;
+}
+
+// Documented in header file
+bool HIVE_steady_step(HiveBee *bee, int hpSize){
+	int nOnlookers = COLONY_SIZE - (COLONY_SIZE * FORAGER_RATIO);
+	long cycleLength = HIVE->nSols + nOnlookers;
+
+	if(bee->index >= 0 && bee->scout){
+		// Another bee may have improved the solution in the meantime
+		if(Solution_idle_iterations(HIVE->sols[bee->index]) > IDLE_LIMIT){
+			HIVE_force_replace_solution(bee->sol, bee->index);
+		} else {
+			Solution_free(bee->sol);
+		}
+	} else if(bee->index >= 0){
+		HIVE_try_replace_solution(bee->sol, bee->index, hpSize);
+
+		HIVE->steadyApplied++;
+		if(HIVE->steadyApplied % cycleLength == 0){
+			HIVE->cycle++;
+			HIVE_refresh_weights();
+		}
+
+		// The bee abandons the food source and becomes a scout
+		if(Solution_idle_iterations(HIVE->sols[bee->index]) > IDLE_LIMIT){
+			bee->sol = Seeds_scout(hpSize);
+			bee->scout = true;
+			return true;
+		}
+	}
+
+	if(HIVE->steadyDispatched == HIVE->steadyBees){
+		bee->index = -1;
+		return false;
+	}
+
+	long step = HIVE->steadyDispatched++ % cycleLength;
+	bee->index = step < HIVE->nSols ? step : HIVE_select_onlooker();
+	bee->sol = HIVE_perturb_solution(bee->index, hpSize);
+	bee->scout = false;
+
+	return true;
 }
@@ -1,12 +1,49 @@
 #ifndef _HIVE_H_
 #define _HIVE_H_
 
-/** \file hive.h Routines for manipulating the bee hive global object. */
+/** \file hive.h Routines for manipulating the bee hive global object.
+ *
+ * Every routine acts on the hive of the calling thread, which is the global hive unless
+ *   the thread chose another one with HIVE_use(). This allows several hives to live in the same process.
+ */
 
+#include <stdbool.h>
 #include <solution/solution.h>
+#include <fitness/fitness_delta.h>
+#include "archive.h"
+
+/** A bee dispatched by the hive in steady-state mode. */
+typedef struct HiveBee_ {
+	Solution sol; /**< Candidate solution carried by the bee */
+	int index;    /**< Index of the hive solution the bee works on, or -1 if the bee carries nothing */
+	bool scout;   /**< Whether 'sol' is a scout's random solution, which replaces the one at 'index' */
+} HiveBee;
+
+/** Handle to a hive other than the global one. */
+typedef struct HIVE_ *Hive;
+
+/** Allocates a new hive, which must be made current with HIVE_use() and then initialized with HIVE_initialize(). */
+Hive HIVE_create();
+
+/** Frees a hive allocated with HIVE_create(). HIVE_destroy() must have been called on it beforehand. */
+void HIVE_delete(Hive hive);
 
-/** Initializes the global HIVE object. */
-void HIVE_initialize();
+/** Makes 'hive' the hive manipulated by the calling thread. */
+void HIVE_use(Hive hive);
+
+/** Returns the hive manipulated by the calling thread. */
+Hive HIVE_current();
+
+/** Locks the hive of the calling thread, for threads that manipulate the same hive concurrently. */
+void HIVE_lock();
+
+/** Unlocks the hive of the calling thread. */
+void HIVE_unlock();
+
+/** Initializes the HIVE object of the calling thread, for a protein with 'hpSize' beads.
+ * A fraction SEED_FRACTION of the solutions is taken from the seed library (see seeds.h), if it was loaded.
+ */
+void HIVE_initialize(int hpSize);
 
 /** Frees memory allocated in HIVE.
  * Does not free the best solution */
@@ -27,6 +64,11 @@ Solution HIVE_solution(int idx);
 /** Returns a pointer to the best solution found so far in the hive. */
 Solution HIVE_best_sol();
 
+/** Returns the archive of best distinct solutions found so far in the hive, or NULL if ARCHIVE_SIZE <= 1.
+ * Every solution accepted by HIVE_try_replace_solution() is offered to the archive.
+ */
+Archive HIVE_archive();
+
 /** Returns the size of the protein being predicted. */
 int HIVE_hp_size();
 
@@ -49,13 +91,24 @@ void HIVE_increment_idle(int index);
 
 /** Causes a minor variation in the solution at given index.
  *
- * The Solution with index 'index' is SOL1, we take a random SOL2 and a random
- *   spot SPOT in the Solutions' movement chain.
+ * The kind of variation is chosen by Moves_choose(). For a move over the coordinates of the beads,
+ *   see Moves_propose(); the returned solution may already have its fitness calculated.
+ *
+ * Otherwise (or if no such move was found), the Solution with index 'index' is SOL1, we take a random SOL2
+ *   and a random spot SPOT in the Solutions' movement chain.
  * SOL1's movement at spot SPOT is made to approach the value in SOL2's movement
  *   at the same spot.
+ * With FEASIBLE_RETRIES, a variation that would add collisions to SOL1 is found by a cheap incremental
+ *   check (see FitnessDelta_try_collisions()) and drawn again, up to FEASIBLE_RETRIES times.
  */
 Solution HIVE_perturb_solution(int index, int hpSize);
 
+/** Returns the incremental evaluation (see fitness_delta.h) of the solution at 'index', which is created again
+ *   if the solution changed since the last call. The hive keeps it, so it must not be freed.
+ * Different threads may take the handles of different solutions at once.
+ */
+FitnessDelta HIVE_solution_delta(int index);
+
 /** The current Solution with index 'index' is SOL1.
  * Checks if 'alt' has a better fitness, and if that is so, replaces SOL1 with 'alt'.
  * If 'alt' is worse, this function frees it, so manipulating 'alt' later is unsafe, and the idle interations of SOL1 is increased.
@@ -68,9 +121,91 @@ void HIVE_try_replace_solution(Solution alt, int index, int hpSize);
  */
 void HIVE_force_replace_solution(Solution alt, int index);
 
+/** Replaces a random solution with 'sol', which came from another hive, and returns true.
+ * If a solution of the hive is 'sol' or a rotated or mirrored copy of it (see MovChain_canonical()),
+ *   'sol' is freed instead, and false is returned.
+ */
+bool HIVE_immigrate(Solution sol);
+
+/** Makes the best solution among the current solutions the best solution of the hive, if it is better,
+ *   and offers all current solutions to the archive.
+ * Meant to be called once the fitness of the initial solutions was calculated.
+ */
+void HIVE_check_best();
+
+/** Refines the best solution of the hive by local search (see local_search.h), if the current cycle is
+ *   a multiple of LOCAL_SEARCH_INTERVAL. Meant to be called right after each cycle.
+ * An improved best solution also replaces the worst solution of the hive.
+ * With LOCAL_SEARCH_ARCHIVE, the archived solutions are refined too, and improvements are offered to the archive.
+ */
+void HIVE_local_search();
+
 /** Replaces the best solution with the given solution.
  * A deep copy is not made, so modifying 'newBest' after calling this function is unsafe.
  */
 void HIVE_replace_best(Solution newBest);
 
+/** Adds to 'proposed' and 'accepted' (with N_MOVES elements each) how many solutions generated by each kind
+ *   of move (see moves.h) were tried by HIVE_try_replace_solution(), and how many replaced the solution they came from.
+ */
+void HIVE_move_counts(long *proposed, long *accepted);
+
+/** Returns the number of bytes that HIVE_serialize() currently needs. */
+size_t HIVE_serialized_size();
+
+/** Writes the state of the hive (solutions, idle iterations, cycle counter, best solution and archive) to 'buf',
+ *   which must have at least HIVE_serialized_size() bytes.
+ * Returns the number of bytes written.
+ */
+size_t HIVE_serialize(char *buf);
+
+/** Restores a state written by HIVE_serialize(), of 'size' bytes, into the hive, which must be initialized.
+ * Returns false if 'buf' doesn't hold a state of a hive with the same number of solutions and protein size,
+ *   in which case the hive may have been partially restored.
+ */
+bool HIVE_deserialize(const char *buf, size_t size);
+
+/** Reasons for a hive to stop before running all its cycles (see HIVE_stop_reasons()). */
+enum HiveStop {
+	HIVE_STOP_TIME       = 1, /**< TIME_BUDGET seconds elapsed since HIVE_initialize() */
+	HIVE_STOP_TARGET     = 2, /**< The best solution reached TARGET_FITNESS */
+	HIVE_STOP_STAGNATION = 4, /**< The best solution didn't improve for STAGNATION_LIMIT cycles */
+};
+
+/** Returns the bitwise OR of the HiveStop criteria that the hive currently meets, or 0 if it should go on.
+ * Cycles are counted by HIVE_increment_cycle() or HIVE_steady_step().
+ */
+int HIVE_stop_reasons();
+
+/** Recalculates the weights with which onlooker bees choose solutions.
+ * All solutions in the hive must have their fitness calculated.
+ * While the weights are valid, every replacement of a solution updates them incrementally.
+ */
+void HIVE_refresh_weights();
+
+/** Chooses a solution with probability proportional to its fitness, as an onlooker bee does.
+ * Fitnesses are shifted by the lowest fitness so they are all non-negative.
+ */
+int HIVE_select_onlooker();
+
+/** Prepares the hive for steady-state mode, in which 'nBees' employed and onlooker bees will be dispatched.
+ * All solutions in the hive must have their fitness calculated.
+ */
+void HIVE_steady_start(long nBees);
+
+/** Dispatches no more bees in steady-state mode. Bees already dispatched are still applied. */
+void HIVE_steady_stop();
+
+/** Applies the result of 'bee' (whose 'sol' must have its fitness calculated) and dispatches the next bee into it.
+ * The first call for a bee should have its 'index' set to -1.
+ *
+ * Within each cycle of the hive, the first HIVE_nSols() bees are employed bees that visit every solution
+ *   in order, and the remaining are onlooker bees that choose solutions by HIVE_select_onlooker().
+ * A solution whose idle iterations exceed IDLE_LIMIT makes the bee that worked on it become a scout.
+ * The cycle counter is incremented when a whole cycle worth of bees has been applied.
+ *
+ * Returns false if there are no more bees to dispatch, in which case 'bee' carries nothing.
+ */
+bool HIVE_steady_step(HiveBee *bee, int hpSize);
+
 #endif
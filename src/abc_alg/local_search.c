@@ -0,0 +1,87 @@
+#include <stdbool.h>
+
+#include <movelem.h>
+#include <fitness/fitness_delta.h>
+#include <config.h>
+
+#include "local_search.h"
+
+/* Changes each element of the chain to the first value that improves it.
+ * Returns whether any element was changed.
+ */
+static
+bool first_improvement_pass(FitnessDelta fd, int chainSize){
+	bool improved = false;
+	int i, v;
+
+	for(i = 0; i < chainSize; i++){
+		MovElem cur = FitnessDelta_chain(fd)[i];
+		double curFit = FitnessDelta_fitness(fd);
+
+		for(v = 0; v < (DOWN+1) * (DOWN+1); v++){
+			MovElem elem = MovElem_from_number(v);
+			if(elem == cur) continue;
+
+			if(FitnessDelta_try(fd, i, elem) > curFit){
+				FitnessDelta_apply(fd, i, elem);
+				improved = true;
+				break;
+			}
+		}
+	}
+
+	return improved;
+}
+
+/* Applies the change of a single element that improves the chain the most.
+ * Returns whether there was such a change.
+ */
+static
+bool best_improvement_pass(FitnessDelta fd, int chainSize){
+	double bestFit = FitnessDelta_fitness(fd);
+	int bestIdx = -1;
+	MovElem bestElem = 0;
+	int i, v;
+
+	for(i = 0; i < chainSize; i++){
+		for(v = 0; v < (DOWN+1) * (DOWN+1); v++){
+			MovElem elem = MovElem_from_number(v);
+			double fit = FitnessDelta_try(fd, i, elem);
+			if(fit > bestFit){
+				bestFit = fit;
+				bestIdx = i;
+				bestElem = elem;
+			}
+		}
+	}
+
+	if(bestIdx < 0) return false;
+
+	FitnessDelta_apply(fd, bestIdx, bestElem);
+	return true;
+}
+
+// Documented in header file
+bool LocalSearch_run(Solution *sol, int hpSize){
+	int chainSize = hpSize - 1;
+	FitnessDelta fd = FitnessDelta_create(Solution_chain(*sol));
+	bool improved = false;
+	int pass;
+
+	for(pass = 0; LOCAL_SEARCH_PASSES <= 0 || pass < LOCAL_SEARCH_PASSES; pass++){
+		bool changed = LOCAL_SEARCH_FIRST_IMPROVEMENT
+			? first_improvement_pass(fd, chainSize)
+			: best_improvement_pass(fd, chainSize);
+		if(!changed) break;
+		improved = true;
+	}
+
+	if(improved){
+		Solution_free(*sol);
+		*sol = Solution_from_chain(FitnessDelta_chain(fd), hpSize);
+		Solution_set_fitness(sol, FitnessDelta_fitness(fd));
+	}
+
+	FitnessDelta_free(fd);
+	return improved;
+}
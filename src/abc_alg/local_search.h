@@ -0,0 +1,22 @@
+#ifndef _LOCAL_SEARCH_H_
+#define _LOCAL_SEARCH_H_
+
+/** \file local_search.h Refinement of solutions by exhaustive search of their 1-neighborhood.
+ *
+ * The 1-neighborhood of a solution holds every chain that differs from its chain in a single element.
+ * Each element takes one of 25 values, so a solution has 24*(hpSize-1) neighbors, which are evaluated
+ *   incrementally (see fitness_delta.h) instead of from scratch.
+ */
+
+#include <stdbool.h>
+#include <solution/solution.h>
+
+/** Replaces 'sol' with better solutions of its 1-neighborhood while there are any, for at most
+ *   LOCAL_SEARCH_PASSES passes over the chain (no limit if 0).
+ * With LOCAL_SEARCH_FIRST_IMPROVEMENT, each element is changed as soon as an improving value is found for it;
+ *   otherwise each pass applies only the best change among all elements.
+ * Returns whether 'sol' improved, in which case it has its fitness calculated and its idle iterations set to 0.
+ */
+bool LocalSearch_run(Solution *sol, int hpSize);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "migration.h"
+
+/* Returns the partner of hive 'me' in the random pairing of 'nHives' hives for migration 'round', or -1 if it has none
+ * Procedure idea:
+ *   The hives are shuffled (Fisher-Yates) by a generator seeded with the round alone, so every hive draws
+ *     the same permutation, and consecutive hives of the permutation are paired
+ *   With an odd number of hives, the last one of the permutation sits the round out
+ */
+static
+int random_partner(int me, int nHives, int round){
+	int i, order[nHives];
+	uint64_t state = 0x9E3779B97F4A7C15ULL * (uint64_t) (round + 1);
+
+	for(i = 0; i < nHives; i++)
+		order[i] = i;
+
+	for(i = nHives - 1; i > 0; i--){
+		// splitmix64
+		uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z ^= z >> 31;
+
+		int j = z % (i + 1);
+		int tmp = order[i];
+		order[i] = order[j];
+		order[j] = tmp;
+	}
+
+	for(i = 0; i + 1 < nHives; i += 2){
+		if(order[i] == me) return order[i + 1];
+		if(order[i + 1] == me) return order[i];
+	}
+	return -1;
+}
+
+// Documented in header file
+int Migration_destinations(int topology, int me, int nHives, int round, int *dests){
+	int count = 0;
+
+	if(nHives < 2) return 0;
+
+	switch(topology){
+		case MIGRATION_BIRING:
+			dests[count++] = (me + 1) % nHives;
+			if(nHives > 2)
+				dests[count++] = (me + nHives - 1) % nHives;
+			break;
+
+		case MIGRATION_HYPERCUBE: {
+			int dims = 0;
+			while((1 << dims) < nHives)
+				dims++;
+
+			int partner = me ^ (1 << (round % dims));
+			if(partner < nHives)
+				dests[count++] = partner;
+			break;
+		}
+
+		case MIGRATION_RANDOM: {
+			int partner = random_partner(me, nHives, round);
+			if(partner >= 0)
+				dests[count++] = partner;
+			break;
+		}
+
+		case MIGRATION_RING:
+		default:
+			dests[count++] = (me + 1) % nHives;
+			break;
+	}
+
+	return count;
+}
+
+/** The consumer only writes 'head' and the producer only writes 'tail'.
+ * Both increase forever; their difference is the number of solutions in the queue.
+ */
+struct MigrationQueue_ {
+	Solution *slots;
+	unsigned capacity;
+	atomic_uint head; /**< Next slot to pop */
+	atomic_uint tail; /**< Next slot to push */
+};
+
+// Documented in header file
+MigrationQueue MigrationQueue_create(int capacity){
+	// A power of two keeps the slot index right when the counters wrap around
+	unsigned size = 1;
+	while(size < (unsigned) capacity)
+		size <<= 1;
+
+	MigrationQueue queue = malloc(sizeof(struct MigrationQueue_));
+	queue->slots = malloc(sizeof(Solution) * size);
+	queue->capacity = size;
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+	return queue;
+}
+
+// Documented in header file
+void MigrationQueue_free(MigrationQueue queue){
+	Solution sol;
+	while(MigrationQueue_pop(queue, &sol))
+		Solution_free(sol);
+
+	free(queue->slots);
+	free(queue);
+}
+
+// Documented in header file
+bool MigrationQueue_push(MigrationQueue queue, Solution sol){
+	unsigned tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+	if(tail - head == queue->capacity)
+		return false;
+
+	queue->slots[tail % queue->capacity] = sol;
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+// Documented in header file
+bool MigrationQueue_pop(MigrationQueue queue, Solution *sol){
+	unsigned head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+	if(head == tail)
+		return false;
+
+	*sol = queue->slots[head % queue->capacity];
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	return true;
+}
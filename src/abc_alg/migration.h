@@ -0,0 +1,53 @@
+#ifndef _MIGRATION_H_
+#define _MIGRATION_H_
+
+/** \file migration.h Routines for exchanging solutions among hives (islands).
+ *
+ * The topology decides, for each migration round, to which hives a hive sends its emigrants.
+ * Hives that live in the same process exchange solutions through MigrationQueue objects,
+ *   one for each ordered pair of hives, so that no hive ever waits for another.
+ */
+
+#include <stdbool.h>
+#include <solution/solution.h>
+
+/** Topologies for the exchange of solutions among hives (see MIGRATION_TOPOLOGY). */
+enum MigrationTopology {
+	MIGRATION_RING      = 0, /**< Hive i sends to hive i+1 */
+	MIGRATION_BIRING    = 1, /**< Hive i sends to hives i-1 and i+1 */
+	MIGRATION_HYPERCUBE = 2, /**< In round r, hive i sends to hive i XOR 2^(r mod log2(n)), if it exists */
+	MIGRATION_RANDOM    = 3, /**< In round r, hives are paired at random, and each sends to its partner */
+};
+
+/** Maximum number of destinations returned by Migration_destinations(). */
+#define MIGRATION_MAX_DESTS 2
+
+/** Writes in 'dests' the hives to which hive 'me' (out of 'nHives') sends emigrants in migration 'round'.
+ * Returns the number of such hives, which is at most MIGRATION_MAX_DESTS.
+ * The result only depends on the arguments (random pairs are drawn from 'round' alone), so all hives agree
+ *   on it without talking to each other.
+ */
+int Migration_destinations(int topology, int me, int nHives, int round, int *dests);
+
+/** Single-producer, single-consumer queue of solutions, which is lock-free. */
+typedef struct MigrationQueue_ *MigrationQueue;
+
+/** Creates an empty queue that holds at least 'capacity' solutions. */
+MigrationQueue MigrationQueue_create(int capacity);
+
+/** Frees the queue and any solution still in it. */
+void MigrationQueue_free(MigrationQueue queue);
+
+/** Appends 'sol' to the queue, which then owns it.
+ * Returns false if the queue is full, in which case the caller still owns 'sol'.
+ * Must only be called by the producer thread.
+ */
+bool MigrationQueue_push(MigrationQueue queue, Solution sol);
+
+/** Removes the oldest solution in the queue and stores it in 'sol'.
+ * Returns false if the queue is empty.
+ * Must only be called by the consumer thread.
+ */
+bool MigrationQueue_pop(MigrationQueue queue, Solution *sol);
+
+#endif
@@ -0,0 +1,346 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <int3d.h>
+#include <movchain.h>
+#include <random.h>
+#include <config.h>
+
+#include "moves.h"
+
+static const char *NAMES[N_MOVES] = { "Relative", "SideChain", "End", "Crankshaft", "Pull" };
+
+static const int3d UNIT[6] = {
+	{ 1, 0, 0}, {-1, 0, 0},
+	{ 0, 1, 0}, { 0,-1, 0},
+	{ 0, 0, 1}, { 0, 0,-1},
+};
+
+static inline
+bool same(int3d a, int3d b){
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static inline
+int3d sub(int3d a, int3d b){
+	return int3d_make(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline
+int3d neg(int3d a){
+	return int3d_make(-a.x, -a.y, -a.z);
+}
+
+static inline
+int dot(int3d a, int3d b){
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline
+int3d cross(int3d a, int3d b){
+	return int3d_make(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static inline
+bool adjacent(int3d a, int3d b){
+	return abs(a.x - b.x) + abs(a.y - b.y) + abs(a.z - b.z) == 1;
+}
+
+/* Whether no bead of the current conformation is in 'p'.
+ * Points the move itself vacates still count as occupied, which only makes moves a bit more conservative.
+ */
+static inline
+bool is_free(FitnessDelta fd, int3d p){
+	return FitnessDelta_occupancy(fd, p) == 0;
+}
+
+// Documented in header file
+const char *Moves_name(int kind){
+	return NAMES[kind];
+}
+
+// Documented in header file
+int Moves_choose(){
+	double weights[N_MOVES] = { MOVE_WEIGHT_RELATIVE, MOVE_WEIGHT_SIDE_CHAIN, MOVE_WEIGHT_END,
+	                            MOVE_WEIGHT_CRANKSHAFT, MOVE_WEIGHT_PULL };
+	double total = 0;
+	int i;
+
+	for(i = 0; i < N_MOVES; i++)
+		if(weights[i] > 0) total += weights[i];
+
+	if(total <= 0 || total == weights[MOVE_RELATIVE])
+		return MOVE_RELATIVE;
+
+	double r = drandom_x() * total;
+	int last = MOVE_RELATIVE;
+	for(i = 0; i < N_MOVES; i++){
+		if(weights[i] <= 0) continue;
+		if(r < weights[i]) return i;
+		r -= weights[i];
+		last = i;
+	}
+	return last; // Rounding errors
+}
+
+/* Moves a random side chain bead to another free point around its backbone bead */
+static
+bool side_chain_move(FitnessDelta fd, int hpSize, int3d *newBB, int3d *newSC){
+	const int3d *bb = FitnessDelta_coords_bb(fd);
+	const int3d *sc = FitnessDelta_coords_sc(fd);
+
+	int i = urandom_max(hpSize);
+	int3d forbidden = i == 0 ? bb[1] : bb[i-1]; // Side chains can't go back along the backbone
+	int start = urandom_max(6);
+	int k;
+
+	for(k = 0; k < 6; k++){
+		int3d site = int3d_add(bb[i], UNIT[(start + k) % 6]);
+		if(!same(site, sc[i]) && !same(site, forbidden) && is_free(fd, site)){
+			newSC[i] = site;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Moves the first or the last backbone bead to another free point around its neighbor */
+static
+bool end_move(FitnessDelta fd, int hpSize, int3d *newBB, int3d *newSC){
+	const int3d *bb = FitnessDelta_coords_bb(fd);
+	const int3d *sc = FitnessDelta_coords_sc(fd);
+
+	int end = urandom_max(2) ? hpSize - 1 : 0;
+	int3d anchor = end == 0 ? bb[1] : bb[hpSize - 2];
+	int start = urandom_max(6);
+	int k;
+
+	for(k = 0; k < 6; k++){
+		int3d site = int3d_add(anchor, UNIT[(start + k) % 6]);
+		if(!same(site, bb[end]) && is_free(fd, site)){
+			newBB[end] = site;
+			newSC[end] = int3d_add(site, sub(sc[end], bb[end]));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Rotates 's' around axis 'a', in the rotation that takes 'v' to 'w' (all unit vectors, with 'v' and 'w' normal to 'a') */
+static
+int3d rotate(int3d s, int3d a, int3d v, int3d w){
+	if(dot(s, a) != 0) return s;
+	if(same(s, v)) return w;
+	if(same(s, neg(v))) return neg(w);
+	if(same(s, cross(a, v))) return cross(a, w);
+	return neg(cross(a, w));
+}
+
+/* Rotates a U-shaped pair of backbone beads around the axis of the U
+ *
+ * Procedure idea:
+ *   Beads i-1, i, i+1, i+2 make a U when i-1 and i+2 are adjacent. Beads i and i+1 then hang from the axis
+ *     i-1 -> i+2 along a direction V normal to it, and can hang along any other normal direction W as long
+ *     as both new points are free. Their side chains rotate along.
+ */
+static
+bool crankshaft_move(FitnessDelta fd, int hpSize, int3d *newBB, int3d *newSC){
+	const int3d *bb = FitnessDelta_coords_bb(fd);
+	const int3d *sc = FitnessDelta_coords_sc(fd);
+
+	if(hpSize < 4) return false;
+
+	int nPlaces = hpSize - 3;
+	int start = urandom_max(nPlaces);
+	int t, k;
+
+	for(t = 0; t < nPlaces; t++){
+		int i = 1 + (start + t) % nPlaces;
+		int3d a = sub(bb[i+2], bb[i-1]);
+		int3d v = sub(bb[i], bb[i-1]);
+
+		if(!adjacent(bb[i+2], bb[i-1]) || !same(v, sub(bb[i+1], bb[i+2])) || dot(a, v) != 0)
+			continue;
+
+		int dirStart = urandom_max(6);
+		for(k = 0; k < 6; k++){
+			int3d w = UNIT[(dirStart + k) % 6];
+			if(dot(w, a) != 0 || same(w, v)) continue;
+
+			int3d site1 = int3d_add(bb[i-1], w);
+			int3d site2 = int3d_add(bb[i+2], w);
+			if(!is_free(fd, site1) || !is_free(fd, site2)) continue;
+
+			newBB[i] = site1;
+			newBB[i+1] = site2;
+			newSC[i] = int3d_add(site1, rotate(sub(sc[i], bb[i]), a, v, w));
+			newSC[i+1] = int3d_add(site2, rotate(sub(sc[i+1], bb[i+1]), a, v, w));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Pull move (Lesh, Mitzenmacher and Whitesides, 2003)
+ *
+ * Procedure idea:
+ *   Looking at the chain from one of its ends, take a bead K and its successor K+1.
+ *   L is a free point adjacent to K+1 and diagonal to K, and C is the point adjacent to both L and K.
+ *   K goes to L. If C holds K-1, we are done (a corner flip).
+ *   Otherwise C must be free, and K-1 goes to C. Then each bead J from K-2 towards the end goes to where
+ *     bead J+2 was, until bead J is already adjacent to the new place of bead J+1.
+ */
+static
+bool pull_move(FitnessDelta fd, int hpSize, int3d *newBB, int3d *newSC){
+	const int3d *bb = FitnessDelta_coords_bb(fd);
+	const int3d *sc = FitnessDelta_coords_sc(fd);
+
+	if(hpSize < 3) return false;
+
+	bool fromStart = urandom_max(2);
+	#define VIEW(K) (fromStart ? (K) : hpSize - 1 - (K))
+
+	int nPlaces = hpSize - 2;
+	int start = urandom_max(nPlaces);
+	int t, k, j;
+
+	for(t = 0; t < nPlaces; t++){
+		int K = 1 + (start + t) % nPlaces;
+		int3d p = bb[VIEW(K)];
+		int3d q = bb[VIEW(K+1)];
+		int3d prev = bb[VIEW(K-1)];
+		int3d axis = sub(p, q);
+
+		int dirStart = urandom_max(6);
+		for(k = 0; k < 6; k++){
+			int3d d = UNIT[(dirStart + k) % 6];
+			if(dot(d, axis) != 0) continue;
+
+			int3d L = int3d_add(q, d);
+			int3d C = int3d_add(p, d);
+			if(!is_free(fd, L) || !(same(C, prev) || is_free(fd, C))) continue;
+
+			newBB[VIEW(K)] = L;
+			if(!same(C, prev)){
+				newBB[VIEW(K-1)] = C;
+				for(j = K - 2; j >= 0; j--){
+					if(adjacent(bb[VIEW(j)], newBB[VIEW(j+1)])) break;
+					newBB[VIEW(j)] = bb[VIEW(j+2)];
+				}
+			}
+
+			// Side chains go along with their backbone beads
+			for(j = 0; j <= K; j++)
+				if(!same(newBB[VIEW(j)], bb[VIEW(j)]))
+					newSC[VIEW(j)] = int3d_add(newBB[VIEW(j)], sub(sc[VIEW(j)], bb[VIEW(j)]));
+
+			return true;
+		}
+	}
+
+	#undef VIEW
+	return false;
+}
+
+/* Returns a point around backbone bead 'bbPoint' for its side chain, other than 'forbidden'.
+ * Prefers the point in direction 'offset', then any free point, then any point.
+ */
+static
+int3d side_chain_site(FitnessDelta fd, int3d bbPoint, int3d offset, int3d forbidden){
+	int3d site = int3d_add(bbPoint, offset);
+	if(!same(site, forbidden) && is_free(fd, site))
+		return site;
+
+	int start = urandom_max(6);
+	int k;
+	for(k = 0; k < 6; k++){
+		site = int3d_add(bbPoint, UNIT[(start + k) % 6]);
+		if(!same(site, forbidden) && is_free(fd, site))
+			return site;
+	}
+
+	// Crowded point: keep the chain representable at least
+	for(k = 0; k < 6; k++){
+		site = int3d_add(bbPoint, UNIT[(start + k) % 6]);
+		if(!same(site, forbidden))
+			break;
+	}
+	return site;
+}
+
+/* Places again every side chain bead that was left apart from its backbone bead, or on the backbone bead before it */
+static
+void fix_side_chains(FitnessDelta fd, int hpSize, int3d *newBB, int3d *newSC){
+	const int3d *bb = FitnessDelta_coords_bb(fd);
+	const int3d *sc = FitnessDelta_coords_sc(fd);
+	int i;
+
+	for(i = 0; i < hpSize; i++){
+		int3d forbidden = i == 0 ? newBB[1] : newBB[i-1];
+		if(!adjacent(newSC[i], newBB[i]) || same(newSC[i], forbidden))
+			newSC[i] = side_chain_site(fd, newBB[i], sub(sc[i], bb[i]), forbidden);
+	}
+}
+
+// Documented in header file
+bool Moves_propose(FitnessDelta fd, int kind, int hpSize, Solution *sol){
+	const int3d *bb = FitnessDelta_coords_bb(fd);
+	const int3d *sc = FitnessDelta_coords_sc(fd);
+	int chainSize = hpSize - 1;
+	bool found = false;
+	int i;
+
+	int3d *newBB = malloc(sizeof(int3d) * hpSize);
+	int3d *newSC = malloc(sizeof(int3d) * hpSize);
+	memcpy(newBB, bb, sizeof(int3d) * hpSize);
+	memcpy(newSC, sc, sizeof(int3d) * hpSize);
+
+	switch(kind){
+		case MOVE_SIDE_CHAIN: found = side_chain_move(fd, hpSize, newBB, newSC); break;
+		case MOVE_END:        found = end_move(fd, hpSize, newBB, newSC);        break;
+		case MOVE_CRANKSHAFT: found = crankshaft_move(fd, hpSize, newBB, newSC); break;
+		case MOVE_PULL:       found = pull_move(fd, hpSize, newBB, newSC);       break;
+	}
+
+	MovElem *chain = malloc(sizeof(MovElem) * chainSize);
+	if(found){
+		fix_side_chains(fd, hpSize, newBB, newSC);
+		found = MovChain_from_3d(newBB, newSC, chainSize, chain) == 0;
+	}
+
+	if(found){
+		*sol = Solution_from_chain(chain, hpSize);
+		Solution_set_move(sol, kind);
+
+		// The chain places the beads exactly where they are now only if the first two backbone beads didn't move
+		if(same(newBB[0], bb[0]) && same(newBB[1], bb[1])){
+			int *beads = malloc(sizeof(int) * 2 * hpSize);
+			int3d *coords = malloc(sizeof(int3d) * 2 * hpSize);
+			int nMoved = 0;
+
+			for(i = 0; i < hpSize; i++){
+				if(!same(newBB[i], bb[i])){
+					beads[nMoved] = i;
+					coords[nMoved++] = newBB[i];
+				}
+				if(!same(newSC[i], sc[i])){
+					beads[nMoved] = hpSize + i;
+					coords[nMoved++] = newSC[i];
+				}
+			}
+
+			Solution_set_fitness(sol, FitnessDelta_try_beads(fd, nMoved, beads, coords));
+			free(beads);
+			free(coords);
+		}
+	}
+
+	free(chain);
+	free(newBB);
+	free(newSC);
+	return found;
+}
@@ -0,0 +1,49 @@
+#ifndef _MOVES_H_
+#define _MOVES_H_
+
+/** \file moves.h Move operators defined over the 3D coordinates of the beads, rather than over the movement chain.
+ *
+ * Changing a single element of a movement chain moves every bead after it, so late in a run most such changes
+ *   make the protein collide. The moves here touch only a few beads, keeping the others where they are:
+ *   - MOVE_SIDE_CHAIN: a side chain bead goes to another free point around its backbone bead.
+ *   - MOVE_END: a terminal backbone bead goes to another free point around its neighbor.
+ *   - MOVE_CRANKSHAFT: two backbone beads in a U shape rotate around the axis of the U.
+ *   - MOVE_PULL: a backbone bead goes to a free point diagonal to it, and the beads before it (or after it)
+ *       follow it only until the chain is connected again.
+ * MOVE_RELATIVE is the original Solution_perturb_relative().
+ *
+ * Side chain beads go along with their backbone beads, keeping their direction whenever possible.
+ * The resulting beads are converted back to a movement chain with MovChain_from_3d().
+ */
+
+#include <stdbool.h>
+#include <fitness/fitness_delta.h>
+#include <solution/solution.h>
+
+/** Kinds of moves */
+enum MoveKind {
+	MOVE_RELATIVE   = 0,
+	MOVE_SIDE_CHAIN = 1,
+	MOVE_END        = 2,
+	MOVE_CRANKSHAFT = 3,
+	MOVE_PULL       = 4,
+	N_MOVES         = 5
+};
+
+/** Returns the name of a kind of move, for reports. */
+const char *Moves_name(int kind);
+
+/** Returns a random kind of move, chosen with probabilities proportional to the MOVE_* weights in the configuration.
+ * No random number is drawn if only MOVE_RELATIVE has a positive weight.
+ */
+int Moves_choose();
+
+/** Proposes a random move of the given kind (other than MOVE_RELATIVE) to the chain of 'fd'.
+ * On success, stores in 'sol' a new Solution with the resulting chain and returns true.
+ * Its fitness is calculated incrementally by 'fd', unless the first two backbone beads moved,
+ *   in which case it is left to be calculated.
+ * Returns false if no such move was found, in which case nothing is allocated.
+ */
+bool Moves_propose(FitnessDelta fd, int kind, int hpSize, Solution *sol);
+
+#endif
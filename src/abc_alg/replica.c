@@ -0,0 +1,570 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <mpi/mpi.h>
+
+#include <movchain.h>
+#include <fitness/fitness.h>
+#include <fitness/fitness_delta.h>
+#include <solution/solution_mpi.h>
+#include <random.h>
+#include <config.h>
+
+#include "replica.h"
+#include "hive.h"
+#include "seeds.h"
+
+/** Kinds of work the master broadcasts for a phase */
+enum ReplicaWork {
+	WORK_EVALUATE = 0, /**< Solutions to evaluate (see Replica_calculate_fitness()) */
+	WORK_GENERATE = 1, /**< Parents of solutions to generate and evaluate (see Replica_generate()) */
+};
+
+/** Number of differences of a record that holds the whole chain */
+#define RECORD_WHOLE -1
+
+/** Number of differences of a record that holds no chain at all */
+#define RECORD_NONE -2
+
+/** Bytes of a message being written or read */
+typedef struct {
+	char *data;
+	size_t used;     /**< Number of bytes written */
+	size_t capacity; /**< Number of bytes 'data' has room for */
+} Message;
+
+/** State of the replica protocol in this node */
+static struct {
+	MPI_Comm comm;
+	int commSize;
+	int myRank;
+	int nSols;         /**< Number of solutions of the hive */
+	int chainSize;     /**< Number of elements of each movement chain */
+	MovElem *mirror;   /**< In the master, the chain each slave holds for each solution of the hive */
+	double *mirrorFit; /**< In the master, the fitness each slave holds for each solution of the hive */
+	bool *synced;      /**< In the master, whether each solution of 'mirror' was ever sent */
+	Message work;      /**< Work broadcast for each phase */
+	Message results;   /**< Results of the share of this node, with WORK_GENERATE */
+	Message gathered;  /**< In the master, results of all nodes, with WORK_GENERATE */
+} REPLICA;
+
+/** A solution of the phase that a slave evaluates incrementally against its parent */
+typedef struct {
+	int parent;
+	int share;    /**< Index of the solution within the share of the slave */
+	int position; /**< Element that differs from the parent */
+	MovElem elem; /**< Value of that element */
+} DeltaItem;
+
+// Documented in header file
+void Replica_initialize(int hpSize, MPI_Comm comm){
+	REPLICA.comm = comm;
+	MPI_Comm_size(comm, &REPLICA.commSize);
+	MPI_Comm_rank(comm, &REPLICA.myRank);
+	REPLICA.nSols = HIVE_nSols();
+	REPLICA.chainSize = hpSize - 1;
+	REPLICA.mirror = NULL;
+	REPLICA.mirrorFit = NULL;
+	REPLICA.synced = NULL;
+	memset(&REPLICA.work, 0, sizeof(Message));
+	memset(&REPLICA.results, 0, sizeof(Message));
+	memset(&REPLICA.gathered, 0, sizeof(Message));
+
+	if(REPLICA.myRank == 0){
+		REPLICA.mirror = malloc(sizeof(MovElem) * REPLICA.nSols * REPLICA.chainSize);
+		REPLICA.mirrorFit = malloc(sizeof(double) * REPLICA.nSols);
+		REPLICA.synced = calloc(REPLICA.nSols, sizeof(bool));
+	}
+}
+
+// Documented in header file
+void Replica_free(){
+	free(REPLICA.mirror);
+	free(REPLICA.mirrorFit);
+	free(REPLICA.synced);
+	free(REPLICA.work.data);
+	free(REPLICA.results.data);
+	free(REPLICA.gathered.data);
+	REPLICA.mirror = NULL;
+	REPLICA.mirrorFit = NULL;
+	REPLICA.synced = NULL;
+	memset(&REPLICA.work, 0, sizeof(Message));
+	memset(&REPLICA.results, 0, sizeof(Message));
+	memset(&REPLICA.gathered, 0, sizeof(Message));
+}
+
+/******************************************/
+/****** MESSAGE PROCEDURES         ********/
+/******************************************/
+
+/* Makes room for 'size' bytes in 'msg' */
+static
+void reserve(Message *msg, size_t size){
+	if(size <= msg->capacity) return;
+	msg->capacity = size > 2 * msg->capacity ? size : 2 * msg->capacity;
+	msg->data = realloc(msg->data, msg->capacity);
+}
+
+/* Appends 'size' bytes to 'msg' */
+static
+void put(Message *msg, const void *data, size_t size){
+	reserve(msg, msg->used + size);
+	memcpy(msg->data + msg->used, data, size);
+	msg->used += size;
+}
+
+/* Reads 'size' bytes of a message at 'cur' into 'data', and advances 'cur' */
+static inline
+void take(const char **cur, void *data, size_t size){
+	memcpy(data, *cur, size);
+	*cur += size;
+}
+
+/* Appends 'chain' to 'msg' as a record of how it differs from 'base', or whole if 'base' is NULL
+ * Procedure idea:
+ *   A record starts with the number of elements that differ, each followed by its position and value.
+ *   If listing them would take at least as long as the chain, the number is RECORD_WHOLE and the chain follows.
+ */
+static
+void put_record(Message *msg, const MovElem *base, const MovElem *chain){
+	int i, nDiffs = 0;
+	int chainSize = REPLICA.chainSize;
+	int maxDiffs = chainSize / (sizeof(int) + sizeof(MovElem));
+
+	if(base){
+		for(i = 0; i < chainSize && nDiffs <= maxDiffs; i++)
+			nDiffs += base[i] != chain[i];
+	}
+
+	if(!base || nDiffs > maxDiffs){
+		int whole = RECORD_WHOLE;
+		put(msg, &whole, sizeof(int));
+		put(msg, chain, sizeof(MovElem) * chainSize);
+		return;
+	}
+
+	put(msg, &nDiffs, sizeof(int));
+	for(i = 0; i < chainSize; i++){
+		if(base[i] != chain[i]){
+			put(msg, &i, sizeof(int));
+			put(msg, &chain[i], sizeof(MovElem));
+		}
+	}
+}
+
+/* Reads a record written by put_record() at 'cur' and applies it to 'chain', which must hold its base.
+ * Returns the number of elements that differ, RECORD_WHOLE if the record held the whole chain, or RECORD_NONE
+ *   if it held no chain.
+ * If exactly one element differs, its position and value are also stored in 'position' and 'elem'.
+ */
+static
+int take_record(const char **cur, MovElem *chain, int *position, MovElem *elem){
+	int i, nDiffs;
+	take(cur, &nDiffs, sizeof(int));
+
+	if(nDiffs == RECORD_NONE)
+		return nDiffs;
+
+	if(nDiffs == RECORD_WHOLE){
+		take(cur, chain, sizeof(MovElem) * REPLICA.chainSize);
+		return nDiffs;
+	}
+
+	for(i = 0; i < nDiffs; i++){
+		take(cur, position, sizeof(int));
+		take(cur, elem, sizeof(MovElem));
+		chain[*position] = *elem;
+	}
+
+	return nDiffs;
+}
+
+/* Index of the first solution, out of 'nSols', that node 'rank' works on */
+static inline
+int share_start(int rank, int nSols){
+	return (long) rank * nSols / REPLICA.commSize;
+}
+
+/* Starts the work message of a phase of the given kind, for 'nSols' solutions
+ * Procedure idea:
+ *   The message starts with the hive solutions whose chain or fitness changed since the last phase,
+ *     each as its index, its fitness and a record against the chain the slaves hold
+ *   Only WORK_GENERATE needs the fitness of the replica. Otherwise it is sent as FITNESS_MIN (not calculated),
+ *     as the hive solutions may not have been evaluated yet
+ */
+static
+void start_work(int kind, int nSols){
+	int i;
+	int chainSize = REPLICA.chainSize;
+	int header[3] = { kind, nSols, 0 };
+	bool withFitness = kind == WORK_GENERATE;
+
+	REPLICA.work.used = 0;
+	put(&REPLICA.work, header, sizeof(header));
+
+	for(i = 0; i < REPLICA.nSols; i++){
+		Solution sol = HIVE_solution(i);
+		const MovElem *chain = Solution_chain(sol);
+		double fit = withFitness ? Solution_fitness(sol) : FITNESS_MIN;
+		MovElem *mirror = REPLICA.mirror + (size_t) i * chainSize;
+		bool sameFit = !withFitness || REPLICA.mirrorFit[i] == fit;
+		if(REPLICA.synced[i] && sameFit && memcmp(mirror, chain, sizeof(MovElem) * chainSize) == 0)
+			continue;
+
+		put(&REPLICA.work, &i, sizeof(int));
+		put(&REPLICA.work, &fit, sizeof(double));
+		put_record(&REPLICA.work, REPLICA.synced[i] ? mirror : NULL, chain);
+		memcpy(mirror, chain, sizeof(MovElem) * chainSize);
+		REPLICA.mirrorFit[i] = fit;
+		REPLICA.synced[i] = true;
+		header[2]++;
+	}
+
+	memcpy(REPLICA.work.data + 2 * sizeof(int), &header[2], sizeof(int));
+}
+
+/* Sends the work message from the master to all slaves */
+static
+void broadcast_work(){
+	int size = REPLICA.work.used;
+	MPI_Bcast(&size, 1, MPI_INT, 0, REPLICA.comm);
+	MPI_Bcast(REPLICA.work.data, size, MPI_BYTE, 0, REPLICA.comm);
+}
+
+/* Applies the 'nUpdates' hive solutions that changed, right after the header of the work message at 'cur',
+ *   to the replica, and advances 'cur'
+ */
+static
+void update_replica(const char **cur, int nUpdates, int hpSize){
+	int i, position;
+	MovElem elem;
+	MovElem chain[REPLICA.chainSize];
+
+	for(i = 0; i < nUpdates; i++){
+		int index;
+		double fit;
+		take(cur, &index, sizeof(int));
+		take(cur, &fit, sizeof(double));
+		memcpy(chain, Solution_chain(HIVE_solution(index)), sizeof(MovElem) * REPLICA.chainSize);
+		take_record(cur, chain, &position, &elem);
+
+		Solution sol = Solution_from_chain(chain, hpSize);
+		Solution_set_fitness(&sol, fit);
+		HIVE_force_replace_solution(sol, index);
+	}
+}
+
+/******************************************/
+/****** EVALUATION PROCEDURES      ********/
+/******************************************/
+
+/* Gathers the fitnesses 'fits' of the share of this node into the master, where 'fits' holds all 'nSols' */
+static
+void gather_fitnesses(double *fits, int nSols){
+	int r;
+	int counts[REPLICA.commSize], displs[REPLICA.commSize];
+
+	for(r = 0; r < REPLICA.commSize; r++){
+		displs[r] = share_start(r, nSols);
+		counts[r] = share_start(r + 1, nSols) - displs[r];
+	}
+
+	int myCount = counts[REPLICA.myRank];
+	if(REPLICA.myRank == 0){
+		MPI_Gatherv(MPI_IN_PLACE, myCount, MPI_DOUBLE, fits, counts, displs, MPI_DOUBLE, 0, REPLICA.comm);
+	} else {
+		MPI_Gatherv(fits, myCount, MPI_DOUBLE, NULL, counts, displs, MPI_DOUBLE, 0, REPLICA.comm);
+	}
+}
+
+// Documented in header file
+void Replica_calculate_fitness(Solution *sols, const int *parents, int nSols, int hpSize){
+	int i;
+	int chainSize = REPLICA.chainSize;
+
+	// Solutions of the phase, against their parents
+	start_work(WORK_EVALUATE, nSols);
+	for(i = 0; i < nSols; i++){
+		int parent = parents ? parents[i] : -1;
+		put(&REPLICA.work, &parent, sizeof(int));
+		put_record(&REPLICA.work, parent < 0 ? NULL : REPLICA.mirror + (size_t) parent * chainSize, Solution_chain(sols[i]));
+	}
+	broadcast_work();
+
+	// The master evaluates the first share itself
+	int myCount = share_start(1, nSols);
+	Solution_calculate_fitness(sols, myCount);
+
+	double *fits = malloc(sizeof(double) * (nSols > 0 ? nSols : 1));
+	for(i = 0; i < myCount; i++)
+		fits[i] = Solution_fitness(sols[i]);
+	gather_fitnesses(fits, nSols);
+
+	for(i = myCount; i < nSols; i++)
+		Solution_set_fitness(&sols[i], fits[i]);
+	free(fits);
+}
+
+static
+int delta_item_compare(const void *a, const void *b){
+	const DeltaItem *da = a, *db = b;
+	if(da->parent != db->parent)
+		return da->parent - db->parent;
+	return da->share - db->share;
+}
+
+/* Evaluates the 'nItems' solutions in 'items' against the FitnessDelta of their parents in the replica
+ * Procedure idea:
+ *   Items are sorted by parent, and each run of items of the same parent is evaluated by a single thread,
+ *     as a FitnessDelta can't be used by several threads at once
+ */
+static
+void evaluate_deltas(DeltaItem *items, int nItems, double *fits){
+	int i, nRuns = 0;
+	int runs[nItems + 1];
+
+	qsort(items, nItems, sizeof(DeltaItem), delta_item_compare);
+	for(i = 0; i < nItems; i++){
+		if(i == 0 || items[i].parent != items[i - 1].parent)
+			runs[nRuns++] = i;
+	}
+	runs[nRuns] = nItems;
+
+	#pragma omp parallel for num_threads(N_THREADS) schedule(dynamic, 1) if(nRuns > 1)
+	for(i = 0; i < nRuns; i++){
+		int j;
+		FitnessDelta fd = HIVE_solution_delta(items[runs[i]].parent);
+		for(j = runs[i]; j < runs[i + 1]; j++)
+			fits[items[j].share] = FitnessDelta_try(fd, items[j].position, items[j].elem);
+	}
+}
+
+/* Evaluates the share of this slave of the 'nSols' solutions of a WORK_EVALUATE message at 'cur',
+ *   and sends their fitnesses to the master
+ */
+static
+void evaluate_share(const char *cur, int nSols, int hpSize){
+	int i;
+	int chainSize = REPLICA.chainSize;
+	int first = share_start(REPLICA.myRank, nSols);
+	int nShare = share_start(REPLICA.myRank + 1, nSols) - first;
+	MovElem *chains = malloc(sizeof(MovElem) * (nShare > 0 ? nShare : 1) * chainSize);
+	int *wholeIdx = malloc(sizeof(int) * (nShare > 0 ? nShare : 1));
+	DeltaItem *items = malloc(sizeof(DeltaItem) * (nShare > 0 ? nShare : 1));
+	double *fits = malloc(sizeof(double) * (nShare > 0 ? nShare : 1));
+	int nWhole = 0, nItems = 0;
+
+	// Solutions of other shares are skipped over
+	for(i = 0; i < first + nShare; i++){
+		int parent, position;
+		MovElem elem;
+		MovElem *chain = chains + (size_t) nWhole * chainSize;
+		take(&cur, &parent, sizeof(int));
+		if(parent >= 0)
+			memcpy(chain, Solution_chain(HIVE_solution(parent)), sizeof(MovElem) * chainSize);
+
+		int nDiffs = take_record(&cur, chain, &position, &elem);
+		if(i < first)
+			continue;
+
+		if(parent >= 0 && nDiffs == 1){
+			items[nItems++] = (DeltaItem) { parent, i - first, position, elem };
+		} else {
+			wholeIdx[nWhole++] = i - first;
+		}
+	}
+
+	// Solutions evaluated from scratch, then incrementally
+	double wholeFits[nWhole > 0 ? nWhole : 1];
+	Solution_evaluate_chains(chains, nWhole, hpSize, wholeFits);
+	for(i = 0; i < nWhole; i++)
+		fits[wholeIdx[i]] = wholeFits[i];
+	evaluate_deltas(items, nItems, fits);
+
+	gather_fitnesses(fits, nSols);
+
+	free(chains);
+	free(wholeIdx);
+	free(items);
+	free(fits);
+}
+
+/******************************************/
+/****** GENERATION PROCEDURES      ********/
+/******************************************/
+
+/* Returns the fitness of 'sol', generated from the hive solution 'parent' (-1 if none),
+ *   incrementally if it differs from its parent in a single element
+ */
+static
+double candidate_fitness(Solution sol, int parent){
+	if(parent >= 0){
+		FitnessDelta fd = HIVE_solution_delta(parent);
+		const MovElem *base = FitnessDelta_chain(fd);
+		const MovElem *chain = Solution_chain(sol);
+		int i, position = -1, nDiffs = 0;
+
+		for(i = 0; i < REPLICA.chainSize && nDiffs <= 1; i++){
+			if(base[i] != chain[i]){
+				position = i;
+				nDiffs++;
+			}
+		}
+
+		if(nDiffs == 1)
+			return FitnessDelta_try(fd, position, chain[position]);
+	}
+
+	return Solution_fitness(sol);
+}
+
+/* Generates and evaluates the share of this node of the 'nSols' solutions whose parents are 'parents',
+ *   and writes their results to REPLICA.results
+ * Procedure idea:
+ *   The i-th solution of the phase is drawn from a generator seeded with 'seed' + i
+ *   Each run of solutions of the same parent is generated by a single thread, as they share the FitnessDelta
+ *     of their parent, and the thread goes back to its own random sequence afterwards
+ *   Each result is the fitness and the kind of move of the solution, followed by a record of its chain
+ *     against its parent, or RECORD_NONE if it is not better than its parent
+ */
+static
+void generate_share(const int *parents, int nSols, uint64_t seed, int hpSize){
+	int i, nRuns = 0;
+	int first = share_start(REPLICA.myRank, nSols);
+	int nShare = share_start(REPLICA.myRank + 1, nSols) - first;
+	Solution *sols = malloc(sizeof(Solution) * (nShare > 0 ? nShare : 1));
+	int runs[nShare + 1];
+	Hive hive = HIVE_current();
+
+	for(i = 0; i < nShare; i++){
+		int parent = parents[first + i];
+		if(i == 0 || parent < 0 || parent != parents[first + i - 1])
+			runs[nRuns++] = i;
+	}
+	runs[nRuns] = nShare;
+
+	#pragma omp parallel for num_threads(N_THREADS) schedule(dynamic, 1) if(nRuns > 1)
+	for(i = 0; i < nRuns; i++){
+		int j;
+		RandomState own = RANDOM_STATE;
+		HIVE_use(hive);
+
+		for(j = runs[i]; j < runs[i + 1]; j++){
+			int parent = parents[first + j];
+			random_use_seed(seed + first + j);
+			sols[j] = parent < 0 ? Seeds_scout(hpSize) : HIVE_perturb_solution(parent, hpSize);
+			Solution_set_fitness(&sols[j], candidate_fitness(sols[j], parent));
+		}
+
+		RANDOM_STATE = own;
+	}
+
+	REPLICA.results.used = 0;
+	for(i = 0; i < nShare; i++){
+		int parent = parents[first + i];
+		double fit = Solution_fitness(sols[i]);
+		int move = Solution_move(sols[i]);
+		put(&REPLICA.results, &fit, sizeof(double));
+		put(&REPLICA.results, &move, sizeof(int));
+
+		if(parent >= 0 && fit <= Solution_fitness(HIVE_solution(parent))){
+			int none = RECORD_NONE;
+			put(&REPLICA.results, &none, sizeof(int));
+		} else {
+			put_record(&REPLICA.results, parent < 0 ? NULL : Solution_chain(HIVE_solution(parent)), Solution_chain(sols[i]));
+		}
+
+		Solution_free(sols[i]);
+	}
+
+	free(sols);
+}
+
+/* Gathers the results of all nodes, one after the other, into REPLICA.gathered of the master */
+static
+void gather_results(){
+	int r, total = 0;
+	int size = REPLICA.results.used;
+	int sizes[REPLICA.commSize], displs[REPLICA.commSize];
+
+	MPI_Gather(&size, 1, MPI_INT, sizes, 1, MPI_INT, 0, REPLICA.comm);
+	if(REPLICA.myRank == 0){
+		for(r = 0; r < REPLICA.commSize; r++){
+			displs[r] = total;
+			total += sizes[r];
+		}
+		reserve(&REPLICA.gathered, total);
+		REPLICA.gathered.used = total;
+	}
+
+	MPI_Gatherv(REPLICA.results.data, size, MPI_BYTE, REPLICA.gathered.data, sizes, displs, MPI_BYTE, 0, REPLICA.comm);
+}
+
+// Documented in header file
+void Replica_generate(const int *parents, int nSols, int hpSize, Solution *sols){
+	int i, position;
+	MovElem elem;
+	MovElem chain[REPLICA.chainSize];
+
+	uint64_t seed = random_u64();
+	start_work(WORK_GENERATE, nSols);
+	put(&REPLICA.work, &seed, sizeof(uint64_t));
+	put(&REPLICA.work, parents, sizeof(int) * nSols);
+	broadcast_work();
+
+	generate_share(parents, nSols, seed, hpSize);
+	gather_results();
+
+	const char *cur = REPLICA.gathered.data;
+	for(i = 0; i < nSols; i++){
+		double fit;
+		int move;
+		take(&cur, &fit, sizeof(double));
+		take(&cur, &move, sizeof(int));
+
+		if(parents[i] >= 0)
+			memcpy(chain, Solution_chain(HIVE_solution(parents[i])), sizeof(MovElem) * REPLICA.chainSize);
+		int nDiffs = take_record(&cur, chain, &position, &elem);
+
+		sols[i] = nDiffs == RECORD_NONE ? Solution_blank(hpSize) : Solution_from_chain(chain, hpSize);
+		Solution_set_fitness(&sols[i], fit);
+		Solution_set_move(&sols[i], move);
+	}
+}
+
+// Documented in header file
+void Replica_slave(int hpSize){
+	while(true){
+		int size;
+		MPI_Bcast(&size, 1, MPI_INT, 0, REPLICA.comm);
+		if(size < 0)
+			break;
+
+		reserve(&REPLICA.work, size);
+		MPI_Bcast(REPLICA.work.data, size, MPI_BYTE, 0, REPLICA.comm);
+
+		int header[3];
+		const char *cur = REPLICA.work.data;
+		take(&cur, header, sizeof(header));
+		update_replica(&cur, header[2], hpSize);
+
+		if(header[0] == WORK_GENERATE){
+			uint64_t seed;
+			int *parents = malloc(sizeof(int) * (header[1] > 0 ? header[1] : 1));
+			take(&cur, &seed, sizeof(uint64_t));
+			take(&cur, parents, sizeof(int) * header[1]);
+			generate_share(parents, header[1], seed, hpSize);
+			gather_results();
+			free(parents);
+		} else {
+			evaluate_share(cur, header[1], hpSize);
+		}
+	}
+}
+
+// Documented in header file
+void Replica_kill_slaves(){
+	int size = -1;
+	MPI_Bcast(&size, 1, MPI_INT, 0, REPLICA.comm);
+}
@@ -0,0 +1,60 @@
+#ifndef _REPLICA_H_
+#define _REPLICA_H_
+
+/** \file replica.h Evaluation of the solutions of a phase by MPI slaves that hold a replica of the hive.
+ *
+ * Each solution generated in a phase differs from the hive solution it came from (its parent) in a few
+ *   elements, usually one, yet the other protocols send its full movement chain to a slave.
+ * Here every slave keeps the solutions of its own hive (see hive.h) as a replica of the hive of the master.
+ *   For each phase, the master broadcasts the solutions of the hive that changed since the last phase (only
+ *   the elements that changed, and their fitness), followed by the work of the phase, of which each node
+ *   takes a contiguous share.
+ *
+ * With Replica_calculate_fitness(), the work is each solution of the phase, as the index of its parent and the
+ *   elements in which it differs from it. Solutions with no parent, or that differ in too many elements,
+ *   are sent whole. The fitnesses are gathered by the master.
+ *   Slaves evaluate a solution that differs from its parent in one element incrementally, against the
+ *   FitnessDelta of the parent in the replica (see HIVE_solution_delta()), so only the beads that moved are placed.
+ *
+ * With Replica_generate(), the master doesn't generate the solutions at all: the work is only the parent of each
+ *   solution, and a random seed for the phase. Each node generates the solutions of its share from the replica,
+ *   drawing the i-th solution from a generator seeded with the seed of the phase plus i (see random_use_seed()),
+ *   so solutions don't depend on which node generates them. Nodes send back the fitness and the kind of move
+ *   of each solution, and its elements only when it may replace its parent: when it is better than its parent,
+ *   or when it has no parent (it is a scout).
+ *
+ * All nodes of the hive communicator must have initialized a hive of the same size with HIVE_initialize(),
+ *   and the same seed library (see seeds.h).
+ */
+
+#include <mpi/mpi.h>
+#include <solution/solution.h>
+
+/** Prepares the node to take part in the replica protocol over 'comm', where node 0 is the master. */
+void Replica_initialize(int hpSize, MPI_Comm comm);
+
+/** Frees the memory used by the protocol. */
+void Replica_free();
+
+/** Calculates the fitness of the 'nSols' solutions in 'sols' with the help of the slaves.
+ * parents[i] is the index of the hive solution sols[i] was generated from, or -1 if it has none.
+ *   A NULL 'parents' means no solution has one.
+ * The hive must not change between the generation of 'sols' and this call.
+ */
+void Replica_calculate_fitness(Solution *sols, const int *parents, int nSols, int hpSize);
+
+/** Generates and evaluates 'nSols' solutions with the help of the slaves, and stores them in 'sols'.
+ * If parents[i] is an index of the hive, sols[i] is HIVE_perturb_solution(parents[i]). If it is -1,
+ *   sols[i] is Seeds_scout(). Solutions of the same parent must be next to each other.
+ * Each solution has its fitness and its kind of move set. A solution that is not better than its parent is blank
+ *   (see Solution_blank()), which is enough for HIVE_try_replace_solution() to reject it.
+ */
+void Replica_generate(const int *parents, int nSols, int hpSize, Solution *sols);
+
+/** Keeps the replica and evaluates or generates solutions for the master until it calls Replica_kill_slaves(). */
+void Replica_slave(int hpSize);
+
+/** Makes the slaves return from Replica_slave(). */
+void Replica_kill_slaves();
+
+#endif
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <movchain.h>
+#include <random.h>
+#include <config.h>
+
+#include "seeds.h"
+#include "growth.h"
+
+/** Library of chains, all with the size of the protein being predicted */
+static struct {
+	MovElem **chains;
+	int count;
+	int capacity;
+	int hpSize;
+} SEEDS;
+
+/* Appends 'chain' to the library, which takes ownership of it */
+static
+void append(MovElem *chain){
+	if(SEEDS.count == SEEDS.capacity){
+		SEEDS.capacity = SEEDS.capacity * 2 + 16;
+		SEEDS.chains = realloc(SEEDS.chains, sizeof(MovElem *) * SEEDS.capacity);
+	}
+	SEEDS.chains[SEEDS.count++] = chain;
+}
+
+// Documented in header file
+void Seeds_load(const char *path, int hpSize){
+	FILE *fp = fopen(path, "r");
+	if(!fp){
+		fprintf(stderr, "Could not open seed file '%s'.\n", path);
+		exit(EXIT_FAILURE);
+	}
+
+	int chainSize = hpSize - 1;
+	SEEDS.hpSize = hpSize;
+
+	char *line = NULL;
+	size_t lineSize = 0;
+	int lineNo = 0;
+
+	while(getline(&line, &lineSize, fp) != -1){
+		lineNo++;
+
+		char *start = line + strspn(line, " \t\r\n");
+		if(*start == '\0' || *start == '#') continue;
+
+		MovElem *read;
+		int readSize = MovChain_parse(start, &read);
+		if(readSize <= 0){
+			fprintf(stderr, "Skipping invalid chain in line %d of seed file '%s'.\n", lineNo, path);
+			if(readSize == 0) free(read);
+			continue;
+		}
+
+		// Truncate or pad with random movements
+		MovElem *chain = malloc(sizeof(MovElem) * chainSize);
+		int i;
+		for(i = 0; i < chainSize; i++)
+			chain[i] = i < readSize ? read[i] : MovElem_random();
+		free(read);
+
+		append(chain);
+	}
+
+	free(line);
+	fclose(fp);
+}
+
+// Documented in header file
+void Seeds_free(){
+	int i;
+	for(i = 0; i < SEEDS.count; i++)
+		free(SEEDS.chains[i]);
+	free(SEEDS.chains);
+
+	SEEDS.chains = NULL;
+	SEEDS.count = 0;
+	SEEDS.capacity = 0;
+}
+
+// Documented in header file
+void Seeds_add(const MovElem *chain, int hpSize){
+	MovElem *copy = malloc(sizeof(MovElem) * (hpSize - 1));
+	memcpy(copy, chain, sizeof(MovElem) * (hpSize - 1));
+	SEEDS.hpSize = hpSize;
+	append(copy);
+}
+
+// Documented in header file
+int Seeds_count(){
+	return SEEDS.count;
+}
+
+// Documented in header file
+Solution Seeds_solution(int idx){
+	return Solution_from_chain(SEEDS.chains[idx], SEEDS.hpSize);
+}
+
+// Documented in header file
+Solution Seeds_scout(int hpSize){
+	if(SEEDS.count > 0 && SEED_SCOUTS > 0 && drandom_x() < SEED_SCOUTS)
+		return Seeds_solution(urandom_max(SEEDS.count));
+	return Growth_solution(hpSize);
+}
@@ -0,0 +1,37 @@
+#ifndef _SEEDS_H_
+#define _SEEDS_H_
+
+/** \file seeds.h Routines for warm-starting hives from a library of known conformations.
+ *
+ * The library is a text file with one movement chain per line, as printed by MovChain_print().
+ * Empty lines and lines starting with '#' are ignored.
+ * Chains longer than the protein being predicted are truncated, and shorter ones are padded with random movements.
+ */
+
+#include <solution/solution.h>
+
+/** Loads the library in file 'path' for a protein with 'hpSize' beads.
+ * Its chains are added after any already in the library.
+ * Invalid lines are reported and skipped. If the file can't be opened, the program is terminated.
+ */
+void Seeds_load(const char *path, int hpSize);
+
+/** Adds a copy of 'chain', for a protein with 'hpSize' beads, to the end of the library. */
+void Seeds_add(const MovElem *chain, int hpSize);
+
+/** Frees the library. */
+void Seeds_free();
+
+/** Returns the number of chains in the library. */
+int Seeds_count();
+
+/** Returns a new Solution with the idx-th chain of the library, without its fitness calculated. */
+Solution Seeds_solution(int idx);
+
+/** Returns a new Solution for a scout bee.
+ * With probability SEED_SCOUTS (and a non-empty library), it holds a random chain of the library.
+ * Otherwise, it is a random Solution (see Growth_solution()).
+ */
+Solution Seeds_scout(int hpSize);
+
+#endif
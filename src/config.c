@@ -17,10 +17,56 @@ int COLONY_SIZE = 250;
 double FORAGER_RATIO = 0.5;
 int IDLE_LIMIT = 100;
 
+double TIME_BUDGET = 0;
+double TARGET_FITNESS = 0;
+int STAGNATION_LIMIT = 0;
+
 int N_HIVES = 1;
+int MIGRATION_TOPOLOGY = 0;
+int MIGRATION_INTERVAL = 0;
+int N_MIGRANTS = 2;
 
 int RANDOM_SEED = -1;
 
+int N_THREADS = 1;
+int STEADY_STATE = 0;
+int SPECULATIVE_ONLOOKERS = 0;
+
+int ARCHIVE_SIZE = 1;
+
+int CHECKPOINT_INTERVAL = 0;
+int CHECKPOINT_SIGNAL = 0;
+char *CHECKPOINT_FILE = (char *) "checkpoint.bin";
+int RESTART = 0;
+
+char *SEED_FILE = (char *) "none";
+double SEED_FRACTION = 0.5;
+double SEED_SCOUTS = 0;
+int LOCAL_SEARCH_INTERVAL = 0;
+int LOCAL_SEARCH_ARCHIVE = 0;
+int LOCAL_SEARCH_FIRST_IMPROVEMENT = 1;
+int LOCAL_SEARCH_PASSES = 0;
+double MOVE_WEIGHT_RELATIVE = 1;
+double MOVE_WEIGHT_SIDE_CHAIN = 0;
+double MOVE_WEIGHT_END = 0;
+double MOVE_WEIGHT_CRANKSHAFT = 0;
+double MOVE_WEIGHT_PULL = 0;
+int INIT_GROWTH = 0;
+int GROWTH_BACKTRACK = 1000;
+double GROWTH_BIAS = 0.5;
+int FEASIBLE_RETRIES = 0;
+int FITNESS_CACHE_SIZE = 0;
+int EXACT_MAX_SIZE = 0;
+int FRAGMENT_SIZE = 0;
+int FRAGMENT_OVERLAP = 10;
+int FRAGMENT_CYCLES = 200;
+int FRAGMENT_SEEDS = 10;
+int EVAL_PROTOCOL = 0;
+int EVAL_PIPELINE_DEPTH = 4;
+int EVAL_BATCH = 1;
+int EVAL_SHARED_MEMORY = 0;
+int EVAL_TREE_TOPOLOGY = 0;
+
 
 static const char filename[] = "configuration.yml";
 
@@ -41,10 +87,51 @@ void initialize_configuration(){
 	errSum += fscanf(fp, " COLONY_SIZE: %d", &COLONY_SIZE);
 	errSum += fscanf(fp, " FORAGER_RATIO: %lf", &FORAGER_RATIO);
 	errSum += fscanf(fp, " IDLE_LIMIT: %d", &IDLE_LIMIT);
+	errSum += fscanf(fp, " TIME_BUDGET: %lf", &TIME_BUDGET);
+	errSum += fscanf(fp, " TARGET_FITNESS: %lf", &TARGET_FITNESS);
+	errSum += fscanf(fp, " STAGNATION_LIMIT: %d", &STAGNATION_LIMIT);
 	errSum += fscanf(fp, " N_HIVES: %d", &N_HIVES);
+	errSum += fscanf(fp, " MIGRATION_TOPOLOGY: %d", &MIGRATION_TOPOLOGY);
+	errSum += fscanf(fp, " MIGRATION_INTERVAL: %d", &MIGRATION_INTERVAL);
+	errSum += fscanf(fp, " N_MIGRANTS: %d", &N_MIGRANTS);
 	errSum += fscanf(fp, " RANDOM_SEED: %d", &RANDOM_SEED);
+	errSum += fscanf(fp, " N_THREADS: %d", &N_THREADS);
+	errSum += fscanf(fp, " STEADY_STATE: %d", &STEADY_STATE);
+	errSum += fscanf(fp, " SPECULATIVE_ONLOOKERS: %d", &SPECULATIVE_ONLOOKERS);
+	errSum += fscanf(fp, " ARCHIVE_SIZE: %d", &ARCHIVE_SIZE);
+	errSum += fscanf(fp, " CHECKPOINT_INTERVAL: %d", &CHECKPOINT_INTERVAL);
+	errSum += fscanf(fp, " CHECKPOINT_SIGNAL: %d", &CHECKPOINT_SIGNAL);
+	errSum += fscanf(fp, " CHECKPOINT_FILE: %ms", &CHECKPOINT_FILE);
+	errSum += fscanf(fp, " RESTART: %d", &RESTART);
+	errSum += fscanf(fp, " SEED_FILE: %ms", &SEED_FILE);
+	errSum += fscanf(fp, " SEED_FRACTION: %lf", &SEED_FRACTION);
+	errSum += fscanf(fp, " SEED_SCOUTS: %lf", &SEED_SCOUTS);
+	errSum += fscanf(fp, " LOCAL_SEARCH_INTERVAL: %d", &LOCAL_SEARCH_INTERVAL);
+	errSum += fscanf(fp, " LOCAL_SEARCH_ARCHIVE: %d", &LOCAL_SEARCH_ARCHIVE);
+	errSum += fscanf(fp, " LOCAL_SEARCH_FIRST_IMPROVEMENT: %d", &LOCAL_SEARCH_FIRST_IMPROVEMENT);
+	errSum += fscanf(fp, " LOCAL_SEARCH_PASSES: %d", &LOCAL_SEARCH_PASSES);
+	errSum += fscanf(fp, " MOVE_WEIGHT_RELATIVE: %lf", &MOVE_WEIGHT_RELATIVE);
+	errSum += fscanf(fp, " MOVE_WEIGHT_SIDE_CHAIN: %lf", &MOVE_WEIGHT_SIDE_CHAIN);
+	errSum += fscanf(fp, " MOVE_WEIGHT_END: %lf", &MOVE_WEIGHT_END);
+	errSum += fscanf(fp, " MOVE_WEIGHT_CRANKSHAFT: %lf", &MOVE_WEIGHT_CRANKSHAFT);
+	errSum += fscanf(fp, " MOVE_WEIGHT_PULL: %lf", &MOVE_WEIGHT_PULL);
+	errSum += fscanf(fp, " INIT_GROWTH: %d", &INIT_GROWTH);
+	errSum += fscanf(fp, " GROWTH_BACKTRACK: %d", &GROWTH_BACKTRACK);
+	errSum += fscanf(fp, " GROWTH_BIAS: %lf", &GROWTH_BIAS);
+	errSum += fscanf(fp, " FEASIBLE_RETRIES: %d", &FEASIBLE_RETRIES);
+	errSum += fscanf(fp, " FITNESS_CACHE_SIZE: %d", &FITNESS_CACHE_SIZE);
+	errSum += fscanf(fp, " EXACT_MAX_SIZE: %d", &EXACT_MAX_SIZE);
+	errSum += fscanf(fp, " FRAGMENT_SIZE: %d", &FRAGMENT_SIZE);
+	errSum += fscanf(fp, " FRAGMENT_OVERLAP: %d", &FRAGMENT_OVERLAP);
+	errSum += fscanf(fp, " FRAGMENT_CYCLES: %d", &FRAGMENT_CYCLES);
+	errSum += fscanf(fp, " FRAGMENT_SEEDS: %d", &FRAGMENT_SEEDS);
+	errSum += fscanf(fp, " EVAL_PROTOCOL: %d", &EVAL_PROTOCOL);
+	errSum += fscanf(fp, " EVAL_PIPELINE_DEPTH: %d", &EVAL_PIPELINE_DEPTH);
+	errSum += fscanf(fp, " EVAL_BATCH: %d", &EVAL_BATCH);
+	errSum += fscanf(fp, " EVAL_SHARED_MEMORY: %d", &EVAL_SHARED_MEMORY);
+	errSum += fscanf(fp, " EVAL_TREE_TOPOLOGY: %d", &EVAL_TREE_TOPOLOGY);
 
-	if(errSum != 14){
+	if(errSum != 55){
 		fprintf(stderr, "Something went wrong while reading the configuration file '%s'.\n"
 				"Make the file is in the correct format.\n", filename);
 		exit(EXIT_FAILURE);
@@ -17,8 +17,49 @@ extern int N_CYCLES;
 extern int COLONY_SIZE;
 extern double FORAGER_RATIO;
 extern int IDLE_LIMIT;
+extern double TIME_BUDGET;
+extern double TARGET_FITNESS;
+extern int STAGNATION_LIMIT;
 extern int N_HIVES;
+extern int MIGRATION_TOPOLOGY;
+extern int MIGRATION_INTERVAL;
+extern int N_MIGRANTS;
 extern int RANDOM_SEED;
+extern int N_THREADS;
+extern int STEADY_STATE;
+extern int SPECULATIVE_ONLOOKERS;
+extern int ARCHIVE_SIZE;
+extern int CHECKPOINT_INTERVAL;
+extern int CHECKPOINT_SIGNAL;
+extern char *CHECKPOINT_FILE;
+extern int RESTART;
+extern char *SEED_FILE;
+extern double SEED_FRACTION;
+extern double SEED_SCOUTS;
+extern int LOCAL_SEARCH_INTERVAL;
+extern int LOCAL_SEARCH_ARCHIVE;
+extern int LOCAL_SEARCH_FIRST_IMPROVEMENT;
+extern int LOCAL_SEARCH_PASSES;
+extern double MOVE_WEIGHT_RELATIVE;
+extern double MOVE_WEIGHT_SIDE_CHAIN;
+extern double MOVE_WEIGHT_END;
+extern double MOVE_WEIGHT_CRANKSHAFT;
+extern double MOVE_WEIGHT_PULL;
+extern int INIT_GROWTH;
+extern int GROWTH_BACKTRACK;
+extern double GROWTH_BIAS;
+extern int FEASIBLE_RETRIES;
+extern int FITNESS_CACHE_SIZE;
+extern int EXACT_MAX_SIZE;
+extern int FRAGMENT_SIZE;
+extern int FRAGMENT_OVERLAP;
+extern int FRAGMENT_CYCLES;
+extern int FRAGMENT_SEEDS;
+extern int EVAL_PROTOCOL;
+extern int EVAL_PIPELINE_DEPTH;
+extern int EVAL_BATCH;
+extern int EVAL_SHARED_MEMORY;
+extern int EVAL_TREE_TOPOLOGY;
 /** @} */
 
 /** Initializes configuration based on the configuration file. */
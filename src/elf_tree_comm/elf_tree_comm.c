@@ -1,4 +1,6 @@
+#include "elf_tree_comm.h"
 
+#include <stdlib.h>
 #include <mpi/mpi.h>
 #include <stdio.h>
 
@@ -86,6 +88,254 @@ void ElfTreeComm_gather(void *buf, int sendCount, MPI_Datatype type, MPI_Comm co
 	}
 }
 
+/* Returns the lowest power of 2 higher than or equal to 'commSize' */
+static inline
+int tree_size(int commSize){
+	int hipow2 = 1;
+	while(hipow2 < commSize) hipow2 <<= 1;
+	return hipow2;
+}
+
+/* Returns the distance from node 'rank' to its parent in the tree, which is its lowest bit set,
+ *   or 'hipow2' for node 0, which has no parent
+ * The children of the node are at distances control / 2, control / 4, ... 1 after it, if they exist,
+ *   and the subtree of the node spans nodes 'rank' to 'rank' + control - 1
+ */
+static inline
+int tree_control(int rank, int hipow2){
+	return rank == 0 ? hipow2 : rank & -rank;
+}
+
+/* Returns the first node past the subtree of the node 'rank' + 'control' */
+static inline
+int tree_end(int rank, int control, int commSize){
+	int end = rank + control;
+	return end > commSize ? commSize : end;
+}
+
+/* Returns the number of elements of nodes 'first' to 'end' - 1, where node i has counts[i] times 'sendCount'
+ *   elements, or 'sendCount' elements if 'counts' is NULL
+ */
+static inline
+int tree_count(const int *counts, int sendCount, int first, int end){
+	if(!counts) return (end - first) * sendCount;
+
+	int i, total = 0;
+	for(i = first; i < end; i++)
+		total += counts[i];
+	return total * sendCount;
+}
+
+/* Scatter where node i gets counts[i] times 'sendCount' elements (see tree_count) */
+static
+void tree_scatter(void *buf, const int *counts, int sendCount, MPI_Datatype type, MPI_Comm comm){
+	int myRank, commSize;
+	MPI_Comm_rank(comm, &myRank);
+	MPI_Comm_size(comm, &commSize);
+
+	if(commSize == 1) return;
+
+	int typeSize;
+	MPI_Type_size(type, &typeSize);
+
+	int control = tree_control(myRank, tree_size(commSize));
+
+	if(myRank != 0){
+		int dataCount = tree_count(counts, sendCount, myRank, tree_end(myRank, control, commSize));
+		MPI_Recv(buf, dataCount, type, myRank - control, 0, comm, MPI_STATUS_IGNORE);
+	}
+
+	for(control /= 2; control >= 1; control /= 2){
+		int dest = myRank + control;
+		if(dest >= commSize) continue;
+
+		int offset = tree_count(counts, sendCount, myRank, dest);
+		int dataCount = tree_count(counts, sendCount, dest, tree_end(dest, control, commSize));
+		MPI_Send( ((char*) buf) + (size_t) offset * typeSize, dataCount, type, dest, 0, comm);
+	}
+}
+
+// Documented in header file
+void ElfTreeComm_scatterv(void *buf, const int *counts, MPI_Datatype type, MPI_Comm comm){
+	tree_scatter(buf, counts, 1, type, comm);
+}
+
+/* Posts the send of the pieces of the subtree of the node to its parent, if it has one */
+static
+void post_parent(ElfTreeComm_Request *req){
+	req->nRequests = 0;
+	if(req->myRank == 0) return;
+
+	int parent = req->myRank - req->control;
+	int dataCount = tree_count(req->counts, 1, req->myRank, tree_end(req->myRank, req->control, req->commSize));
+	MPI_Isend(req->buf, dataCount, req->type, parent, 0, req->comm, &req->requests[req->nRequests++]);
+}
+
+/* Posts the receives from all the children of the node at once, as each has its own piece of the buffer */
+static
+void post_children(ElfTreeComm_Request *req){
+	req->nRequests = 0;
+
+	int control;
+	for(control = req->control / 2; control >= 1; control /= 2){
+		int child = req->myRank + control;
+		if(child >= req->commSize) continue;
+
+		int offset = tree_count(req->counts, 1, req->myRank, child);
+		int dataCount = tree_count(req->counts, 1, child, tree_end(child, control, req->commSize));
+		char *data = req->buf + (size_t) offset * req->typeSize;
+		MPI_Irecv(data, dataCount, req->type, child, 0, req->comm, &req->requests[req->nRequests++]);
+	}
+}
+
+/* Starts the gather of 'req' over 'comm', where node i has counts[i] elements */
+static
+void start_request(void *buf, const int *counts, MPI_Datatype type, MPI_Comm comm, ElfTreeComm_Request *req){
+	req->buf = buf;
+	req->counts = counts;
+	req->type = type;
+	req->comm = comm;
+	req->stage = 0;
+	MPI_Comm_rank(comm, &req->myRank);
+	MPI_Comm_size(comm, &req->commSize);
+	MPI_Type_size(type, &req->typeSize);
+
+	req->control = tree_control(req->myRank, tree_size(req->commSize));
+
+	post_children(req);
+}
+
+/* Moves 'req' to its next stage, once the requests of the current one have completed
+ * Procedure idea:
+ *   The node receives from its children (stage 0) and then sends to its parent (stage 1)
+ *   When the gather is done and a second level follows, it starts over on 'nextComm'
+ */
+static
+void next_stage(ElfTreeComm_Request *req){
+	req->stage++;
+	if(req->stage == 1){
+		post_parent(req);
+	} else if(req->nextComm != MPI_COMM_NULL){
+		MPI_Comm next = req->nextComm;
+		req->nextComm = MPI_COMM_NULL;
+		start_request(req->buf, req->nextCounts, req->type, next, req);
+	} else {
+		req->nRequests = 0;
+	}
+}
+
+// Documented in header file
+void ElfTreeComm_igatherv(void *buf, const int *counts, MPI_Datatype type, MPI_Comm comm, ElfTreeComm_Request *req){
+	req->nextComm = MPI_COMM_NULL;
+	start_request(buf, counts, type, comm, req);
+}
+
+// Documented in header file
+bool ElfTreeComm_test(ElfTreeComm_Request *req){
+	while(req->stage < 2){
+		int done;
+		MPI_Testall(req->nRequests, req->requests, &done, MPI_STATUSES_IGNORE);
+		if(!done) return false;
+		next_stage(req);
+	}
+	return true;
+}
+
+// Documented in header file
+void ElfTreeComm_wait(ElfTreeComm_Request *req){
+	while(req->stage < 2){
+		MPI_Waitall(req->nRequests, req->requests, MPI_STATUSES_IGNORE);
+		next_stage(req);
+	}
+}
+
+// Documented in header file
+ElfTreeComm_Topology *ElfTreeComm_topology_create(MPI_Comm comm){
+	int i, myRank;
+	MPI_Comm_rank(comm, &myRank);
+
+	ElfTreeComm_Topology *topo = malloc(sizeof(ElfTreeComm_Topology));
+
+	// Processes of the same machine, in the order of 'comm', so node 0 is the first of its machine
+	MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, myRank, MPI_INFO_NULL, &topo->nodeComm);
+
+	int myLocalRank;
+	MPI_Comm_rank(topo->nodeComm, &myLocalRank);
+	MPI_Comm_split(comm, myLocalRank == 0 ? 0 : MPI_UNDEFINED, myRank, &topo->leaderComm);
+
+	// Leaders share the sizes of their machines, and pass them on to the rest of their machine
+	int machine = 0, nodeSize;
+	MPI_Comm_size(topo->nodeComm, &nodeSize);
+	if(myLocalRank == 0){
+		MPI_Comm_rank(topo->leaderComm, &machine);
+		MPI_Comm_size(topo->leaderComm, &topo->nMachines);
+	}
+	MPI_Bcast(&machine, 1, MPI_INT, 0, topo->nodeComm);
+	MPI_Bcast(&topo->nMachines, 1, MPI_INT, 0, topo->nodeComm);
+
+	topo->machineSizes = malloc(sizeof(int) * topo->nMachines);
+	if(myLocalRank == 0)
+		MPI_Allgather(&nodeSize, 1, MPI_INT, topo->machineSizes, 1, MPI_INT, topo->leaderComm);
+	MPI_Bcast(topo->machineSizes, topo->nMachines, MPI_INT, 0, topo->nodeComm);
+
+	// Machines one after the other, each with its processes in the order of 'nodeComm'
+	topo->first = 0;
+	for(i = 0; i < machine; i++)
+		topo->first += topo->machineSizes[i];
+	MPI_Comm_split(comm, 0, topo->first + myLocalRank, &topo->comm);
+
+	topo->machineCounts = malloc(sizeof(int) * topo->nMachines);
+
+	return topo;
+}
+
+// Documented in header file
+void ElfTreeComm_topology_free(ElfTreeComm_Topology *topo){
+	MPI_Comm_free(&topo->comm);
+	MPI_Comm_free(&topo->nodeComm);
+	if(topo->leaderComm != MPI_COMM_NULL)
+		MPI_Comm_free(&topo->leaderComm);
+	free(topo->machineSizes);
+	free(topo->machineCounts);
+	free(topo);
+}
+
+// Documented in header file
+void ElfTreeComm_topology_scatter(void *buf, int sendCount, MPI_Datatype type, const ElfTreeComm_Topology *topo){
+	if(topo->leaderComm != MPI_COMM_NULL)
+		tree_scatter(buf, topo->machineSizes, sendCount, type, topo->leaderComm);
+	tree_scatter(buf, NULL, sendCount, type, topo->nodeComm);
+}
+
+/* Fills 'machineCounts' with the elements of each machine of 'topo', where node i of topo->comm has counts[i] */
+static
+void machine_counts(const int *counts, const ElfTreeComm_Topology *topo, int *machineCounts){
+	int i, j, rank = 0;
+	for(i = 0; i < topo->nMachines; i++){
+		machineCounts[i] = 0;
+		for(j = 0; j < topo->machineSizes[i]; j++)
+			machineCounts[i] += counts[rank++];
+	}
+}
+
+// Documented in header file
+void ElfTreeComm_topology_scatterv(void *buf, const int *counts, MPI_Datatype type, const ElfTreeComm_Topology *topo){
+	if(topo->leaderComm != MPI_COMM_NULL){
+		int machineCounts[topo->nMachines];
+		machine_counts(counts, topo, machineCounts);
+		tree_scatter(buf, machineCounts, 1, type, topo->leaderComm);
+	}
+	tree_scatter(buf, counts + topo->first, 1, type, topo->nodeComm);
+}
+
+// Documented in header file
+void ElfTreeComm_topology_igatherv(void *buf, const int *counts, MPI_Datatype type, ElfTreeComm_Topology *topo,
+		ElfTreeComm_Request *req){
+	machine_counts(counts, topo, topo->machineCounts);
+	req->nextComm = topo->leaderComm;
+	req->nextCounts = topo->machineCounts;
+	start_request(buf, counts + topo->first, type, topo->nodeComm, req);
+}
 
 /* DEBUG PROCEDURES
 
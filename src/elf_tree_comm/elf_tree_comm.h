@@ -73,11 +73,104 @@
  * node 2 receives "dd" from node 3
  * node 0 receives "ccdd" from node 2
  *
+ *
+ * VARIABLE COUNTS
+ *
+ * ElfTreeComm_scatterv and ElfTreeComm_igatherv follow the same pattern, but node i gets or gives counts[i]
+ *   elements, which may be 0, so a short last round of work needs no padding.
+ * Each node passes the same 'counts', with an entry for every node, as each node must know how much of its
+ *   buffer goes to each of the nodes below it in the tree.
+ *   The piece of node i starts at counts[0] + ... + counts[i-1] in the buffer of node 0.
+ *
+ *
+ * NON-BLOCKING VARIANTS
+ *
+ * ElfTreeComm_igatherv starts the gather and returns right away.
+ *   The gather advances only when the request is tested (ElfTreeComm_test) or waited (ElfTreeComm_wait),
+ *   as a node must have received from the nodes below it before it passes their pieces on.
+ * A node may compute its own piece meanwhile, as nodes below it only write past it. It must be in place
+ *   before the request is tested or waited.
+ *
+ *
+ * TWO-LEVEL TREE
+ *
+ * The tree above is built on the ranks alone, so many of its edges may cross the network even when both
+ *   processes run in the same machine.
+ * ElfTreeComm_topology_create() groups the processes of a communicator by machine. A topology scatter first
+ *   goes over a tree of the first process of each machine (its leader), each getting the pieces of its whole
+ *   machine, and then over a tree within each machine. A topology gather goes the other way.
+ *   So each machine gets a single message from the network in a scatter, and sends a single one in a gather.
+ * Its buffers follow the ranks of topo->comm, in which the processes of each machine are next to each other
+ *   and node 0 is node 0 of the original communicator.
  */
 
+#include <stdbool.h>
 #include <mpi/mpi.h>
 
+/** Maximum number of point-to-point requests a node has in flight in a tree gather */
+#define ELF_TREE_MAX_REQUESTS 32
+
+/** State of a non-blocking tree gather. */
+typedef struct {
+	char *buf;
+	const int *counts; /**< Node i has counts[i] elements */
+	MPI_Datatype type;
+	MPI_Comm comm;
+	int myRank;
+	int commSize;
+	int control;   /**< Distance to the parent of the node in the tree (power of 2) */
+	int typeSize;
+	int stage;     /**< 0: waiting for the children, 1: for the parent, 2: done */
+	int nRequests; /**< Number of 'requests' of the stage */
+	MPI_Request requests[ELF_TREE_MAX_REQUESTS];
+	MPI_Comm nextComm;     /**< If not MPI_COMM_NULL, the gather goes on over this communicator once done */
+	const int *nextCounts; /**< 'counts' over 'nextComm' */
+} ElfTreeComm_Request;
+
+/** Processes of a communicator grouped by machine, for the two-level tree. */
+typedef struct {
+	MPI_Comm comm;       /**< The communicator reordered so the processes of each machine are next to each other */
+	MPI_Comm nodeComm;   /**< Processes in the machine of this one */
+	MPI_Comm leaderComm; /**< The first process of each machine, or MPI_COMM_NULL if this one is not the first */
+	int nMachines;
+	int *machineSizes;   /**< Number of processes of each machine, in the order of 'leaderComm' */
+	int first;           /**< Rank in 'comm' of the first process of the machine of this one */
+	int *machineCounts;  /**< Elements of each machine in the current variable-count gather */
+} ElfTreeComm_Topology;
+
 void ElfTreeComm_scatter(void *buf, int sendCount, MPI_Datatype type, MPI_Comm comm);
 void ElfTreeComm_gather(void *buf, int sendCount, MPI_Datatype type, MPI_Comm comm);
 
+/** As ElfTreeComm_scatter, with counts[i] elements for node i. */
+void ElfTreeComm_scatterv(void *buf, const int *counts, MPI_Datatype type, MPI_Comm comm);
+
+/** Starts ElfTreeComm_gather with counts[i] elements from node i, which is done once 'req' completes.
+ * 'counts' must be kept until then.
+ */
+void ElfTreeComm_igatherv(void *buf, const int *counts, MPI_Datatype type, MPI_Comm comm, ElfTreeComm_Request *req);
+
+/** Advances the gather of 'req' as far as it can without waiting, and returns whether it is complete. */
+bool ElfTreeComm_test(ElfTreeComm_Request *req);
+
+/** Waits until the gather of 'req' completes. */
+void ElfTreeComm_wait(ElfTreeComm_Request *req);
+
+/** Groups the processes of 'comm' by machine. Must be called by all of them. */
+ElfTreeComm_Topology *ElfTreeComm_topology_create(MPI_Comm comm);
+
+/** Frees 'topo' and its communicators. */
+void ElfTreeComm_topology_free(ElfTreeComm_Topology *topo);
+
+/** As ElfTreeComm_scatter over topo->comm, with the two-level tree. */
+void ElfTreeComm_topology_scatter(void *buf, int sendCount, MPI_Datatype type, const ElfTreeComm_Topology *topo);
+
+/** As ElfTreeComm_scatterv over topo->comm, with the two-level tree. */
+void ElfTreeComm_topology_scatterv(void *buf, const int *counts, MPI_Datatype type, const ElfTreeComm_Topology *topo);
+
+/** As ElfTreeComm_igatherv over topo->comm, with the two-level tree.
+ * Only one such gather may be in progress over 'topo' at once.
+ */
+void ElfTreeComm_topology_igatherv(void *buf, const int *counts, MPI_Datatype type, ElfTreeComm_Topology *topo,
+		ElfTreeComm_Request *req);
+
 #endif
@@ -1,16 +1,43 @@
 #include "fitness_private.h"
 #include "fitness.h"
 #include "gyration.h"
+#include "fitness_cache.h"
+
+/* Protein of the calling thread, if set by FitnessCalc_use_protein() */
+static _Thread_local struct {
+	const HPElem * hpChain;
+	int hpSize;
+	double maxGyration;
+} THREAD_PROTEIN = { NULL, 0, 0 };
+
+void FitnessCalc_use_protein(const HPElem * hpChain, int hpSize){
+	THREAD_PROTEIN.hpChain = hpChain;
+	THREAD_PROTEIN.hpSize = hpSize;
+	THREAD_PROTEIN.maxGyration = hpChain ? calc_max_gyration(hpChain, hpSize) : 0;
+}
+
+FitnessCalc FitnessCalc_thread(FitnessCalc registered){
+	if(THREAD_PROTEIN.hpChain){
+		registered.hpChain = THREAD_PROTEIN.hpChain;
+		registered.hpSize = THREAD_PROTEIN.hpSize;
+		registered.maxGyration = THREAD_PROTEIN.maxGyration;
+	}
+	return registered;
+}
 
 double FitnessCalc_run(const int3d *coordsBB, const int3d *coordsSC){
+	FitnessCalc fitCalc = FitnessCalc_get();
+	BeadMeasures measures = proteinMeasures(coordsBB, coordsSC, fitCalc.hpChain, fitCalc.hpSize);
+	return measuresFitness(measures, coordsSC);
+}
+
+double measuresFitness(BeadMeasures measures, const int3d *coordsSC){
 	int i;
 	FitnessCalc fitCalc = FitnessCalc_get();
 
 	// H is the energy related to different kinds of contacts among side-chain and backbone beads.
 	double H = 0; // Free energy of the protein
 
-	BeadMeasures measures = proteinMeasures(coordsBB, coordsSC, fitCalc.hpChain, fitCalc.hpSize);
-
 	// Keep summing on energy
 	H += EPS_HH * measures.hh;
 	H += EPS_PP * measures.pp;
@@ -21,32 +48,13 @@ double FitnessCalc_run(const int3d *coordsBB, const int3d *coordsSC){
 
 	double penalty = PENALTY_VALUE * measures.collisions;
 
-// Then we calculate the mass center for H beads and P beads (we'll need for gyration)
-// Sum all coordinates for P and H beads
-	int3d sumP = int3d_make(0, 0, 0);
-	int3d sumH = int3d_make(0, 0, 0);
-	int countP = 0;
-	int countH = 0;
-	for(i = 0; i < fitCalc.hpSize; i++){
-		if(fitCalc.hpChain[i] == 'H'){
-			sumH = int3d_add(sumH, coordsSC[i]);
-			countH ++;
-		} else /* bead is Polar */ {
-			sumP = int3d_add(sumP, coordsSC[i]);
-			countP ++;
-		}
-	}
-
-// Get mass centers for H and P
-	DPoint centerH = { sumH.x / (double) countH,
-					   sumH.y / (double) countH,
-					   sumH.z / (double) countH };
-	DPoint centerP = { sumP.x / (double) countP,
-					   sumP.y / (double) countP,
-					   sumP.z / (double) countP };
-
 // Calculate the gyration for both bead types
-	DPair RG_HP = calc_gyration_joint(coordsSC, fitCalc.hpChain, fitCalc.hpSize, centerH, centerP);
+	DPair RG_HP = calc_gyration_joint(coordsSC, fitCalc.hpChain, fitCalc.hpSize);
+
+	int countP = 0;
+	for(i = 0; i < fitCalc.hpSize; i++)
+		if(fitCalc.hpChain[i] != 'H')
+			countP++;
 
 // Calculate max gyration of H beads
 	double maxRG_H = fitCalc.maxGyration;
@@ -65,12 +73,11 @@ double FitnessCalc_run(const int3d *coordsBB, const int3d *coordsSC){
 	return (H - penalty) * radiusG_H * radiusG_P;
 }
 
-double FitnessCalc_run2(const MovElem * chain){
+/* Returns the fitness of 'chain', with 'chainSize' elements, calculated from its beads */
+static
+double chain_fitness(const MovElem * chain, int chainSize){
 	int3d *coordsBB, *coordsSC;
 
-	FitnessCalc fitCalc = FitnessCalc_get();
-	int chainSize = fitCalc.hpSize - 1;
-
 	MovChain_build_3d(chain, chainSize, &coordsBB, &coordsSC);
 	double fit = FitnessCalc_run(coordsBB, coordsSC);
 	free(coordsBB);
@@ -78,6 +85,32 @@ double FitnessCalc_run2(const MovElem * chain){
 	return fit;
 }
 
+double FitnessCalc_run2(const MovElem * chain){
+	FitnessCalc fitCalc = FitnessCalc_get();
+	int chainSize = fitCalc.hpSize - 1;
+
+	// The cache only holds chains of the registered protein
+	if(!FitnessCache_enabled() || THREAD_PROTEIN.hpChain)
+		return chain_fitness(chain, chainSize);
+
+	// Symmetric copies share the canonical form, which is what gets evaluated and cached
+	MovElem canon[chainSize];
+	MovChain_canonical(chain, chainSize, canon);
+	uint64_t hash = MovChain_hash(canon, chainSize);
+
+	double fit;
+	if(!FitnessCache_lookup(canon, hash, &fit)){
+		fit = chain_fitness(canon, chainSize);
+		FitnessCache_store(canon, hash, fit);
+	}
+
+	return fit;
+}
+
+double FitnessCalc_max_gyration(){
+	return FitnessCalc_get().maxGyration;
+}
+
 void FitnessCalc_measures(const MovElem *chain, int *Hcontacts_p, int *collisions_p, double *bbGyration_p){
 	int3d *coordsBB, *coordsSC;
 
@@ -97,20 +130,7 @@ void FitnessCalc_measures(const MovElem *chain, int *Hcontacts_p, int *collision
 	}
 
 	if(bbGyration_p){
-		int3d sum = int3d_make(0, 0, 0);
-		int i;
-
-		// Sum coordinates
-		for(i = 0; i < fitCalc.hpSize; i++){
-			sum = int3d_add(sum, coordsBB[i]);
-		}
-
-		// Get center
-		DPoint center = {  sum.x / (double) fitCalc.hpSize,
-						   sum.y / (double) fitCalc.hpSize,
-						   sum.z / (double) fitCalc.hpSize };
-
-		*bbGyration_p = calc_gyration(coordsBB, fitCalc.hpSize, center);
+		*bbGyration_p = calc_gyration(coordsBB, fitCalc.hpSize);
 	}
 
 	free(coordsBB);
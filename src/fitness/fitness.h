@@ -18,6 +18,13 @@ void FitnessCalc_initialize(const HPElem * hpChain, int hpSize);
 void FitnessCalc_cleanup();
 
 
+/* Makes the calling thread calculate fitnesses for the protein 'hpChain', with 'hpSize' beads, instead of
+ *   the one registered with FitnessCalc_initialize, which must have at least as many beads.
+ * With a NULL 'hpChain', the thread goes back to the registered protein.
+ * Threads started by the calling thread aren't affected, and the fitness cache isn't used by the thread.
+ */
+void FitnessCalc_use_protein(const HPElem * hpChain, int hpSize);
+
 /* Returns the fitness for a protein already registered with FitnessCalc_initialize,
  *   considering that the protein has its 3d coordinates in coordsBB and coordsSC.
  */
@@ -25,9 +32,16 @@ double FitnessCalc_run(const int3d *coordsBB, const int3d *coordsSC);
 
 /* Returns the fitness for a protein already registered with FitnessCalc_initialize,
  *   considering that the protein has movement chain 'chain'.
+ * If there is a fitness cache (see fitness_cache.h), it is used, and symmetric copies of a chain all get
+ *   the fitness of their canonical form.
  */
 double FitnessCalc_run2(const MovElem * chain);
 
+/* Returns maxRG_H, the gyration radius of the H beads of the protein registered with FitnessCalc_initialize
+ *   when completely unfolded. The fitness is proportional to maxRG_H minus their actual gyration radius.
+ */
+double FitnessCalc_max_gyration();
+
 /* Returns measures for a given movement chain.
  * chain    - the movement chain from which to extract measures
  *
@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include <config.h>
+
+#include "fitness_cache.h"
+
+/** Number of locks, each guarding the slots whose index is congruent to it */
+#define N_LOCKS 64
+
+static struct {
+	MovElem *chains;   /**< Canonical chain in each slot, one after the other */
+	uint64_t *hashes;  /**< Hash of the chain in each slot */
+	double *fitness;   /**< Fitness of the chain in each slot */
+	bool *used;        /**< Whether each slot holds a chain */
+	int nSlots;
+	int chainSize;
+	pthread_mutex_t locks[N_LOCKS];
+	atomic_long lookups, hits;
+} CACHE = { .nSlots = 0 };
+
+// Documented in header file
+void FitnessCache_initialize(int hpSize){
+	int i;
+
+	CACHE.nSlots = FITNESS_CACHE_SIZE;
+	CACHE.chainSize = hpSize - 1;
+	atomic_init(&CACHE.lookups, 0);
+	atomic_init(&CACHE.hits, 0);
+	if(CACHE.nSlots <= 0)
+		return;
+
+	CACHE.chains = malloc(sizeof(MovElem) * CACHE.chainSize * (size_t) CACHE.nSlots);
+	CACHE.hashes = malloc(sizeof(uint64_t) * CACHE.nSlots);
+	CACHE.fitness = malloc(sizeof(double) * CACHE.nSlots);
+	CACHE.used = calloc(CACHE.nSlots, sizeof(bool));
+	for(i = 0; i < N_LOCKS; i++)
+		pthread_mutex_init(&CACHE.locks[i], NULL);
+}
+
+// Documented in header file
+void FitnessCache_cleanup(){
+	int i;
+
+	if(CACHE.nSlots <= 0)
+		return;
+
+	free(CACHE.chains);
+	free(CACHE.hashes);
+	free(CACHE.fitness);
+	free(CACHE.used);
+	for(i = 0; i < N_LOCKS; i++)
+		pthread_mutex_destroy(&CACHE.locks[i]);
+	CACHE.nSlots = 0;
+}
+
+// Documented in header file
+bool FitnessCache_enabled(){
+	return CACHE.nSlots > 0;
+}
+
+// Documented in header file
+bool FitnessCache_lookup(const MovElem *canon, uint64_t hash, double *fitness){
+	int slot = hash % CACHE.nSlots;
+	bool found;
+
+	pthread_mutex_lock(&CACHE.locks[slot % N_LOCKS]);
+	found = CACHE.used[slot] && CACHE.hashes[slot] == hash
+	     && memcmp(CACHE.chains + slot * (size_t) CACHE.chainSize, canon, sizeof(MovElem) * CACHE.chainSize) == 0;
+	if(found)
+		*fitness = CACHE.fitness[slot];
+	pthread_mutex_unlock(&CACHE.locks[slot % N_LOCKS]);
+
+	atomic_fetch_add_explicit(&CACHE.lookups, 1, memory_order_relaxed);
+	if(found)
+		atomic_fetch_add_explicit(&CACHE.hits, 1, memory_order_relaxed);
+
+	return found;
+}
+
+// Documented in header file
+void FitnessCache_store(const MovElem *canon, uint64_t hash, double fitness){
+	int slot = hash % CACHE.nSlots;
+
+	pthread_mutex_lock(&CACHE.locks[slot % N_LOCKS]);
+	memcpy(CACHE.chains + slot * (size_t) CACHE.chainSize, canon, sizeof(MovElem) * CACHE.chainSize);
+	CACHE.hashes[slot] = hash;
+	CACHE.fitness[slot] = fitness;
+	CACHE.used[slot] = true;
+	pthread_mutex_unlock(&CACHE.locks[slot % N_LOCKS]);
+}
+
+// Documented in header file
+void FitnessCache_stats(long *lookups, long *hits){
+	*lookups = atomic_load(&CACHE.lookups);
+	*hits = atomic_load(&CACHE.hits);
+}
@@ -0,0 +1,39 @@
+#ifndef _FITNESS_CACHE_H_
+#define _FITNESS_CACHE_H_
+
+/** \file fitness_cache.h Cache of the fitness of recently evaluated movement chains.
+ *
+ * Chains are kept in their canonical form (see MovChain_canonical()), so a rotated or mirrored copy of a
+ *   conformation already evaluated is found in the cache as well.
+ * The cache is direct-mapped: each chain can only be in the slot given by its hash, replacing whatever was there.
+ * All functions can be called in parallel among threads.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <movchain.h>
+
+/** Creates the cache, with FITNESS_CACHE_SIZE slots, for chains of proteins with 'hpSize' beads.
+ * If FITNESS_CACHE_SIZE is 0, there is no cache.
+ */
+void FitnessCache_initialize(int hpSize);
+
+/** Frees the cache. */
+void FitnessCache_cleanup();
+
+/** Whether there is a cache. */
+bool FitnessCache_enabled();
+
+/** Looks up the canonical chain 'canon', whose hash is 'hash' (see MovChain_hash()).
+ * If it is in the cache, stores its fitness in 'fitness' and returns true.
+ * Must only be called if FitnessCache_enabled(), as must FitnessCache_store().
+ */
+bool FitnessCache_lookup(const MovElem *canon, uint64_t hash, double *fitness);
+
+/** Stores the fitness of the canonical chain 'canon', whose hash is 'hash'. */
+void FitnessCache_store(const MovElem *canon, uint64_t hash, double fitness);
+
+/** Stores in 'lookups' and 'hits' how many lookups were done since FitnessCache_initialize(), and how many succeeded. */
+void FitnessCache_stats(long *lookups, long *hits);
+
+#endif
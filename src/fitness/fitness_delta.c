@@ -0,0 +1,506 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include <int3d.h>
+#include <hpchain.h>
+#include <movchain.h>
+
+#include "fitness_private.h"
+#include "fitness_delta.h"
+
+/** Kinds of beads, for counting contacts */
+enum BeadType { TYPE_BB = 0, TYPE_H = 1, TYPE_P = 2, N_TYPES = 3 };
+
+/** Layers of a Lattice */
+enum LatticeLayer { LAYER_FIXED = 0, LAYER_MOVED = 1, N_LAYERS = 2 };
+
+/** Sparse 3D lattice holding how many beads of each kind are in each point, in two layers:
+ *   the beads that stay fixed while a change is tried, and the beads moved by the change being tried.
+ * It is an open addressing hash table with linear probing. A layer of a slot is empty unless its stamp matches
+ *   the stamp of the layer, so each layer is emptied in constant time.
+ *
+ * Probe sequences stay valid because the fixed layer only grows while the moved layer is empty:
+ *   the slots between the home of a fixed point and its slot are always fixed too.
+ */
+typedef struct {
+	uint64_t *keys;                    /**< Packed coordinates of each slot */
+	unsigned int (*stamps)[N_LAYERS];  /**< Stamp of each layer of each slot */
+	short (*counts)[N_LAYERS][N_TYPES]; /**< Number of beads of each kind in each layer of each slot (negative
+	                                         in the moved layer where fixed beads were taken away) */
+	unsigned int stamp[N_LAYERS];      /**< Stamp of the slots in use in each layer */
+	unsigned int mask;                 /**< Number of slots minus 1 (a power of 2) */
+	int shift;                         /**< 64 minus log2 of the number of slots */
+} Lattice;
+
+/** Contacts and collisions among a set of beads, before linearization. */
+typedef struct {
+	int pairs[N_TYPES][N_TYPES]; /**< pairs[a][b] counts contacts where a bead of kind 'a' met one of kind 'b' placed before it */
+	int collisions;              /**< Pairs of beads in the same point */
+} Tally;
+
+struct FitnessDelta_ {
+	MovElem *chain;       /**< Current chain */
+	int chainSize;        /**< Number of elements in 'chain' */
+	int hpSize;           /**< Number of beads of each kind (BB and SC) */
+	const HPElem *hpChain;
+	int countH, countP;   /**< Number of H and P side chain beads */
+
+	int3d *coordsBB, *coordsSC; /**< Beads of the current chain */
+	int3d *candBB, *candSC;     /**< Beads of the chain being tried */
+	double fitness;             /**< Fitness of the current chain */
+	int collisions;             /**< Pairs of colliding beads in the current chain */
+	int candCollisions;         /**< Pairs of colliding beads in the last chain evaluated */
+
+	Lattice lattice;      /**< Beads placed by the elements before 'fixedIdx' (fixed layer) and from
+	                           the element being tried onwards (moved layer) */
+	Tally fixedTally;     /**< Contacts and collisions among the fixed beads */
+	int fixedIdx;         /**< Element whose prefix is in the fixed layer, or -1 if none */
+};
+
+/******************************************/
+/****** LATTICE PROCEDURES         ********/
+/******************************************/
+
+#define KEY_SHIFT_X 42
+#define KEY_SHIFT_Y 21
+
+/* Packs coordinates into a key. Coordinates never get farther than the protein size from the origin */
+static inline
+uint64_t lattice_key(int3d p){
+	const int64_t OFFSET = 1 << 20;
+	return ((uint64_t) (p.x + OFFSET) << KEY_SHIFT_X) | ((uint64_t) (p.y + OFFSET) << KEY_SHIFT_Y) | (uint64_t) (p.z + OFFSET);
+}
+
+/* Differences between the key of a point and the keys of its 6 neighbors */
+static const uint64_t NEIGHBOR_KEYS[6] = {
+	 (1ULL << KEY_SHIFT_X), -(1ULL << KEY_SHIFT_X),
+	 (1ULL << KEY_SHIFT_Y), -(1ULL << KEY_SHIFT_Y),
+	  1ULL,                 -1ULL,
+};
+
+static
+void lattice_init(Lattice *lat, int nBeads){
+	unsigned int size = 16;
+	int shift = 60;
+	while(size < 8 * (unsigned int) nBeads){
+		size *= 2;
+		shift--;
+	}
+
+	lat->keys = malloc(sizeof(uint64_t) * size);
+	lat->stamps = calloc(size, sizeof(*lat->stamps));
+	lat->counts = malloc(sizeof(*lat->counts) * size);
+	lat->stamp[LAYER_FIXED] = lat->stamp[LAYER_MOVED] = 1;
+	lat->mask = size - 1;
+	lat->shift = shift;
+}
+
+static
+void lattice_free(Lattice *lat){
+	free(lat->keys);
+	free(lat->stamps);
+	free(lat->counts);
+}
+
+static
+void lattice_clear(Lattice *lat, int layer){
+	lat->stamp[layer]++;
+	if(lat->stamp[layer] == 0){ // Wrapped around, so old stamps could be taken as current
+		unsigned int i;
+		for(i = 0; i <= lat->mask; i++)
+			lat->stamps[i][layer] = 0;
+		lat->stamp[layer] = 1;
+	}
+}
+
+/* Returns whether some layer of 'slot' is in use */
+static inline
+bool lattice_used(const Lattice *lat, unsigned int slot){
+	return lat->stamps[slot][LAYER_FIXED] == lat->stamp[LAYER_FIXED]
+	    || lat->stamps[slot][LAYER_MOVED] == lat->stamp[LAYER_MOVED];
+}
+
+/* Returns the slot of point 'key', which is unused if the point holds no beads */
+static inline
+unsigned int lattice_slot(const Lattice *lat, uint64_t key){
+	unsigned int slot = (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> lat->shift); // Fibonacci hashing
+	while(lattice_used(lat, slot) && lat->keys[slot] != key)
+		slot = (slot + 1) & lat->mask;
+	return slot;
+}
+
+/* Adds to 'sum' the number of beads of each kind in point 'key', over both layers. Returns the total. */
+static inline
+int lattice_count(const Lattice *lat, uint64_t key, int sum[N_TYPES]){
+	unsigned int slot = lattice_slot(lat, key);
+	int layer, u, total = 0;
+
+	for(layer = 0; layer < N_LAYERS; layer++){
+		if(lat->stamps[slot][layer] != lat->stamp[layer]) continue;
+		for(u = 0; u < N_TYPES; u++){
+			sum[u] += lat->counts[slot][layer][u];
+			total += lat->counts[slot][layer][u];
+		}
+	}
+
+	return total;
+}
+
+static inline
+void lattice_add(Lattice *lat, uint64_t key, int layer, int type, int delta){
+	unsigned int slot = lattice_slot(lat, key);
+	if(lat->stamps[slot][layer] != lat->stamp[layer]){
+		lat->stamps[slot][layer] = lat->stamp[layer];
+		lat->keys[slot] = key;
+		memset(lat->counts[slot][layer], 0, sizeof(lat->counts[slot][layer]));
+	}
+	lat->counts[slot][layer][type] += delta;
+}
+
+/******************************************/
+/****** FITNESS DELTA PROCEDURES   ********/
+/******************************************/
+
+static inline
+int sc_type(FitnessDelta fd, int idx){
+	return fd->hpChain[idx] == 'H' ? TYPE_H : TYPE_P;
+}
+
+/* Counts the contacts and collisions of a bead of kind 'type' at 'bead' with all beads in the lattice,
+ *   then adds it to 'layer'.
+ */
+static
+void place_bead(FitnessDelta fd, Tally *tally, int layer, int3d bead, int type){
+	uint64_t key = lattice_key(bead);
+	int near[N_TYPES] = { 0, 0, 0 };
+	int here[N_TYPES] = { 0, 0, 0 };
+	int i, u;
+
+	tally->collisions += lattice_count(&fd->lattice, key, here);
+
+	for(i = 0; i < 6; i++)
+		lattice_count(&fd->lattice, key + NEIGHBOR_KEYS[i], near);
+	for(u = 0; u < N_TYPES; u++)
+		tally->pairs[type][u] += near[u];
+
+	lattice_add(&fd->lattice, key, layer, type, 1);
+}
+
+/* Takes away a bead of kind 'type' at 'bead' from the lattice, through the moved layer,
+ *   and discounts its contacts and collisions with the beads left.
+ */
+static
+void remove_bead(FitnessDelta fd, Tally *tally, int3d bead, int type){
+	uint64_t key = lattice_key(bead);
+	int near[N_TYPES] = { 0, 0, 0 };
+	int here[N_TYPES] = { 0, 0, 0 };
+	int i, u;
+
+	lattice_add(&fd->lattice, key, LAYER_MOVED, type, -1);
+
+	tally->collisions -= lattice_count(&fd->lattice, key, here);
+
+	for(i = 0; i < 6; i++)
+		lattice_count(&fd->lattice, key + NEIGHBOR_KEYS[i], near);
+	for(u = 0; u < N_TYPES; u++)
+		tally->pairs[type][u] -= near[u];
+}
+
+/* Makes the fixed layer hold the beads placed by the elements before 'eleIdx' of the current chain, and empties the moved layer.
+ * The beads placed before element 0 are backbone beads 0 and 1; element 0 places side chain beads 0 and 1;
+ *   any other element E places backbone and side chain beads E+1.
+ */
+static
+void set_fixed(FitnessDelta fd, int eleIdx){
+	lattice_clear(&fd->lattice, LAYER_MOVED);
+
+	if(fd->fixedIdx < 0 || fd->fixedIdx > eleIdx){
+		lattice_clear(&fd->lattice, LAYER_FIXED);
+		memset(&fd->fixedTally, 0, sizeof(Tally));
+		place_bead(fd, &fd->fixedTally, LAYER_FIXED, fd->coordsBB[0], TYPE_BB);
+		place_bead(fd, &fd->fixedTally, LAYER_FIXED, fd->coordsBB[1], TYPE_BB);
+		fd->fixedIdx = 0;
+	}
+
+	for(; fd->fixedIdx < eleIdx; fd->fixedIdx++){
+		int idx = fd->fixedIdx;
+		if(idx == 0){
+			place_bead(fd, &fd->fixedTally, LAYER_FIXED, fd->coordsSC[0], sc_type(fd, 0));
+			place_bead(fd, &fd->fixedTally, LAYER_FIXED, fd->coordsSC[1], sc_type(fd, 1));
+		} else {
+			place_bead(fd, &fd->fixedTally, LAYER_FIXED, fd->coordsBB[idx+1], TYPE_BB);
+			place_bead(fd, &fd->fixedTally, LAYER_FIXED, fd->coordsSC[idx+1], sc_type(fd, idx+1));
+		}
+	}
+}
+
+/* Returns the fitness of the side chain beads in 'candSC', whose contacts and collisions are in 'tally'.
+ * The counts are linearized exactly as proteinMeasures() does.
+ */
+static
+double tally_fitness(FitnessDelta fd, const Tally *tally){
+	const int (*p)[N_TYPES] = tally->pairs;
+	BeadMeasures measures;
+
+	measures.hh = p[TYPE_H][TYPE_H];
+	measures.pp = p[TYPE_P][TYPE_P];
+	measures.hp = p[TYPE_H][TYPE_P] + p[TYPE_P][TYPE_H];
+	measures.bb = p[TYPE_BB][TYPE_BB];
+	measures.hb = p[TYPE_BB][TYPE_H] + p[TYPE_H][TYPE_BB];
+	measures.pb = p[TYPE_BB][TYPE_P] + p[TYPE_P][TYPE_BB];
+	measures.collisions = tally->collisions;
+
+	// Remove the trivial contacts
+	measures.bb -= (fd->hpSize - 1);
+	measures.hb -= fd->countH;
+	measures.pb -= fd->countP;
+
+	// Linearize amount of collisions and contacts
+	measures.hh = sqrt(measures.hh);
+	measures.pp = sqrt(measures.pp);
+	measures.hp = sqrt(measures.hp);
+	measures.bb = sqrt(measures.bb);
+	measures.hb = sqrt(measures.hb);
+	measures.pb = sqrt(measures.pb);
+	measures.collisions = sqrt(measures.collisions);
+
+	return measuresFitness(measures, fd->candSC);
+}
+
+/* Returns the fitness of the fixed beads along with the beads in 'candBB' and 'candSC'
+ *   placed by elements 'eleIdx' onwards.
+ *
+ * Procedure idea:
+ *   The contacts among the fixed beads are already counted, so we start from them and place each
+ *     moved bead, counting its contacts with the fixed beads and with the moved beads placed before it.
+ *   The counts are then linearized exactly as proteinMeasures() does.
+ */
+static
+double evaluate(FitnessDelta fd, int eleIdx){
+	Tally tally = fd->fixedTally;
+	int i;
+
+	if(eleIdx == 0){
+		place_bead(fd, &tally, LAYER_MOVED, fd->candSC[0], sc_type(fd, 0));
+		place_bead(fd, &tally, LAYER_MOVED, fd->candSC[1], sc_type(fd, 1));
+		i = 2;
+	} else {
+		i = eleIdx + 1;
+	}
+
+	for(; i < fd->hpSize; i++){
+		place_bead(fd, &tally, LAYER_MOVED, fd->candBB[i], TYPE_BB);
+		place_bead(fd, &tally, LAYER_MOVED, fd->candSC[i], sc_type(fd, i));
+	}
+
+	fd->candCollisions = tally.collisions;
+	return tally_fitness(fd, &tally);
+}
+
+/* Returns the number of pairs of colliding beads of the fixed beads along with the beads in 'candBB' and 'candSC'
+ *   placed by elements 'eleIdx' onwards, or 'limit'+1 as soon as it is known to exceed 'limit'.
+ * Unlike evaluate(), contacts aren't counted, so only the point of each bead is looked up.
+ */
+static
+int count_collisions(FitnessDelta fd, int eleIdx, int limit){
+	int here[N_TYPES] = { 0, 0, 0 };
+	int collisions = fd->fixedTally.collisions;
+	int i, k;
+
+	for(i = eleIdx == 0 ? 0 : eleIdx + 1; i < fd->hpSize && collisions <= limit; i++){
+		// Element 0 moves only the side chains of beads 0 and 1
+		for(k = (i < 2 ? 1 : 0); k < 2; k++){
+			int3d bead = k == 0 ? fd->candBB[i] : fd->candSC[i];
+			int type = k == 0 ? TYPE_BB : sc_type(fd, i);
+			uint64_t key = lattice_key(bead);
+
+			collisions += lattice_count(&fd->lattice, key, here);
+			lattice_add(&fd->lattice, key, LAYER_MOVED, type, 1);
+		}
+	}
+
+	return collisions <= limit ? collisions : limit + 1;
+}
+
+/* Places in 'candBB' and 'candSC' the beads of the current chain with element 'eleIdx' set to 'elem',
+ *   and returns its fitness.
+ */
+static
+double evaluate_change(FitnessDelta fd, int eleIdx, MovElem elem){
+	set_fixed(fd, eleIdx);
+
+	MovElem old = fd->chain[eleIdx];
+	fd->chain[eleIdx] = elem;
+	MovChain_rebuild_3d(fd->chain, fd->chainSize, eleIdx, fd->candBB, fd->candSC);
+	fd->chain[eleIdx] = old;
+
+	return evaluate(fd, eleIdx);
+}
+
+// Documented in header file
+FitnessDelta FitnessDelta_create(const MovElem *chain){
+	FitnessCalc fitCalc = FitnessCalc_get();
+	FitnessDelta fd = malloc(sizeof(struct FitnessDelta_));
+	int i;
+
+	fd->hpSize = fitCalc.hpSize;
+	fd->chainSize = fitCalc.hpSize - 1;
+	fd->hpChain = fitCalc.hpChain;
+	fd->countH = 0;
+	for(i = 0; i < fd->hpSize; i++)
+		if(fd->hpChain[i] == 'H') fd->countH++;
+	fd->countP = fd->hpSize - fd->countH;
+
+	fd->chain = malloc(sizeof(MovElem) * fd->chainSize);
+	memcpy(fd->chain, chain, sizeof(MovElem) * fd->chainSize);
+
+	MovChain_build_3d(fd->chain, fd->chainSize, &fd->coordsBB, &fd->coordsSC);
+	fd->candBB = malloc(sizeof(int3d) * fd->hpSize);
+	fd->candSC = malloc(sizeof(int3d) * fd->hpSize);
+	memcpy(fd->candBB, fd->coordsBB, sizeof(int3d) * fd->hpSize);
+	memcpy(fd->candSC, fd->coordsSC, sizeof(int3d) * fd->hpSize);
+
+	lattice_init(&fd->lattice, 2 * fd->hpSize);
+	fd->fixedIdx = -1;
+
+	set_fixed(fd, 0);
+	fd->fitness = evaluate(fd, 0);
+	fd->collisions = fd->candCollisions;
+
+	return fd;
+}
+
+// Documented in header file
+void FitnessDelta_free(FitnessDelta fd){
+	lattice_free(&fd->lattice);
+	free(fd->chain);
+	free(fd->coordsBB);
+	free(fd->coordsSC);
+	free(fd->candBB);
+	free(fd->candSC);
+	free(fd);
+}
+
+// Documented in header file
+const MovElem *FitnessDelta_chain(FitnessDelta fd){
+	return fd->chain;
+}
+
+// Documented in header file
+double FitnessDelta_fitness(FitnessDelta fd){
+	return fd->fitness;
+}
+
+// Documented in header file
+double FitnessDelta_try(FitnessDelta fd, int eleIdx, MovElem elem){
+	if(fd->chain[eleIdx] == elem)
+		return fd->fitness;
+
+	double fitness = evaluate_change(fd, eleIdx, elem);
+
+	// Bring the candidate beads back to the current chain
+	memcpy(fd->candBB, fd->coordsBB, sizeof(int3d) * fd->hpSize);
+	memcpy(fd->candSC, fd->coordsSC, sizeof(int3d) * fd->hpSize);
+
+	return fitness;
+}
+
+// Documented in header file
+int FitnessDelta_collisions(FitnessDelta fd){
+	return fd->collisions;
+}
+
+// Documented in header file
+int FitnessDelta_try_collisions(FitnessDelta fd, int eleIdx, MovElem elem, int limit){
+	if(fd->chain[eleIdx] == elem)
+		return fd->collisions <= limit ? fd->collisions : limit + 1;
+
+	set_fixed(fd, eleIdx);
+
+	MovElem old = fd->chain[eleIdx];
+	fd->chain[eleIdx] = elem;
+	MovChain_rebuild_3d(fd->chain, fd->chainSize, eleIdx, fd->candBB, fd->candSC);
+	fd->chain[eleIdx] = old;
+
+	int collisions = count_collisions(fd, eleIdx, limit);
+
+	// Bring the candidate beads back to the current chain. Only the beads of 'eleIdx' onwards moved
+	int from = eleIdx == 0 ? 0 : eleIdx + 1;
+	memcpy(fd->candBB + from, fd->coordsBB + from, sizeof(int3d) * (fd->hpSize - from));
+	memcpy(fd->candSC + from, fd->coordsSC + from, sizeof(int3d) * (fd->hpSize - from));
+
+	return collisions;
+}
+
+// Documented in header file
+double FitnessDelta_apply(FitnessDelta fd, int eleIdx, MovElem elem){
+	if(fd->chain[eleIdx] == elem)
+		return fd->fitness;
+
+	fd->fitness = evaluate_change(fd, eleIdx, elem);
+	fd->collisions = fd->candCollisions;
+	fd->chain[eleIdx] = elem;
+
+	// The prefix of 'eleIdx' didn't change, so the fixed layer is still valid
+	memcpy(fd->coordsBB, fd->candBB, sizeof(int3d) * fd->hpSize);
+	memcpy(fd->coordsSC, fd->candSC, sizeof(int3d) * fd->hpSize);
+
+	return fd->fitness;
+}
+
+// Documented in header file
+const int3d *FitnessDelta_coords_bb(FitnessDelta fd){
+	return fd->coordsBB;
+}
+
+// Documented in header file
+const int3d *FitnessDelta_coords_sc(FitnessDelta fd){
+	return fd->coordsSC;
+}
+
+// Documented in header file
+int FitnessDelta_occupancy(FitnessDelta fd, int3d point){
+	int here[N_TYPES] = { 0, 0, 0 };
+
+	set_fixed(fd, fd->chainSize);
+	return lattice_count(&fd->lattice, lattice_key(point), here);
+}
+
+/* Returns where bead 'bead' (see FitnessDelta_try_beads()) is in 'coordsBB' or 'coordsSC' */
+static inline
+int3d *bead_coords(FitnessDelta fd, int3d *coordsBB, int3d *coordsSC, int bead){
+	return bead < fd->hpSize ? &coordsBB[bead] : &coordsSC[bead - fd->hpSize];
+}
+
+static inline
+int bead_type(FitnessDelta fd, int bead){
+	return bead < fd->hpSize ? TYPE_BB : sc_type(fd, bead - fd->hpSize);
+}
+
+// Documented in header file
+double FitnessDelta_try_beads(FitnessDelta fd, int nBeads, const int *beads, const int3d *coords){
+	int i;
+
+	// All beads of the current chain are fixed, and the moved layer takes the moved ones away
+	set_fixed(fd, fd->chainSize);
+	Tally tally = fd->fixedTally;
+
+	for(i = 0; i < nBeads; i++)
+		remove_bead(fd, &tally, *bead_coords(fd, fd->coordsBB, fd->coordsSC, beads[i]), bead_type(fd, beads[i]));
+
+	for(i = 0; i < nBeads; i++){
+		place_bead(fd, &tally, LAYER_MOVED, coords[i], bead_type(fd, beads[i]));
+		*bead_coords(fd, fd->candBB, fd->candSC, beads[i]) = coords[i];
+	}
+
+	double fitness = tally_fitness(fd, &tally);
+
+	// Bring the candidate beads back to the current chain
+	for(i = 0; i < nBeads; i++)
+		*bead_coords(fd, fd->candBB, fd->candSC, beads[i]) = *bead_coords(fd, fd->coordsBB, fd->coordsSC, beads[i]);
+
+	return fitness;
+}
@@ -0,0 +1,69 @@
+#ifndef _FITNESS_DELTA_H_
+#define _FITNESS_DELTA_H_
+
+/** \file fitness_delta.h Incremental fitness of single-element changes of a movement chain.
+ *
+ * Changing element E of a movement chain moves every bead placed by elements E onwards, while the beads
+ *   placed by earlier elements (the prefix) stay where they are.
+ * A FitnessDelta keeps the contacts and collisions among the beads of the prefix of E in a hashed lattice,
+ *   so evaluating a change of element E only needs to place the beads that moved.
+ * Evaluating changes of elements in increasing order grows the prefix incrementally, so a full scan of
+ *   all elements costs about half of what evaluating each alternative from scratch does.
+ *
+ * Changes can also be given as new coordinates for a few beads (FitnessDelta_try_beads()), in which case
+ *   all other beads are fixed and only the given ones are placed again.
+ *
+ * The fitness returned is exactly the one FitnessCalc_run2() returns for the changed chain.
+ * FitnessCalc_initialize() must have been called. Each handle must be used by a single thread at a time.
+ */
+
+#include <movchain.h>
+
+/** Handle to the incremental evaluation of a movement chain. */
+typedef struct FitnessDelta_ *FitnessDelta;
+
+/** Creates the handle for a copy of 'chain', which has the size of the protein registered with FitnessCalc_initialize(). */
+FitnessDelta FitnessDelta_create(const MovElem *chain);
+
+/** Frees the handle. */
+void FitnessDelta_free(FitnessDelta fd);
+
+/** Returns the current movement chain of the handle, which shouldn't be modified. */
+const MovElem *FitnessDelta_chain(FitnessDelta fd);
+
+/** Returns the fitness of the current movement chain. */
+double FitnessDelta_fitness(FitnessDelta fd);
+
+/** Returns the fitness the current chain would have if its element 'eleIdx' were 'elem'. The chain is not changed. */
+double FitnessDelta_try(FitnessDelta fd, int eleIdx, MovElem elem);
+
+/** Returns the number of pairs of colliding beads in the current chain. */
+int FitnessDelta_collisions(FitnessDelta fd);
+
+/** Returns the number of pairs of colliding beads the current chain would have if its element 'eleIdx' were 'elem',
+ *   or 'limit'+1 if that number is greater than 'limit'.
+ * It only looks up the point of each moved bead, without counting contacts, and stops as soon as 'limit' is exceeded,
+ *   so it is much cheaper than FitnessDelta_try(). The chain is not changed.
+ */
+int FitnessDelta_try_collisions(FitnessDelta fd, int eleIdx, MovElem elem, int limit);
+
+/** Sets element 'eleIdx' of the current chain to 'elem', and returns the new fitness. */
+double FitnessDelta_apply(FitnessDelta fd, int eleIdx, MovElem elem);
+
+/** Returns the coordinates of the backbone beads of the current chain, as built by MovChain_build_3d(). */
+const int3d *FitnessDelta_coords_bb(FitnessDelta fd);
+
+/** Returns the coordinates of the side chain beads of the current chain, as built by MovChain_build_3d(). */
+const int3d *FitnessDelta_coords_sc(FitnessDelta fd);
+
+/** Returns the number of beads of the current chain in 'point'. */
+int FitnessDelta_occupancy(FitnessDelta fd, int3d point);
+
+/** Returns the fitness the current chain would have if the 'nBeads' beads in 'beads' were moved to 'coords'.
+ * Backbone bead i is identified by i, and side chain bead i by hpSize+i. Beads must not repeat.
+ * The fitness is the one of the coordinates, which may not be the coordinates of any movement chain.
+ * The chain is not changed.
+ */
+double FitnessDelta_try_beads(FitnessDelta fd, int nBeads, const int *beads, const int3d *coords);
+
+#endif
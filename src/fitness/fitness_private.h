@@ -56,6 +56,21 @@ typedef struct {
 } BeadMeasures;
 
 FitnessCalc FitnessCalc_get(); // Returns the FIT_BUNDLE of the protein being assessed.
+FitnessCalc FitnessCalc_thread(FitnessCalc registered); // 'registered', with the protein of the calling thread if it has one (see FitnessCalc_use_protein).
 BeadMeasures proteinMeasures(const int3d *BBbeads, const int3d *SCbeads, const HPElem *hpChain, int hpSize);
+double measuresFitness(BeadMeasures measures, const int3d *SCbeads); // Fitness given the measures and the side chain beads.
+
+/**********************************
+ *    Lattices of the threads     *
+ **********************************/
+
+/** Returns the 3D lattice of the calling thread, with 'axisSize' points per axis, allocating it on first use
+ *   or after Lattice_free_all().
+ * Lattices are registered under a lock, so many threads may call it at once.
+ */
+char *Lattice_thread(int axisSize);
+
+/** Frees the lattices of all threads. Each thread allocates a new one on its next Lattice_thread(). */
+void Lattice_free_all();
 
 #endif
@@ -4,6 +4,7 @@
 #include <fitness/fitness.h>
 
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -14,59 +15,66 @@ double dsquare(double a){
 	return a * a;
 }
 
-// Documented in header file
-double calc_gyration(const int3d *coords, int size, DPoint center){
-	double gyr = 0;
-
-	// First we perform the sum of squares
-	int i;
-	for(i = 0; i < size; i++){
-		int3d elem = coords[i];
+/* Moments of a set of beads, from which its gyration is taken exactly */
+typedef struct {
+	int64_t count;
+	int64_t sum[3];    /**< Sum of the coordinates on each axis */
+	int64_t sumSq;     /**< Sum of the squared coordinates of all axes */
+} Moments;
 
-		// Perform sum of squares
-		gyr += dsquare(elem.x - center.x);
-		gyr += dsquare(elem.y - center.y);
-		gyr += dsquare(elem.z - center.z);
-	}
+static inline
+void moments_add(Moments *m, int3d p){
+	m->count++;
+	m->sum[0] += p.x;
+	m->sum[1] += p.y;
+	m->sum[2] += p.z;
+	m->sumSq += (int64_t) p.x * p.x + (int64_t) p.y * p.y + (int64_t) p.z * p.z;
+}
 
-	// Final touches
-	gyr = sqrt(gyr / size);
+/* Returns the gyration radius of the beads of 'm'
+ * The sum of squared distances to the center, times count^2, is count * sumSq - |sum|^2, which is an integer
+ *   that doesn't change when the beads are moved, rotated or mirrored over the lattice. With a single division
+ *   at the end, symmetric conformations get exactly the same gyration.
+ */
+static inline
+double moments_gyration(const Moments *m){
+	int64_t spread = m->count * m->sumSq;
+	int i;
+	for(i = 0; i < 3; i++)
+		spread -= m->sum[i] * m->sum[i];
 
-	return gyr;
+	double count = (double) m->count;
+	return sqrt(spread / (count * count));
 }
 
 // Documented in header file
-DPair calc_gyration_joint(const int3d *coordsSC, const HPElem * hpChain, int hpSize, DPoint centerH, DPoint centerP){
-	DPair gyr = { 0, 0 };
-	int countH = 0, countP = 0;
+double calc_gyration(const int3d *coords, int size){
+	Moments m = { 0, { 0, 0, 0 }, 0 };
 
-	// First we perform the sum of squares
 	int i;
-	for(i = 0; i < hpSize; i++){
-		int3d elem = coordsSC[i];
+	for(i = 0; i < size; i++)
+		moments_add(&m, coords[i]);
 
-		// Perform sum of squares
-		if(hpChain[i] == 'H'){
-			gyr.first += dsquare(elem.x - centerH.x);
-			gyr.first += dsquare(elem.y - centerH.y);
-			gyr.first += dsquare(elem.z - centerH.z);
+	return moments_gyration(&m);
+}
 
-			countH++;
-		} else {
-			gyr.second += dsquare(elem.x - centerP.x);
-			gyr.second += dsquare(elem.y - centerP.y);
-			gyr.second += dsquare(elem.z - centerP.z);
+// Documented in header file
+DPair calc_gyration_joint(const int3d *coordsSC, const HPElem * hpChain, int hpSize){
+	Moments mH = { 0, { 0, 0, 0 }, 0 };
+	Moments mP = { 0, { 0, 0, 0 }, 0 };
 
-			countP++;
-		}
+	int i;
+	for(i = 0; i < hpSize; i++){
+		if(hpChain[i] == 'H')
+			moments_add(&mH, coordsSC[i]);
+		else
+			moments_add(&mP, coordsSC[i]);
 	}
 
-	// Final touches
-	gyr.first = sqrt(gyr.first / countH);
-	gyr.second = sqrt(gyr.second / countP);
+	DPair gyr = { moments_gyration(&mH), moments_gyration(&mP) };
 
 	// Because we would have divided by 0 above
-	if(countP == 0) gyr.second = 1;
+	if(mP.count == 0) gyr.second = 1;
 
 	return gyr;
 }
@@ -8,21 +8,22 @@
 
 /* coords - the coordinates for the beads
  * size   - the number of beads
- * center - the center points (baricenter) for the beads.
  *
- * Returns the gyration radius for the given beads.
+ * Returns the gyration radius for the given beads, around their center (baricenter).
+ * It is calculated from integer moments of the beads, so it is exactly the same for beads that are
+ *   moved, rotated or mirrored over the lattice.
  */
-double calc_gyration(const int3d *coords, int size, DPoint center);
+double calc_gyration(const int3d *coords, int size);
 
 /* coordsSC - the coordinates for all side chain beads
  * hpChain - the string representing the types of the side chain beads
  * hpSize - the number of side chain beads
- * centerH and centerP are the center points (baricenter) for H beads and P beads respectively.
  *
  * Returns a DPair where the first element is the gyration for H beads.
  * The second element is gyration for P beads.
+ * Each is taken around the center of its beads, as in calc_gyration.
  */
-DPair calc_gyration_joint(const int3d *coordsSC, const HPElem * hpChain, int hpSize, DPoint centerH, DPoint centerP);
+DPair calc_gyration_joint(const int3d *coordsSC, const HPElem * hpChain, int hpSize);
 
 /* Calculate MaxRG_H which is the radius of gyration for the hydrophobic beads
  *   considering the protein completely unfolded
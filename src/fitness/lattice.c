@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "fitness_private.h"
+
+/* Each thread lazily allocates its own lattice, so that fitness can be calculated by many threads at once.
+ * All lattices are registered here so that Lattice_free_all can free them, and 'generation' tells
+ *   a thread that its lattice belongs to a previous initialization.
+ */
+static struct {
+	char **spaces;
+	int count;
+	int generation;
+	pthread_mutex_t lock;
+} LATTICES = { NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+
+static _Thread_local char *MY_SPACE3D = NULL;
+static _Thread_local int MY_GENERATION = -1;
+
+// Documented in header file
+char *Lattice_thread(int axisSize){
+	if(MY_SPACE3D != NULL && MY_GENERATION == LATTICES.generation)
+		return MY_SPACE3D;
+
+	long int spaceSize = axisSize * axisSize * (long int) axisSize;
+
+	pthread_mutex_lock(&LATTICES.lock);
+
+	// Failsafe for memory usage
+	if((LATTICES.count + 1) * spaceSize * sizeof(char) > MAX_MEMORY){
+		fprintf(stderr, "Will not allocate more than %g memory.\n", (double) MAX_MEMORY);
+		exit(EXIT_FAILURE);
+	}
+
+	MY_SPACE3D = malloc(spaceSize * sizeof(char));
+	MY_GENERATION = LATTICES.generation;
+
+	LATTICES.spaces = realloc(LATTICES.spaces, sizeof(char *) * (LATTICES.count + 1));
+	LATTICES.spaces[LATTICES.count++] = MY_SPACE3D;
+
+	pthread_mutex_unlock(&LATTICES.lock);
+
+	return MY_SPACE3D;
+}
+
+// Documented in header file
+void Lattice_free_all(){
+	int i;
+
+	pthread_mutex_lock(&LATTICES.lock);
+	for(i = 0; i < LATTICES.count; i++)
+		free(LATTICES.spaces[i]);
+	free(LATTICES.spaces);
+	LATTICES.spaces = NULL;
+	LATTICES.count = 0;
+	LATTICES.generation++;
+	pthread_mutex_unlock(&LATTICES.lock);
+}
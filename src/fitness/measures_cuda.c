@@ -8,6 +8,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "CUDA_header.h"
 #include "gyration.h"
@@ -17,6 +18,11 @@
 
 static FitnessCalc FIT_BUNDLE = {0, 0, NULL, 0, 0};
 
+/* The CUDA routines rotate over a static set of streams, so launches from
+ *   different threads must not interleave.
+ */
+static pthread_mutex_t GPU_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
 void FitnessCalc_initialize(const HPElem * hpChain, int hpSize){
 	FIT_BUNDLE.hpChain = hpChain;
 	FIT_BUNDLE.hpSize = hpSize;
@@ -30,7 +36,7 @@ void FitnessCalc_cleanup(){
 /* Returns the FitnessCalc
  */
 FitnessCalc FitnessCalc_get(){
-	return FIT_BUNDLE;
+	return FitnessCalc_thread(FIT_BUNDLE);
 }
 
 static inline
@@ -77,6 +83,8 @@ BeadMeasures proteinMeasures(const int3d *BBbeads, const int3d *SCbeads, const H
 		}
 	}
 
+	pthread_mutex_lock(&GPU_LOCK);
+
 	struct CollisionCountPromise promises[] = {
 		count_contacts_launch(coordsHH, sizeHH), // HH
 		count_contacts_launch(coordsPP, sizePP), // PP
@@ -97,6 +105,8 @@ BeadMeasures proteinMeasures(const int3d *BBbeads, const int3d *SCbeads, const H
 	retval.pb = count_contacts_fetch(promises[5]) - retval.pp - retval.bb; // PB = all - PP - BB
 	retval.collisions = count_collisions_fetch(promises[6]);
 
+	pthread_mutex_unlock(&GPU_LOCK);
+
 	// Remove the trivial contacts
 	retval.bb -= (hpSize - 1);
 	retval.hb -= (sizeHH);
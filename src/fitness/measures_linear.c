@@ -25,24 +25,15 @@ void FitnessCalc_initialize(const HPElem * hpChain, int hpSize){
 
 	FIT_BUNDLE.hpChain = hpChain;
 	FIT_BUNDLE.hpSize = hpSize;
-
-	int axisSize = (hpSize+3)*2;
-	long int spaceSize = axisSize * axisSize * (long int) axisSize;
-
-	// Failsafe for memory usage
-	if(spaceSize * sizeof(char) > MAX_MEMORY){
-		fprintf(stderr, "Will not allocate more than %g memory.\n", (double) MAX_MEMORY);
-		exit(EXIT_FAILURE);
-	}
-
-	FIT_BUNDLE.axisSize = axisSize;
-	FIT_BUNDLE.space3d = malloc(spaceSize * sizeof(char));
+	FIT_BUNDLE.axisSize = (hpSize+3)*2;
+	FIT_BUNDLE.space3d = Lattice_thread(FIT_BUNDLE.axisSize);
 	FIT_BUNDLE.maxGyration = calc_max_gyration(hpChain, hpSize);
 }
 
 void FitnessCalc_cleanup(){
 	// No checks will be done
-	free(FIT_BUNDLE.space3d);
+	Lattice_free_all();
+
 	FIT_BUNDLE.space3d = NULL;
 }
 
@@ -53,7 +44,7 @@ FitnessCalc FitnessCalc_get(){
 		fprintf(stderr, "%s", "FitnessCalc must be initialized.\n");
 		exit(EXIT_FAILURE);
 	}
-	return FIT_BUNDLE;
+	return FitnessCalc_thread(FIT_BUNDLE);
 }
 
 
@@ -67,7 +58,7 @@ int count_collisions(const int3d *beads, int nBeads){
 	int i, collisions;
 
 	// Get space3d associated with that thread
-	char *space3d = FIT_BUNDLE.space3d;
+	char *space3d = Lattice_thread(FIT_BUNDLE.axisSize);
 	int axisSize = FIT_BUNDLE.axisSize;
 	
 	collisions = 0;
@@ -96,7 +87,7 @@ int count_contacts(const int3d *beads, int nBeads){
 	int i;
 
 	// Get space3d associated with that thread
-	char *space3d = FIT_BUNDLE.space3d;
+	char *space3d = Lattice_thread(FIT_BUNDLE.axisSize);
 	int axisSize = FIT_BUNDLE.axisSize;
 
 	int contacts = 0;
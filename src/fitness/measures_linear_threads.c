@@ -16,70 +16,36 @@
 #define COORD3D(V, AXIS) COORD(V.x, V.y, V.z, AXIS)
 #define COORD(X, Y, Z, AXIS) ( (Z+AXIS/2) * (AXIS*(long int)AXIS) + (Y+AXIS/2) * ((long int)AXIS) + (X+AXIS/2))
 
-static FitnessCalc *FIT_BUNDLE = NULL;
+static FitnessCalc FIT_BUNDLE = {0, 0, NULL, 0, 0};
 
 void FitnessCalc_initialize(const HPElem * hpChain, int hpSize){
-	if(FIT_BUNDLE != NULL){
+	if(FIT_BUNDLE.space3d != NULL){
 		fprintf(stderr, "%s", "Double initialization.\n");
 		exit(EXIT_FAILURE);
 	}
 
-	int i;
-	int numThreads = omp_get_max_threads();
-	int axisSize = (hpSize+3)*2;
-	long int spaceSize = axisSize * axisSize * (long int) axisSize;
-
-	// Verify memory usage
-	if(numThreads * spaceSize * sizeof(char) > MAX_MEMORY){
-		fprintf(stderr, "Will not allocate more than %g memory.\n", (double) MAX_MEMORY);
-		exit(EXIT_FAILURE);
-	}
-
-	// Allocate on bundle for each thread
-	FIT_BUNDLE = (FitnessCalc *) malloc(sizeof(FitnessCalc) * numThreads);
-
-	// Initialize bundles
-	for(i = 0; i < numThreads; i++){
-		FIT_BUNDLE[i].hpChain  = hpChain;
-		FIT_BUNDLE[i].hpSize   = hpSize;
-		FIT_BUNDLE[i].axisSize = axisSize;
-	}
-
-	// Keep initializing bundles
-	const int gyration = calc_max_gyration(hpChain, hpSize);
-	for(i = 0; i < numThreads; i++){
-		FIT_BUNDLE[i].maxGyration = gyration;
-	}
-
-	// Final initialization
-	for(i = 0; i < numThreads; i++){
-		FIT_BUNDLE[i].space3d = (void *) malloc(spaceSize * sizeof(char));
-		if(FIT_BUNDLE[i].space3d == NULL){
-			fprintf(stderr, "Malloc returned error when allocating memory! Attempted to allocate %lf GiB\n", numThreads * spaceSize * sizeof(char) / 1024.0 / 1024.0 / 1024.0);
-		}
-	}
+	FIT_BUNDLE.hpChain = hpChain;
+	FIT_BUNDLE.hpSize = hpSize;
+	FIT_BUNDLE.axisSize = (hpSize+3)*2;
+	FIT_BUNDLE.space3d = Lattice_thread(FIT_BUNDLE.axisSize);
+	FIT_BUNDLE.maxGyration = calc_max_gyration(hpChain, hpSize);
 }
 
 void FitnessCalc_cleanup(){
-	int i;
-	int numThreads = omp_get_max_threads();
-	
-	for(i = 0; i < numThreads; i++){
-		free(FIT_BUNDLE[i].space3d);
-	}
+	// No checks will be done
+	Lattice_free_all();
 
-	free(FIT_BUNDLE);
-	FIT_BUNDLE = NULL;
+	FIT_BUNDLE.space3d = NULL;
 }
 
 /* Returns the FitnessCalc
  */
 FitnessCalc FitnessCalc_get(){
-	if(FIT_BUNDLE == NULL){
+	if(FIT_BUNDLE.space3d == NULL){
 		fprintf(stderr, "%s", "FitnessCalc must be initialized.\n");
 		exit(EXIT_FAILURE);
 	}
-	return FIT_BUNDLE[0];
+	return FitnessCalc_thread(FIT_BUNDLE);
 }
 
 
@@ -89,12 +55,12 @@ FitnessCalc FitnessCalc_get(){
  * 'space3d' is 3D lattice whose axis has size axisSize (positive + negative sides of the axis).
  */
 static
-int count_collisions(int tid, const int3d *beads, int nBeads){
+int count_collisions(const int3d *beads, int nBeads){
 	int i, collisions;
 
 	// Get space3d associated with that thread
-	char *space3d = FIT_BUNDLE[tid].space3d;
-	int axisSize = FIT_BUNDLE[tid].axisSize;
+	char *space3d = Lattice_thread(FIT_BUNDLE.axisSize);
+	int axisSize = FIT_BUNDLE.axisSize;
 	
 	collisions = 0;
 
@@ -118,12 +84,12 @@ int count_collisions(int tid, const int3d *beads, int nBeads){
  * 'space3d' is 3D lattice whose axis has size axisSize (positive + negative sides of the axis).
  */
 static
-int count_contacts(int tid, const int3d *beads, int nBeads){
+int count_contacts(const int3d *beads, int nBeads){
 	int i;
 
 	// Get space3d associated with that thread
-	char *space3d = FIT_BUNDLE[tid].space3d;
-	int axisSize = FIT_BUNDLE[tid].axisSize;
+	char *space3d = Lattice_thread(FIT_BUNDLE.axisSize);
+	int axisSize = FIT_BUNDLE.axisSize;
 
 	int contacts = 0;
 	
@@ -199,36 +165,32 @@ BeadMeasures proteinMeasures(const int3d *BBbeads, const int3d *SCbeads, const H
 
 	BeadMeasures retval;
 
+	// Raw counts are only combined after the parallel loop, as the HP, HB and PB
+	//   counts depend on the HH, PP and BB counts computed by other threads.
+	int counts[7];
+
 	#pragma omp parallel for schedule(dynamic, 1)
 	for(i = 0; i < 7; i++){
-		int tid = omp_get_thread_num();
-
 		switch(i){
-		case 0:
-			retval.hh = count_contacts(tid, coordsHH, sizeHH);
-			break;
-		case 1:
-			retval.pp = count_contacts(tid, coordsPP, sizePP);
-			break;
-		case 2:
-			retval.hp = count_contacts(tid, coordsHP, sizeHP) - retval.hh - retval.pp; // HP = all - HH - PP
-			break;
-		case 3:
-			retval.bb = count_contacts(tid, coordsBB, sizeBB);
-			break;
-		case 4:
-			retval.hb = count_contacts(tid, coordsHB, sizeHB) - retval.hh - retval.bb; // HB = all - HH - BB
-			break;
-		case 5:
-			retval.pb = count_contacts(tid, coordsPB, sizePB) - retval.pp - retval.bb; // PB = all - PP - BB
-			break;
-		case 6:
-			retval.collisions = count_collisions(tid, coordsAll, sizeAll);
-			break;
+		case 0: counts[i] = count_contacts(coordsHH, sizeHH); break;
+		case 1: counts[i] = count_contacts(coordsPP, sizePP); break;
+		case 2: counts[i] = count_contacts(coordsHP, sizeHP); break;
+		case 3: counts[i] = count_contacts(coordsBB, sizeBB); break;
+		case 4: counts[i] = count_contacts(coordsHB, sizeHB); break;
+		case 5: counts[i] = count_contacts(coordsPB, sizePB); break;
+		case 6: counts[i] = count_collisions(coordsAll, sizeAll); break;
 		default: break;
 		}
 	}
 
+	retval.hh = counts[0];
+	retval.pp = counts[1];
+	retval.hp = counts[2] - retval.hh - retval.pp; // HP = all - HH - PP
+	retval.bb = counts[3];
+	retval.hb = counts[4] - retval.hh - retval.bb; // HB = all - HH - BB
+	retval.pb = counts[5] - retval.pp - retval.bb; // PB = all - PP - BB
+	retval.collisions = counts[6];
+
 	// Remove the trivial contacts
 	retval.bb -= (hpSize - 1);
 	retval.hb -= (sizeHH);
@@ -27,7 +27,7 @@ void FitnessCalc_cleanup(){
 /* Returns the FitnessCalc
  */
 FitnessCalc FitnessCalc_get(){
-	return FIT_BUNDLE;
+	return FitnessCalc_thread(FIT_BUNDLE);
 }
 
 
@@ -28,7 +28,7 @@ void FitnessCalc_cleanup(){
 /* Returns the FitnessCalc
  */
 FitnessCalc FitnessCalc_get(){
-	return FIT_BUNDLE;
+	return FitnessCalc_thread(FIT_BUNDLE);
 }
 
 
@@ -113,34 +113,32 @@ BeadMeasures proteinMeasures(const int3d *BBbeads, const int3d *SCbeads, const H
 
 	BeadMeasures retval;
 
+	// Raw counts are only combined after the parallel loop, as the HP, HB and PB
+	//   counts depend on the HH, PP and BB counts computed by other threads.
+	int counts[7];
+
 	#pragma omp parallel for schedule(dynamic, 1)
 	for(i = 0; i < 7; i++){
 		switch(i){
-		case 0:
-			retval.hh = count_contacts(coordsHH, sizeHH);
-			break;
-		case 1:
-			retval.pp = count_contacts(coordsPP, sizePP);
-			break;
-		case 2:
-			retval.hp = count_contacts(coordsHP, sizeHP) - retval.hh - retval.pp; // HP = all - HH - PP
-			break;
-		case 3:
-			retval.bb = count_contacts(coordsBB, sizeBB);
-			break;
-		case 4:
-			retval.hb = count_contacts(coordsHB, sizeHB) - retval.hh - retval.bb; // HB = all - HH - BB
-			break;
-		case 5:
-			retval.pb = count_contacts(coordsPB, sizePB) - retval.pp - retval.bb; // PB = all - PP - BB
-			break;
-		case 6:
-			retval.collisions = count_collisions(coordsAll, sizeAll);
-			break;
+		case 0: counts[i] = count_contacts(coordsHH, sizeHH); break;
+		case 1: counts[i] = count_contacts(coordsPP, sizePP); break;
+		case 2: counts[i] = count_contacts(coordsHP, sizeHP); break;
+		case 3: counts[i] = count_contacts(coordsBB, sizeBB); break;
+		case 4: counts[i] = count_contacts(coordsHB, sizeHB); break;
+		case 5: counts[i] = count_contacts(coordsPB, sizePB); break;
+		case 6: counts[i] = count_collisions(coordsAll, sizeAll); break;
 		default: break;
 		}
 	}
 
+	retval.hh = counts[0];
+	retval.pp = counts[1];
+	retval.hp = counts[2] - retval.hh - retval.pp; // HP = all - HH - PP
+	retval.bb = counts[3];
+	retval.hb = counts[4] - retval.hh - retval.bb; // HB = all - HH - BB
+	retval.pb = counts[5] - retval.pp - retval.bb; // PB = all - PP - BB
+	retval.collisions = counts[6];
+
 	// Remove the trivial contacts
 	retval.bb -= (hpSize - 1);
 	retval.hb -= (sizeHH);
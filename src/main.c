@@ -9,18 +9,19 @@
 #include "fitness/fitness.h"
 #include "abc_alg/abc_alg.h"
 #include "config.h"
+#include "random.h"
 
 #undef MT_GENERATE_CODE_IN_HEADER
 #define MT_GENERATE_CODE_IN_HEADER 0
 #include "mtwist/mtwist.h"
 
 void fixed_seed(int seed){
-	mt_seed32(seed);
+	random_set_seed(seed);
 }
 
-// Seeds the mersenne twister random number generator
+// Seeds the random number generator with a seed chosen by the mersenne twister from random input
 void random_seed(){
-	mt_seed();
+	random_set_seed(mt_seed());
 }
 
 void print_3d(const MovElem * movchain, const HPElem * hpChain, int hpSize, FILE *fp){
@@ -120,12 +121,44 @@ int main(int argc, char *argv[]){
 		printf("BBGyration: %lf\n", results.bbGyration);
 		printf("CPU_Time: %lf\n", clk_time);
 		printf("Wall_Time: %lf\n", wall_time);
+		if(results.exactNodes > 0)
+			printf("Exact_Nodes: %ld\n", results.exactNodes);
+
+		// Acceptance rate of the solutions generated by each kind of move
+		int kind;
+		for(kind = 0; kind < N_MOVES; kind++){
+			if(results.moveProposed[kind] > 0)
+				printf("Acceptance_%s: %lf (%ld/%ld)\n", Moves_name(kind),
+					results.moveAccepted[kind] / (double) results.moveProposed[kind],
+					results.moveAccepted[kind], results.moveProposed[kind]);
+		}
 
 		FILE *fp = fopen(outFile, "w+");
 		print_3d(Solution_chain(sol), hpChain, hpSize, fp);
-
 		fclose(fp);
+
+		// The movement chains go to '<outFile>.chains', which can seed later runs (see SEED_FILE)
+		char fileName[strlen(outFile) + 16];
+		sprintf(fileName, "%s.chains", outFile);
+		FILE *chainsFp = fopen(fileName, "w+");
+		MovChain_print(Solution_chain(sol), hpSize - 1, chainsFp);
 		Solution_free(sol);
+
+		// Archived conformations go to '<outFile>.1', '<outFile>.2' and so on
+		int i;
+		for(i = 0; i < results.archiveSize; i++){
+			printf("Archive_Fitness_%d: %lf\n", i + 1, Solution_fitness(results.archive[i]));
+
+			sprintf(fileName, "%s.%d", outFile, i + 1);
+			fp = fopen(fileName, "w+");
+			print_3d(Solution_chain(results.archive[i]), hpChain, hpSize, fp);
+			fclose(fp);
+
+			MovChain_print(Solution_chain(results.archive[i]), hpSize - 1, chainsFp);
+			Solution_free(results.archive[i]);
+		}
+		fclose(chainsFp);
+		free(results.archive);
 	}
 
 	if(freeChain)
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 
 #include "movchain.h"
 #include "movelem.h"
@@ -74,27 +75,51 @@ void MovChain_build_3d(const MovElem * chain,
 	coordsBB[0] = int3d_make(1, 0, 0);
 	coordsBB[1] = int3d_make(2, 0, 0);
 
-	// Place initial SC, which are exceptions.
-	// The first MovChain element stores directions for the first 2 SC's.
-	// All the other MovChain elements store for 1 SC and 1 BB.
-	MovElem elem = chain[0];
-	unsigned char mov1 = MovElem_getBB(elem);
-	unsigned char mov2 = MovElem_getSC(elem);
+	// Everything else depends on the chain
+	MovChain_rebuild_3d(chain, chainSize, 0, coordsBB, coordsSC);
 
+	*coordsBB_p = coordsBB;
+	*coordsSC_p = coordsSC;
+}
+
+void MovChain_rebuild_3d(const MovElem * chain,
+	int chainSize,
+	int eleIdx,
+	int3d *coordsBB,
+	int3d *coordsSC
+){
 	// predecessor vector and displacement vector
 	int3d predVec, dispVec;
+	unsigned char mov1, mov2;
+	int i;
+
+	if(eleIdx == 0){
+		// Place initial SC, which are exceptions.
+		// The first MovChain element stores directions for the first 2 SC's.
+		// All the other MovChain elements store for 1 SC and 1 BB.
+		MovElem elem = chain[0];
+		mov1 = MovElem_getBB(elem);
+		mov2 = MovElem_getSC(elem);
 
-	// Add SC beads.
-	// First predecessor vector is (-1, 0, 0) from BB[1] to BB[0].
-	// Second is (1, 0, 0) from BB[0] to BB[1]. 
-	coordsSC[0] = int3d_add(getNext(int3d_make(-1, 0, 0), mov1), coordsBB[0]);
-	predVec = int3d_make(1, 0, 0); // Will feed the loop as the first predecessor vector
-	coordsSC[1] = int3d_add(getNext(predVec, mov2), coordsBB[1]);
+		// Add SC beads.
+		// First predecessor vector is (-1, 0, 0) from BB[1] to BB[0].
+		// Second is (1, 0, 0) from BB[0] to BB[1].
+		coordsSC[0] = int3d_add(getNext(int3d_make(-1, 0, 0), mov1), coordsBB[0]);
+		predVec = int3d_make(1, 0, 0); // Will feed the loop as the first predecessor vector
+		coordsSC[1] = int3d_add(getNext(predVec, mov2), coordsBB[1]);
+
+		i = 2;
+	} else {
+		// Element 'eleIdx' places bead eleIdx+1, right after the last backbone segment kept
+		predVec = int3d_make(coordsBB[eleIdx].x - coordsBB[eleIdx-1].x,
+		                     coordsBB[eleIdx].y - coordsBB[eleIdx-1].y,
+		                     coordsBB[eleIdx].z - coordsBB[eleIdx-1].z);
+		i = eleIdx + 1;
+	}
 
 	// Iterate over the chain
 	// There should be N+1 beads and N chain elements
-	int i;
-	for(i = 2; i <= chainSize; i++){ // i represents index of current bead being added
+	for(; i <= chainSize; i++){ // i represents index of current bead being added
 		MovElem elem = chain[i-1];
 		mov1 = MovElem_getBB(elem);
 		mov2 = MovElem_getSC(elem);
@@ -118,9 +143,195 @@ void MovChain_build_3d(const MovElem * chain,
 
 		// Predecessor vector is kept for next iteration.
 	}
+}
 
-	*coordsBB_p = coordsBB;
-	*coordsSC_p = coordsSC;
+/* Inverse of getNext(): returns the movement that turns predecessor vector 'pred' into 'disp',
+ *   or -1 if there is none (if 'disp' isn't a unit vector, or goes back along 'pred').
+ */
+static
+int getMovement(int3d pred, int3d disp){
+	int first, second;
+
+	if(abs(disp.x) + abs(disp.y) + abs(disp.z) != 1)
+		return -1;
+
+	if(disp.x == pred.x && disp.y == pred.y && disp.z == pred.z)
+		return FRONT;
+
+	// Get first and second filled coordinates, as in getNext()
+	if(pred.x != 0){
+		first = disp.y;
+		second = disp.z;
+	} else if(pred.y != 0) {
+		first = disp.x;
+		second = disp.z;
+	} else /* z != 0 */ {
+		first = disp.x;
+		second = disp.y;
+	}
+
+	if(first == 1)   return UP;
+	if(first == -1)  return DOWN;
+	if(second == 1)  return RIGHT;
+	if(second == -1) return LEFT;
+	return -1; // Goes back along 'pred'
+}
+
+/* Rotates 'v' so that unit vector 'dir' becomes (1, 0, 0) */
+static
+int3d rotateToX(int3d v, int3d dir){
+	if(dir.x == 1)  return v;
+	if(dir.x == -1) return int3d_make(-v.x, -v.y, v.z);
+	if(dir.y == 1)  return int3d_make(v.y, -v.x, v.z);
+	if(dir.y == -1) return int3d_make(-v.y, v.x, v.z);
+	if(dir.z == 1)  return int3d_make(v.z, v.y, -v.x);
+	/* dir.z == -1 */ return int3d_make(-v.z, v.y, v.x);
+}
+
+int MovChain_from_3d(const int3d *coordsBB,
+	const int3d *coordsSC,
+	int chainSize,
+	MovElem *chain
+){
+	int i;
+	int3d origin = coordsBB[0];
+	int3d dir = int3d_make(coordsBB[1].x - origin.x, coordsBB[1].y - origin.y, coordsBB[1].z - origin.z);
+
+	if(abs(dir.x) + abs(dir.y) + abs(dir.z) != 1)
+		return -1;
+
+	// Bead i relative to backbone bead 0, in the orientation where backbone bead 1 follows along X
+	#define REL_BB(I) rotateToX(int3d_make(coordsBB[I].x - origin.x, coordsBB[I].y - origin.y, coordsBB[I].z - origin.z), dir)
+	#define REL_SC(I) rotateToX(int3d_make(coordsSC[I].x - origin.x, coordsSC[I].y - origin.y, coordsSC[I].z - origin.z), dir)
+	#define DIFF(A, B) int3d_make(A.x - B.x, A.y - B.y, A.z - B.z)
+
+	// The first element holds the side chains of the first two beads, as in MovChain_rebuild_3d()
+	int3d prevBB = REL_BB(0);
+	int3d curBB = REL_BB(1);
+	int3d predVec = DIFF(curBB, prevBB);
+	int mov1 = getMovement(int3d_make(-1, 0, 0), DIFF(REL_SC(0), prevBB));
+	int mov2 = getMovement(predVec, DIFF(REL_SC(1), curBB));
+	if(mov1 < 0 || mov2 < 0)
+		return -1;
+	chain[0] = MovElem_make(mov1, mov2);
+
+	for(i = 2; i <= chainSize; i++){
+		prevBB = curBB;
+		curBB = REL_BB(i);
+
+		int3d dispVec = DIFF(curBB, prevBB);
+		mov1 = getMovement(predVec, dispVec);
+		mov2 = getMovement(dispVec, DIFF(REL_SC(i), curBB));
+		if(mov1 < 0 || mov2 < 0)
+			return -1;
+
+		chain[i-1] = MovElem_make(mov1, mov2);
+		predVec = dispVec;
+	}
+
+	#undef REL_BB
+	#undef REL_SC
+	#undef DIFF
+
+	return 0;
+}
+
+/* Unit vectors are numbered as follows, so that 'd ^ 1' is the opposite of 'd' */
+enum UnitDir { DIR_PX = 0, DIR_NX = 1, DIR_PY = 2, DIR_NY = 3, DIR_PZ = 4, DIR_NZ = 5 };
+
+/* NEXT_DIR[pred][movement] is getNext() over numbered unit vectors */
+static const unsigned char NEXT_DIR[6][5] = {
+	{ DIR_PX, DIR_NZ, DIR_PZ, DIR_PY, DIR_NY },
+	{ DIR_NX, DIR_NZ, DIR_PZ, DIR_PY, DIR_NY },
+	{ DIR_PY, DIR_NZ, DIR_PZ, DIR_PX, DIR_NX },
+	{ DIR_NY, DIR_NZ, DIR_PZ, DIR_PX, DIR_NX },
+	{ DIR_PZ, DIR_NY, DIR_PY, DIR_PX, DIR_NX },
+	{ DIR_NZ, DIR_NY, DIR_PY, DIR_PX, DIR_NX },
+};
+
+/* MOVEMENT_DIR[pred][disp] is getMovement() over numbered unit vectors (0 where there is no movement) */
+static const unsigned char MOVEMENT_DIR[6][6] = {
+	{ FRONT, 0,     UP,    DOWN,  RIGHT, LEFT  },
+	{ 0,     FRONT, UP,    DOWN,  RIGHT, LEFT  },
+	{ UP,    DOWN,  FRONT, 0,     RIGHT, LEFT  },
+	{ UP,    DOWN,  0,     FRONT, RIGHT, LEFT  },
+	{ UP,    DOWN,  RIGHT, LEFT,  FRONT, 0     },
+	{ UP,    DOWN,  RIGHT, LEFT,  0,     FRONT },
+};
+
+/* SYMMETRY_DIR[sym][dir] applies to a numbered unit vector each of the 8 symmetries that keep the X axis
+ *   in place: rotations of 0, 90, 180 and 270 degrees around X (sym & 3), optionally followed by the
+ *   reflection that swaps Y and Z (sym & 4).
+ */
+static const unsigned char SYMMETRY_DIR[8][6] = {
+	{ DIR_PX, DIR_NX, DIR_PY, DIR_NY, DIR_PZ, DIR_NZ },
+	{ DIR_PX, DIR_NX, DIR_PZ, DIR_NZ, DIR_NY, DIR_PY },
+	{ DIR_PX, DIR_NX, DIR_NY, DIR_PY, DIR_NZ, DIR_PZ },
+	{ DIR_PX, DIR_NX, DIR_NZ, DIR_PZ, DIR_PY, DIR_NY },
+	{ DIR_PX, DIR_NX, DIR_PZ, DIR_NZ, DIR_PY, DIR_NY },
+	{ DIR_PX, DIR_NX, DIR_PY, DIR_NY, DIR_NZ, DIR_PZ },
+	{ DIR_PX, DIR_NX, DIR_NZ, DIR_PZ, DIR_NY, DIR_PY },
+	{ DIR_PX, DIR_NX, DIR_NY, DIR_PY, DIR_PZ, DIR_NZ },
+};
+
+/* Procedure idea:
+ *   Walk the chain once, storing for each movement the unit vectors it goes from and to
+ *   Under a symmetry, each movement becomes the one between the transformed vectors, which only takes table lookups
+ *   Each transformed chain is compared with the smallest one so far while it is made, and dropped once it is greater
+ */
+void MovChain_canonical(const MovElem * chain, int chainSize, MovElem *canon){
+	unsigned char dirs[chainSize > 0 ? chainSize : 1][3]; // Predecessor, backbone and side chain vectors of each element
+	MovElem other[chainSize > 0 ? chainSize : 1];
+	int sym, i;
+
+	memcpy(canon, chain, sizeof(MovElem) * chainSize);
+	if(chainSize <= 0)
+		return;
+
+	// The first element holds the side chains of beads 0 and 1, whose predecessor vectors are -X and +X
+	dirs[0][0] = NEXT_DIR[DIR_NX][MovElem_getBB(chain[0])];
+	dirs[0][1] = NEXT_DIR[DIR_PX][MovElem_getSC(chain[0])];
+
+	unsigned char pred = DIR_PX;
+	for(i = 1; i < chainSize; i++){
+		dirs[i][0] = pred;
+		dirs[i][1] = NEXT_DIR[pred][MovElem_getBB(chain[i])];
+		dirs[i][2] = NEXT_DIR[dirs[i][1]][MovElem_getSC(chain[i])];
+		pred = dirs[i][1];
+	}
+
+	for(sym = 1; sym < 8; sym++){
+		const unsigned char *map = SYMMETRY_DIR[sym];
+		int cmp = 0; // Sign of the comparison between 'other' and 'canon' so far
+
+		other[0] = MovElem_make(MOVEMENT_DIR[DIR_NX][map[dirs[0][0]]], MOVEMENT_DIR[DIR_PX][map[dirs[0][1]]]);
+		if(other[0] != canon[0])
+			cmp = other[0] < canon[0] ? -1 : 1;
+
+		for(i = 1; i < chainSize && cmp <= 0; i++){
+			unsigned char disp = map[dirs[i][1]];
+			other[i] = MovElem_make(MOVEMENT_DIR[map[dirs[i][0]]][disp], MOVEMENT_DIR[disp][map[dirs[i][2]]]);
+			if(cmp == 0 && other[i] != canon[i])
+				cmp = other[i] < canon[i] ? -1 : 1;
+		}
+
+		if(cmp < 0)
+			memcpy(canon, other, sizeof(MovElem) * chainSize);
+	}
+}
+
+// FNV-1a hash
+uint64_t MovChain_hash(const MovElem * chain, int chainSize){
+	const unsigned char *bytes = (const unsigned char *) chain;
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	int i;
+
+	for(i = 0; i < (int) sizeof(MovElem) * chainSize; i++){
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
 }
 
 /* DEBUGGING PROCEDURES
@@ -155,3 +366,55 @@ int main(int argc, char *argv[]){
 
 *
 */
+
+// Documented in header file
+void MovChain_print(const MovElem * chain, int size, FILE *fp){
+	int i;
+	for(i = 0; i < size; i++){
+		if(i > 0) fprintf(fp, " ");
+		MovElem_print(chain[i], fp);
+	}
+	fprintf(fp, "\n");
+}
+
+// Returns the movement represented by 'c', or -1 if there is none
+static
+int parse_movement(char c){
+	static const char chars[] = {'F','L','R','U','D'};
+	int i;
+	for(i = FRONT; i <= DOWN; i++)
+		if(chars[i] == c) return i;
+	return -1;
+}
+
+// Documented in header file
+int MovChain_parse(const char *str, MovElem **chain_p){
+	int size = 0;
+	int capacity = 64;
+	MovElem *chain = malloc(capacity);
+
+	while(1){
+		while(*str == ' ' || *str == '\t' || *str == '\n' || *str == '\r')
+			str++;
+		if(*str == '\0') break;
+
+		int bb = parse_movement(str[0]);
+		int sc = str[1] == ',' ? parse_movement(str[2]) : -1;
+		bool separated = sc >= 0 && strchr(" \t\r\n", str[3]) != NULL; // Also true for the terminating '\0'
+		if(bb < 0 || !separated){
+			free(chain);
+			return -1;
+		}
+
+		if(size == capacity){
+			capacity *= 2;
+			chain = realloc(chain, capacity);
+		}
+
+		chain[size++] = MovElem_make(bb, sc);
+		str += 3;
+	}
+
+	*chain_p = chain;
+	return size;
+}
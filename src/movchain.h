@@ -4,6 +4,7 @@
 /** \file movchain.h Routines for managing chains of MovElem units. */
 
 #include <stdio.h>
+#include <stdint.h>
 #include "movelem.h"
 #include "int3d.h"
 
@@ -29,5 +30,49 @@ void MovChain_build_3d(const MovElem * chain, // input
 	int3d **coordsSC_p  // output
 );
 
+/** Recomputes, in place, the coordinates of all beads whose position depends on elements 'eleIdx' onwards of 'chain'.
+ * 'coordsBB' and 'coordsSC' hold chainSize+1 beads, as built by MovChain_build_3d().
+ * Beads placed only by earlier elements are kept, so they must already be correct: if 'eleIdx' is 0,
+ *   that is backbone beads 0 and 1; otherwise, backbone and side chain beads 0 to 'eleIdx'.
+ */
+void MovChain_rebuild_3d(const MovElem * chain, // input
+	int chainSize,    // input
+	int eleIdx,       // input
+	int3d *coordsBB,  // input and output
+	int3d *coordsSC   // input and output
+);
+
+/** Inverse of MovChain_build_3d(): stores in 'chain' (with 'chainSize' elements) the movements that place
+ *   the beads in 'coordsBB' and 'coordsSC'.
+ * The beads may be anywhere and in any orientation, since the chain places them translated and rotated
+ *   so that backbone beads 0 and 1 are at (1, 0, 0) and (2, 0, 0).
+ * Returns -1 if the beads can't be represented by a chain (a bead isn't adjacent to the backbone bead
+ *   it follows, or lies right back on the backbone bead before it), and 0 otherwise.
+ */
+int MovChain_from_3d(const int3d *coordsBB, // input
+	const int3d *coordsSC, // input
+	int chainSize,         // input
+	MovElem *chain         // output
+);
+
+/** Stores in 'canon' the canonical form of 'chain' (both with 'chainSize' elements).
+ * Rotating a conformation around the axis of its first two backbone beads, or mirroring it, gives another
+ *   movement chain with the same contacts, collisions and gyration, hence the same fitness.
+ * The canonical form is the smallest of the 8 such chains (compared byte by byte), so two chains are symmetric
+ *   copies of each other if and only if their canonical forms are equal. It takes O(chainSize) time.
+ */
+void MovChain_canonical(const MovElem * chain, int chainSize, MovElem *canon);
+
+/** Returns a hash of the 'chainSize' elements of 'chain'. */
+uint64_t MovChain_hash(const MovElem * chain, int chainSize);
+
+/** Prints the 'size' elements of 'chain' with MovElem_print(), separated by spaces and followed by a newline. */
+void MovChain_print(const MovElem * chain, int size, FILE *fp);
+
+/** Parses a chain printed by MovChain_print() from the string 'str'.
+ * Stores in '*chain_p' a newly allocated chain, and returns its number of elements.
+ * Returns -1 if 'str' has anything other than movements (in which case nothing is allocated).
+ */
+int MovChain_parse(const char *str, MovElem **chain_p);
 
 #endif // MOVCHAIN_H
@@ -45,12 +45,6 @@ MovElem MovElem_make(unsigned char bb, unsigned char sc){
 	return (bb << 4) | sc;
 }
 
-/** Returns a uniformly random MovElem. */
-MOVELEM_INLINE
-MovElem MovElem_random(){
-	return MovElem_make(urandom_max(DOWN+1), urandom_max(DOWN+1));
-}
-
 /** Returns the movement for the backbone (BB) stored in a MovElem. */
 MOVELEM_INLINE
 unsigned char MovElem_getBB(MovElem elem){
@@ -81,6 +75,14 @@ MovElem MovElem_from_number(unsigned char num){
 	return MovElem_make(num / 5, num % 5);
 }
 
+/** Returns a uniformly random MovElem.
+ * A single draw in [0, 25) is split into both movements (see MovElem_from_number).
+ */
+MOVELEM_INLINE
+MovElem MovElem_random(){
+	return MovElem_from_number(urandom_max((DOWN+1) * (DOWN+1)));
+}
+
 /** Prints a movement in the format "%c,%c", without leading/trailing spaces.
  * Prints to file 'fp'.
  */
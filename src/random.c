@@ -1,3 +1,138 @@
+#include <stdatomic.h>
 
 #define RANDOM_SOURCE_CODE
 #include "random.h"
+
+_Thread_local RandomState RANDOM_STATE;
+
+static uint64_t   BASE_SEED = 72;
+static atomic_int NEXT_STREAM = RANDOM_EXPLICIT_STREAMS; // Lower streams are only taken on request
+
+static inline
+uint64_t rotl(uint64_t x, int k){
+	return (x << k) | (x >> (64 - k));
+}
+
+// Used to expand a 64-bit seed into a full xoshiro256** state
+static inline
+uint64_t splitmix64(uint64_t *x){
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// Advances a single xoshiro256** state 's' by the polynomial in 'poly'.
+// Used with the 'jump' polynomial (2^128 steps) and 'long jump' polynomial (2^192 steps).
+static
+void jump(uint64_t s[4], const uint64_t poly[4]){
+	uint64_t t[4] = {0, 0, 0, 0};
+	int i, b;
+
+	for(i = 0; i < 4; i++){
+		for(b = 0; b < 64; b++){
+			if(poly[i] & (1ULL << b)){
+				t[0] ^= s[0];
+				t[1] ^= s[1];
+				t[2] ^= s[2];
+				t[3] ^= s[3];
+			}
+
+			uint64_t x = s[1] << 17;
+			s[2] ^= s[0];
+			s[3] ^= s[1];
+			s[1] ^= s[2];
+			s[0] ^= s[3];
+			s[2] ^= x;
+			s[3] = rotl(s[3], 45);
+		}
+	}
+
+	s[0] = t[0]; s[1] = t[1]; s[2] = t[2]; s[3] = t[3];
+}
+
+static const uint64_t JUMP[4] = {
+	0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+static const uint64_t LONG_JUMP[4] = {
+	0x76E15D3EFEFDCBBFULL, 0xC5004E441C522FB3ULL, 0x77710069854EE241ULL, 0x39109BB02ACBE635ULL };
+
+/* Seeds the calling thread's generator with the given stream of BASE_SEED.
+ * Streams are 2^192 steps apart, and lanes within a stream are 2^128 steps apart.
+ */
+static
+void seed_stream(int stream){
+	uint64_t x = BASE_SEED;
+	uint64_t s[4];
+	int i, lane;
+
+	for(i = 0; i < 4; i++)
+		s[i] = splitmix64(&x);
+
+	for(i = 0; i < stream; i++)
+		jump(s, LONG_JUMP);
+
+	for(lane = 0; lane < RANDOM_LANES; lane++){
+		for(i = 0; i < 4; i++)
+			RANDOM_STATE.s[i][lane] = s[i];
+		jump(s, JUMP);
+	}
+
+	RANDOM_STATE.avail = 0;
+	RANDOM_STATE.seeded = 1;
+}
+
+// Documented in header file
+void random_set_seed(uint64_t seed){
+	BASE_SEED = seed;
+	atomic_store(&NEXT_STREAM, RANDOM_EXPLICIT_STREAMS);
+	seed_stream(0);
+}
+
+// Documented in header file
+void random_use_stream(int stream){
+	seed_stream(stream);
+}
+
+// Documented in header file
+void random_use_seed(uint64_t seed){
+	int i, lane;
+
+	// Sequences are short, so lanes are seeded straight from splitmix64 instead of jumping
+	for(lane = 0; lane < RANDOM_LANES; lane++){
+		for(i = 0; i < 4; i++)
+			RANDOM_STATE.s[i][lane] = splitmix64(&seed);
+	}
+
+	RANDOM_STATE.avail = 0;
+	RANDOM_STATE.seeded = 1;
+}
+
+// Documented in header file
+void random_refill(){
+	if(!RANDOM_STATE.seeded)
+		seed_stream(atomic_fetch_add(&NEXT_STREAM, 1));
+
+	uint64_t *s0 = RANDOM_STATE.s[0];
+	uint64_t *s1 = RANDOM_STATE.s[1];
+	uint64_t *s2 = RANDOM_STATE.s[2];
+	uint64_t *s3 = RANDOM_STATE.s[3];
+	uint64_t *buf = RANDOM_STATE.buf;
+
+	int i, lane;
+	for(i = 0; i < RANDOM_BLOCK; i += RANDOM_LANES){
+		// Lanes are independent, so this loop is a straightforward vectorization target
+		for(lane = 0; lane < RANDOM_LANES; lane++){
+			buf[i + lane] = rotl(s1[lane] * 5, 7) * 9;
+
+			uint64_t t = s1[lane] << 17;
+			s2[lane] ^= s0[lane];
+			s3[lane] ^= s1[lane];
+			s1[lane] ^= s2[lane];
+			s0[lane] ^= s3[lane];
+			s2[lane] ^= t;
+			s3[lane] = rotl(s3[lane], 45);
+		}
+	}
+
+	RANDOM_STATE.avail = RANDOM_BLOCK;
+}
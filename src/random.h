@@ -1,11 +1,21 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
-/** \file random.h Routines for random number generation. */
+/** \file random.h Routines for random number generation.
+ *
+ * The generator is a xoshiro256** run in RANDOM_LANES independent lanes, whose
+ *   state is laid out lane-interleaved so the refill loop can be vectorized by the compiler.
+ * Numbers are produced ahead of time in blocks of RANDOM_BLOCK 64-bit words, and the
+ *   routines below only consume words from that buffer.
+ *
+ * Each thread owns its own generator (stream). The thread that calls random_set_seed()
+ *   gets stream 0, and any other thread is lazily assigned the next free stream the first
+ *   time it draws a number, so threads never share or overlap their sequences.
+ * Streams below RANDOM_EXPLICIT_STREAMS are never assigned lazily. A thread may take one of them with
+ *   random_use_stream(), so that its sequence doesn't depend on the order in which threads start drawing.
+ */
 
-#undef MT_GENERATE_CODE_IN_HEADER
-#define MT_GENERATE_CODE_IN_HEADER 0
-#include "mtwist/mtwist.h"
+#include <stdint.h>
 
 #ifndef RANDOM_SOURCE_CODE
 	#define RANDOM_INLINE inline
@@ -13,16 +23,71 @@
 	#define RANDOM_INLINE extern inline
 #endif
 
+#define RANDOM_LANES 4   /**< Number of interleaved xoshiro256** generators */
+#define RANDOM_BLOCK 256 /**< Number of 64-bit words generated per refill (multiple of RANDOM_LANES) */
+#define RANDOM_EXPLICIT_STREAMS 256 /**< Number of streams reserved for random_use_stream() */
+
+/** State of the generator of a single thread. */
+typedef struct RandomState_ {
+	uint64_t s[4][RANDOM_LANES]; /**< xoshiro256** state, word-major so that lanes are contiguous */
+	uint64_t buf[RANDOM_BLOCK];  /**< Words generated ahead of time */
+	int avail;                   /**< Number of words in 'buf' not consumed yet */
+	int seeded;                  /**< Whether 's' has been seeded */
+} RandomState;
+
+/** Generator of the calling thread. */
+extern _Thread_local RandomState RANDOM_STATE;
+
+/** Seeds the generator of the calling thread (stream 0), and makes 'seed' the base
+ *   seed from which the streams of other threads are derived.
+ */
+void random_set_seed(uint64_t seed);
+
+/** Makes the calling thread draw from stream 'stream' of the base seed, from its beginning.
+ * 'stream' should be lower than RANDOM_EXPLICIT_STREAMS, and taken by a single thread.
+ */
+void random_use_stream(int stream);
+
+/** Makes the calling thread draw from a generator seeded by 'seed' alone, regardless of the base seed and the streams.
+ * Meant for short sequences that other threads or processes must be able to draw again from the same 'seed'.
+ *   The previous sequence of the thread can be resumed by saving RANDOM_STATE beforehand and restoring it afterwards.
+ */
+void random_use_seed(uint64_t seed);
+
+/** Refills the buffer of the calling thread. Seeds its stream if needed. */
+void random_refill();
+
+/** Returns a uniformly random 64-bit word. */
+RANDOM_INLINE
+uint64_t random_u64(){
+	if(RANDOM_STATE.avail == 0)
+		random_refill();
+	return RANDOM_STATE.buf[--RANDOM_STATE.avail];
+}
+
 /** Returns a random double within [0,1) */
 RANDOM_INLINE
 double drandom_x(){
-	return mt_drand();
+	return (random_u64() >> 11) * 0x1.0p-53;
 }
 
-/** Returns an unsigned integer within [0,max) */
+/** Returns an unsigned integer within [0,max)
+ * Uses Lemire's multiply-shift reduction, which is unbiased and only divides on the rare rejection path.
+ */
 RANDOM_INLINE
 unsigned int urandom_max(unsigned int max){
-	return drandom_x() * max;
+	uint64_t m = (random_u64() >> 32) * (uint64_t) max;
+	uint32_t low = (uint32_t) m;
+
+	if(low < max){
+		uint32_t threshold = -max % max;
+		while(low < threshold){
+			m = (random_u64() >> 32) * (uint64_t) max;
+			low = (uint32_t) m;
+		}
+	}
+
+	return m >> 32;
 }
 
 #endif // RANDOM_H
@@ -30,6 +30,7 @@ Solution Solution_blank(int hpSize){
 	retval.chain = malloc(sizeof(MovElem) * (hpSize - 1));
 	retval.fitness = FITNESS_MIN;
 	retval.idle_iterations = 0;
+	retval.move = 0;
 	return retval;
 }
 
@@ -39,6 +40,7 @@ Solution Solution_copy(Solution sol, int hpSize){
 	Solution retval;
 	retval.fitness = sol.fitness;
 	retval.idle_iterations = sol.idle_iterations;
+	retval.move = sol.move;
 
 	int chainSize = hpSize - 1;
 
@@ -48,6 +50,16 @@ Solution Solution_copy(Solution sol, int hpSize){
 	return retval;
 }
 
+/** Returns a Solution whose movement chain is a copy of 'chain', which has hpSize-1 elements.
+ * The returned Solution has its idle_iterations set to 0, and won't have its fitness calculated.
+ */
+SOLUTION_INLINE
+Solution Solution_from_chain(const MovElem *chain, int hpSize){
+	Solution retval = Solution_blank(hpSize);
+	memcpy(retval.chain, chain, sizeof(MovElem) * (hpSize - 1));
+	return retval;
+}
+
 /** Frees memory allocated for given solution */
 SOLUTION_INLINE
 void Solution_free(Solution sol){
@@ -64,6 +76,7 @@ Solution Solution_random(int hpSize){
 	int nMovements = hpSize - 1;
 
 	sol.idle_iterations = 0;
+	sol.move = 0;
 
 	// Generate random MovElem *
 	sol.chain = malloc(sizeof(MovElem) * nMovements);
@@ -89,9 +102,7 @@ SOLUTION_INLINE
 Solution Solution_perturb_relative(Solution perturb, Solution other, int hpSize){
 	int chainSize = hpSize - 1;
 	int pos1 = urandom_max(chainSize);
-	int pos2 = urandom_max(chainSize);
-
-	pos2 = pos1;
+	int pos2 = pos1;
 
 	Solution retval = Solution_copy(perturb, hpSize);
 	unsigned char elem1 = MovElem_to_number(retval.chain[pos1]);
@@ -108,6 +119,7 @@ Solution Solution_perturb_relative(Solution perturb, Solution other, int hpSize)
 	retval.chain[pos1] = MovElem_from_number(elem1 + delta);
 	retval.idle_iterations = 0;
 	retval.fitness = FITNESS_MIN;
+	retval.move = 0;
 
 	return retval;
 }
@@ -123,6 +135,20 @@ double Solution_fitness(Solution sol){
 	return sol.fitness;
 }
 
+/** Calculates the fitness of all 'nSols' solutions in 'sols', using up to N_THREADS threads.
+ * Unlike Solution_fitness, the calculated fitness is stored in each solution.
+ * Solutions whose fitness is already calculated are skipped.
+ */
+SOLUTION_INLINE
+void Solution_calculate_fitness(Solution *sols, int nSols){
+	int i;
+
+	#pragma omp parallel for num_threads(N_THREADS) schedule(dynamic, 1) if(nSols > 1)
+	for(i = 0; i < nSols; i++)
+		if(sols[i].fitness < (FITNESS_MIN + 0.1))
+			sols[i].fitness = FitnessCalc_run2(sols[i].chain);
+}
+
 /** Sets the fitness of a solution.
  */
 SOLUTION_INLINE
@@ -144,6 +170,29 @@ void Solution_inc_idle_iterations(Solution *sol){
 	sol->idle_iterations++;
 }
 
+/** Sets the number of idle iterations of the given solution to zero. */
+SOLUTION_INLINE
+void Solution_reset_idle_iterations(Solution *sol){
+	sol->idle_iterations = 0;
+}
+
+/** Sets the number of idle iterations of the given solution. */
+SOLUTION_INLINE
+void Solution_set_idle_iterations(Solution *sol, int idle){
+	sol->idle_iterations = idle;
+}
+
+/** Returns the kind of move that generated the solution (see moves.h), which is 0 unless set by Solution_set_move(). */
+SOLUTION_INLINE
+int Solution_move(Solution sol){
+	return sol.move;
+}
+
+/** Sets the kind of move that generated the solution. */
+SOLUTION_INLINE
+void Solution_set_move(Solution *sol, int move){
+	sol->move = move;
+}
 
 /** Returns the MovChain of the given solution.
  * \return The MovChain of the given solution, which shouldn't be modified.
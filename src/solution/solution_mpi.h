@@ -3,6 +3,8 @@
 
 /** \file solution_mpi.h Routines for transmitting Solution objects to and from other nodes within an MPI environment. */
 
+#include <stdatomic.h>
+#include <sched.h>
 #include <mpi/mpi.h>
 #include <elf_tree_comm/elf_tree_comm.h>
 #include "solution.h"
@@ -29,99 +31,749 @@ Solution Solution_unpack(int hpSize, void *buf, int maxSize, int *position, MPI_
 	return sol;
 }
 
+/** Stores in 'fits' the fitnesses of the 'nChains' chains in 'chains', one after the other, using the N_THREADS
+ *   threads of this node, each with its own lattice (see FitnessCalc_run2).
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_evaluate_chains(const MovElem *chains, int nChains, int hpSize, double *fits){
+	int i;
+
+	#pragma omp parallel for num_threads(N_THREADS) schedule(dynamic, 1) if(nChains > 1)
+	for(i = 0; i < nChains; i++){
+		fits[i] = FitnessCalc_run2(chains + i * (hpSize - 1));
+	}
+}
+
+/** Counters at the start of the shared window of an EvalShared, which all nodes update with atomic operations. */
+typedef struct {
+	atomic_int seq;  /**< Number of passes published by node 0 */
+	atomic_int stop; /**< Whether slaves must return */
+	atomic_int next; /**< Next chain of the pass to be taken */
+	atomic_int done; /**< Number of chains of the pass evaluated */
+	atomic_int left; /**< Number of slaves that are done with the pass */
+	int nChains;     /**< Number of chains of the pass */
+} EvalSharedHeader;
+
+/** Shared-memory transport of the tree protocol, for a hive whose nodes all live in the same machine.
+ *
+ * Node 0 allocates an MPI-3 shared window (MPI_Win_allocate_shared) that holds room for 'capacity' chains and
+ *   their fitnesses. Chains are evaluated in passes: node 0 copies up to 'capacity' chains into the window and
+ *   publishes the pass by incrementing 'seq'. Every node, node 0 included, then takes chunks of N_THREADS chains
+ *   by incrementing 'next', evaluates them and writes their fitnesses right into the window. Node 0 waits until
+ *   'done' counts all chains of the pass, and the next pass reuses the window once every slave left this one.
+ * No chain or fitness is copied through MPI messages, and nodes wait for each other by polling the counters,
+ *   yielding the processor while they do.
+ */
+typedef struct {
+	MPI_Comm nodeComm;        /**< Nodes of the hive, all of them in this machine */
+	MPI_Win win;
+	EvalSharedHeader *header; /**< Window of node 0, as mapped in this node */
+	double *fits;             /**< Fitnesses of the chains of the pass, within the window */
+	MovElem *chains;          /**< Chains of the pass, within the window */
+	int capacity;             /**< Number of chains of a pass */
+	int nSlaves;
+	int seq;                  /**< Last pass published (node 0) or seen (slaves) */
+} EvalShared;
+
+/* Size of the header of the window, rounded up so fitnesses don't share a cache line with the counters */
+#define EVAL_SHARED_HEADER_SIZE (((sizeof(EvalSharedHeader) + 63) / 64) * 64)
+
+/** Returns a shared-memory transport for the nodes of 'comm', which must all call this, for passes of
+ *   'capacity' chains, or NULL if they don't all live in the same machine (or there are no slaves).
+ *   In that case, nodes use MPI messages.
+ */
+SOLUTION_PARALLEL_INLINE
+EvalShared *EvalShared_create(MPI_Comm comm, int capacity, int hpSize){
+	int myRank, commSize, nodeSize;
+	MPI_Comm nodeComm;
+	MPI_Comm_rank(comm, &myRank);
+	MPI_Comm_size(comm, &commSize);
+	MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, myRank, MPI_INFO_NULL, &nodeComm);
+	MPI_Comm_size(nodeComm, &nodeSize);
+
+	// All nodes see the same sizes, so they agree on the fallback
+	if(nodeSize != commSize || commSize == 1){
+		MPI_Comm_free(&nodeComm);
+		return NULL;
+	}
+
+	EvalShared *sh = malloc(sizeof(EvalShared));
+	sh->nodeComm = nodeComm;
+	sh->capacity = capacity;
+	sh->nSlaves = commSize - 1;
+	sh->seq = 0;
+
+	MPI_Aint size = EVAL_SHARED_HEADER_SIZE + capacity * (sizeof(double) + hpSize - 1);
+	void *mine;
+	MPI_Win_allocate_shared(myRank == 0 ? size : 0, 1, MPI_INFO_NULL, nodeComm, &mine, &sh->win);
+
+	int dispUnit;
+	char *base;
+	MPI_Win_shared_query(sh->win, 0, &size, &dispUnit, &base);
+	sh->header = (EvalSharedHeader *) base;
+	sh->fits = (double *) (base + EVAL_SHARED_HEADER_SIZE);
+	sh->chains = (MovElem *) (sh->fits + capacity);
+
+	if(myRank == 0){
+		atomic_init(&sh->header->seq, 0);
+		atomic_init(&sh->header->stop, 0);
+		atomic_init(&sh->header->next, 0);
+		atomic_init(&sh->header->done, 0);
+		atomic_init(&sh->header->left, sh->nSlaves); // As if a pass had just finished
+		sh->header->nChains = 0;
+	}
+
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, sh->win);
+	MPI_Win_sync(sh->win);
+	MPI_Barrier(nodeComm);
+	return sh;
+}
+
+/** Frees the transport. All nodes that created it must call this, after the slaves returned. */
+SOLUTION_PARALLEL_INLINE
+void EvalShared_free(EvalShared *sh){
+	MPI_Win_unlock_all(sh->win);
+	MPI_Win_free(&sh->win);
+	MPI_Comm_free(&sh->nodeComm);
+	free(sh);
+}
+
+/** Waits until the counter 'v' reaches 'value', yielding the processor after a short spin. */
+SOLUTION_PARALLEL_INLINE
+void EvalShared_wait(atomic_int *v, int value){
+	int spins = 0;
+	while(atomic_load_explicit(v, memory_order_acquire) != value){
+		if(++spins > 64)
+			sched_yield();
+	}
+}
+
+/** Takes chunks of the pass of 'nChains' chains and evaluates them, until none is left. */
+SOLUTION_PARALLEL_INLINE
+void EvalShared_work(EvalShared *sh, int nChains, int hpSize){
+	int chunk = N_THREADS > 0 ? N_THREADS : 1;
+
+	while(true){
+		int first = atomic_fetch_add(&sh->header->next, chunk);
+		if(first >= nChains)
+			break;
+
+		int n = chunk < nChains - first ? chunk : nChains - first;
+		Solution_evaluate_chains(sh->chains + (size_t) first * (hpSize - 1), n, hpSize, sh->fits + first);
+		atomic_fetch_add_explicit(&sh->header->done, n, memory_order_release);
+	}
+}
+
+/** Calculates the fitness for all solutions in the given vector, using all nodes of the transport 'sh',
+ *   in passes of sh->capacity chains.
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_calculate_fitness_master_shared(Solution *sols, int nSols, int hpSize, EvalShared *sh){
+	int i, first;
+	EvalSharedHeader *h = sh->header;
+
+	for(first = 0; first < nSols; first += sh->capacity){
+		int n = sh->capacity < nSols - first ? sh->capacity : nSols - first;
+
+		// No slave may still be taking chains of the previous pass
+		EvalShared_wait(&h->left, sh->nSlaves);
+		atomic_store(&h->left, 0);
+		atomic_store(&h->next, 0);
+		atomic_store(&h->done, 0);
+		h->nChains = n;
+		for(i = 0; i < n; i++)
+			memcpy(sh->chains + (size_t) i * (hpSize - 1), sols[first + i].chain, hpSize - 1);
+		atomic_store_explicit(&h->seq, ++sh->seq, memory_order_release);
+
+		EvalShared_work(sh, n, hpSize);
+		EvalShared_wait(&h->done, n);
+
+		for(i = 0; i < n; i++)
+			sols[first + i].fitness = sh->fits[i];
+	}
+}
+
+/** Tells slaves running Solution_calculate_fitness_slave_shared to return. */
+SOLUTION_PARALLEL_INLINE
+void Solution_calculate_fitness_master_kill_slaves_shared(EvalShared *sh){
+	EvalShared_wait(&sh->header->left, sh->nSlaves);
+	atomic_store(&sh->header->stop, 1);
+	atomic_store_explicit(&sh->header->seq, ++sh->seq, memory_order_release);
+}
+
+/** Procedure that the slave nodes should execute with the transport 'sh'.
+ * Waits for each pass published by node 0 and takes chains of it until none is left.
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_calculate_fitness_slave_shared(int hpSize, EvalShared *sh){
+	EvalSharedHeader *h = sh->header;
+
+	while(true){
+		EvalShared_wait(&h->seq, sh->seq + 1);
+		sh->seq++;
+		if(atomic_load(&h->stop))
+			return;
+
+		EvalShared_work(sh, h->nChains, hpSize);
+		atomic_fetch_add(&h->left, 1);
+	}
+}
+
+/** Number of chains each node evaluates per round of the tree protocol (see Solution_calculate_fitness_master).
+ * Every node keeps one. Node 0 announces the size of the first round of each call in a header, and the size
+ *   of the next round within each round.
+ */
+typedef struct {
+	int k;              /**< Chains per node estimated for a round. Each call takes no more than its solutions need */
+	int fixed;          /**< If positive, 'k' is always this. Otherwise it is sized from the times measured by node 0 */
+	double evalTime;    /**< Average time node 0 took to evaluate a chain */
+	double overhead;    /**< Average time of a round that node 0 didn't spend evaluating chains */
+	EvalShared *shared; /**< If not NULL, chains go through shared memory instead of rounds of messages */
+	ElfTreeComm_Topology *topology; /**< If not NULL, rounds go over the two-level tree of its machines */
+} EvalBatch;
+
+/** Weight of the last round in the averages of EvalBatch */
+#define EVAL_BATCH_SMOOTHING 0.25
+
+/** With automatic sizing, rounds are made long enough that evaluation takes this many times their overhead */
+#define EVAL_BATCH_RATIO 4
+
+/** Returns the EvalBatch all nodes start with. 'fixed' is the number of chains per node and round, or 0 to size
+ *   rounds automatically. It must be the same in all nodes.
+ */
+SOLUTION_PARALLEL_INLINE
+EvalBatch EvalBatch_create(int fixed){
+	EvalBatch batch;
+	batch.k = fixed > 0 ? fixed : 1;
+	batch.fixed = fixed;
+	batch.evalTime = 0;
+	batch.overhead = 0;
+	batch.shared = NULL;
+	batch.topology = NULL;
+	return batch;
+}
+
+/** Scatters the blocks of a round over 'comm', or over the two-level tree of batch->topology if it is set. */
+SOLUTION_PARALLEL_INLINE
+void EvalBatch_scatter(const EvalBatch *batch, void *buf, int blockSize, MPI_Comm comm){
+	if(batch->topology)
+		ElfTreeComm_topology_scatter(buf, blockSize, MPI_BYTE, batch->topology);
+	else
+		ElfTreeComm_scatter(buf, blockSize, MPI_BYTE, comm);
+}
+
+/** Scatters blocks of blockSizes[i] bytes, as EvalBatch_scatter(). */
+SOLUTION_PARALLEL_INLINE
+void EvalBatch_scatterv(const EvalBatch *batch, void *buf, const int *blockSizes, MPI_Comm comm){
+	if(batch->topology)
+		ElfTreeComm_topology_scatterv(buf, blockSizes, MPI_BYTE, batch->topology);
+	else
+		ElfTreeComm_scatterv(buf, blockSizes, MPI_BYTE, comm);
+}
+
+/** Starts gathering the fitnesses of the nodeChains[i] chains of each node i in a round, as EvalBatch_scatterv()
+ *   sent them.
+ */
+SOLUTION_PARALLEL_INLINE
+void EvalBatch_igatherv(const EvalBatch *batch, double *fits, const int *nodeChains, MPI_Comm comm,
+		ElfTreeComm_Request *req){
+	if(batch->topology)
+		ElfTreeComm_topology_igatherv(fits, nodeChains, MPI_DOUBLE, batch->topology, req);
+	else
+		ElfTreeComm_igatherv(fits, nodeChains, MPI_DOUBLE, comm, req);
+}
+
+/** Returns the position of the node in the order of the blocks of a round. */
+SOLUTION_PARALLEL_INLINE
+int EvalBatch_rank(const EvalBatch *batch, MPI_Comm comm){
+	int rank;
+	MPI_Comm_rank(batch->topology ? batch->topology->comm : comm, &rank);
+	return rank;
+}
+
+/** Passes the header of a call from node 0 to all nodes: the chains per node of its first round, and the
+ *   number of chains of the call, or -1 to make the slaves return.
+ */
+SOLUTION_PARALLEL_INLINE
+void EvalBatch_header(const EvalBatch *batch, int header[2], MPI_Comm comm){
+	int i, myRank, commSize;
+	MPI_Comm_rank(comm, &myRank);
+	MPI_Comm_size(comm, &commSize);
+
+	int buff[2 * commSize];
+	if(myRank == 0){
+		for(i = 0; i < commSize; i++){
+			buff[2 * i] = header[0];
+			buff[2 * i + 1] = header[1];
+		}
+	}
+
+	EvalBatch_scatter(batch, buff, 2 * sizeof(int), comm);
+	header[0] = buff[0];
+	header[1] = buff[1];
+}
+
+/** Returns the number of bytes of the block each node receives in a round of 'k' chains:
+ *   the size of the next round, followed by the chains.
+ */
+SOLUTION_PARALLEL_INLINE
+int EvalBatch_block_size(int k, int hpSize){
+	return sizeof(int) + k * (hpSize - 1);
+}
+
+/** Fills the number of chains of each node in a round of 'k' chains per node with 'left' chains still to go,
+ *   and the size of its block. Nodes take k chains in order until none are left, so the last round of a call
+ *   may leave the last nodes with fewer chains, or none, instead of padding.
+ */
+SOLUTION_PARALLEL_INLINE
+void EvalBatch_round(int k, int left, int commSize, int hpSize, int *nodeChains, int *blockSizes){
+	int i;
+	for(i = 0; i < commSize; i++){
+		int n = left - i * k;
+		nodeChains[i] = n < 0 ? 0 : n < k ? n : k;
+		blockSizes[i] = EvalBatch_block_size(nodeChains[i], hpSize);
+	}
+}
+
 /** Calculates the fitness for all solutions in the given vector, using all nodes
  *   in the MPI communicator registered in the HIVE (HIVE_COMM.comm).
+ * The call starts with a header that tells the slaves how many chains it has, and how many each node gets
+ *   in its first round.
+ * In each round, every node gets k chains in a single tree scatter and returns their fitnesses in a single
+ *   tree gather, so the cost of each message is shared by k chains. In the last round, nodes only get the chains
+ *   left (see EvalBatch_round). The gather is started before each node evaluates its own chains, so fitnesses
+ *   from the nodes below it arrive meanwhile.
+ * Unless batch->fixed is set, batch->k is resized after each round so that evaluating the chains takes
+ *   EVAL_BATCH_RATIO times the rest of the round (mostly the latency of the tree), as measured by node 0.
+ *   Rounds never take more chains than the call needs, but batch->k keeps the size measured, so a short call
+ *   doesn't shrink the rounds of the next one.
+ * If batch->shared is set, chains and fitnesses go through shared memory instead (see EvalShared).
+ * If batch->topology is set, rounds go over its two-level tree instead (see elf_tree_comm.h).
  */
 SOLUTION_PARALLEL_INLINE
-void Solution_calculate_fitness_master(Solution *sols, int nSols, int hpSize, MPI_Comm comm){
-	int i, j;
+void Solution_calculate_fitness_master(Solution *sols, int nSols, int hpSize, MPI_Comm comm, EvalBatch *batch){
+	int i, j, n;
+
+	if(batch->shared){
+		Solution_calculate_fitness_master_shared(sols, nSols, hpSize, batch->shared);
+		return;
+	}
+	if(nSols == 0) return; // Not even a header
+	int chainSize = hpSize - 1;
 
 	int commSize;
 	MPI_Comm_size(comm, &commSize);
 
-	// Allocate buffer for MPI_Scatter / Gather
-	int buffSize = commSize * (hpSize - 1);
-	MovElem *buff = malloc(buffSize); // We send mov chains
-	double recvBuff[commSize];        // And receive fitnesses
+	// Rounds never need more chains than all solutions take
+	int maxK = (nSols + commSize - 1) / commSize;
+	if(maxK < 1) maxK = 1;
+
+	int k = batch->k < maxK ? batch->k : maxK;
+	int header[2] = { k, nSols };
+	EvalBatch_header(batch, header, comm);
+
+	// Allocate buffer for MPI_Scatter / Gather, large enough for any round
+	char *buff = malloc(commSize * EvalBatch_block_size(maxK, hpSize)); // We send mov chains
+	double *recvBuff = malloc(sizeof(double) * commSize * maxK);       // And receive fitnesses
+
+	int nodeChains[commSize], blockSizes[commSize];
+
+	for(i = 0; i < nSols; ){
+		EvalBatch_round(k, nSols - i, commSize, hpSize, nodeChains, blockSizes);
+		double start = MPI_Wtime();
+
+		// Size the next round from the previous ones
+		if(batch->fixed <= 0 && batch->evalTime > 0){
+			batch->k = ceil(EVAL_BATCH_RATIO * batch->overhead / batch->evalTime);
+			if(batch->k < 1) batch->k = 1;
+		}
+		int nextK = batch->k < maxK ? batch->k : maxK;
 
-	for(i = 0; i < nSols; i += commSize){
 		// Build scatter buffer content
-		for(j = 0; j < commSize; j++){
-			if((i+j) < nSols){
-				memcpy(buff + j*(hpSize-1), sols[i+j].chain, hpSize - 1);
-			} else {
-				memset(buff + j*(hpSize-1), 0xFEFEFEFE, hpSize - 1);
-			}
+		char *block = buff;
+		for(n = 0; n < commSize; n++){
+			memcpy(block, &nextK, sizeof(int));
+			MovElem *chains = (MovElem *) (block + sizeof(int));
+			for(j = 0; j < nodeChains[n]; j++)
+				memcpy(chains + j * chainSize, sols[i + n * k + j].chain, chainSize);
+			block += blockSizes[n];
 		}
 
 		// Scatter buffer
-		ElfTreeComm_scatter(buff, hpSize - 1, MPI_CHAR, comm);
+		EvalBatch_scatterv(batch, buff, blockSizes, comm);
+
+		// Gather fitnesses as they come, while calculating own fitnesses
+		ElfTreeComm_Request gather;
+		EvalBatch_igatherv(batch, recvBuff, nodeChains, comm, &gather);
 
-		// Calculate own fitness
-		double fit = FitnessCalc_run2(buff);
-		sols[i].fitness = fit;
+		double evalStart = MPI_Wtime();
+		int nOwn = nodeChains[0];
+		Solution_evaluate_chains((MovElem *) (buff + sizeof(int)), nOwn, hpSize, recvBuff);
+		double evalTime = MPI_Wtime() - evalStart;
 
-		// Gather fitnesses
-		ElfTreeComm_gather(recvBuff, 1, MPI_DOUBLE, comm);
+		ElfTreeComm_wait(&gather);
 
 		// Place fitnesses into the due solutions
-		for(j = 1; j < commSize && (i+j) < nSols; j++){
+		for(j = 0; j < commSize * k && (i+j) < nSols; j++)
 			sols[i+j].fitness = recvBuff[j];
 
-			// For verifying correctness of fitness
-			// int good = sols[i+j].fitness == FitnessCalc_run2(buff + j * (hpSize - 1));
+		// Measure the round
+		if(nOwn > 0){
+			double roundTime = MPI_Wtime() - start;
+			double overhead = roundTime > evalTime ? roundTime - evalTime : 0;
+			evalTime /= nOwn;
+			if(batch->evalTime == 0){
+				batch->evalTime = evalTime;
+				batch->overhead = overhead;
+			} else {
+				batch->evalTime += EVAL_BATCH_SMOOTHING * (evalTime - batch->evalTime);
+				batch->overhead += EVAL_BATCH_SMOOTHING * (overhead - batch->overhead);
+			}
 		}
+
+		i += commSize * k;
+		k = nextK;
 	}
 
 	free(buff);
+	free(recvBuff);
 }
 
-/** Tells slaves to return
- * Allocate buffer for MPI_Scatter / Gather */
+/** Tells slaves to return, with a header of no chains (see Solution_calculate_fitness_master). */
 SOLUTION_PARALLEL_INLINE
-void Solution_calculate_fitness_master_kill_slaves(int hpSize, MPI_Comm comm){
-	int commSize;
-	MPI_Comm_size(comm, &commSize);
+void Solution_calculate_fitness_master_kill_slaves(int hpSize, MPI_Comm comm, EvalBatch *batch){
+	if(batch->shared){
+		Solution_calculate_fitness_master_kill_slaves_shared(batch->shared);
+		return;
+	}
 
-	int buffSize = commSize * (hpSize - 1);
-	void *buff = malloc(buffSize);
-	memset(buff, 0xFFFFFFFF, buffSize);
-	ElfTreeComm_scatter(buff, hpSize - 1, MPI_CHAR, comm);
-	free(buff);
+	int header[2] = { 0, -1 };
+	EvalBatch_header(batch, header, comm);
 }
 
 /** Procedure that the slave nodes should execute.
  * Consists of waiting for MovChains, calculating its fitness, and sending the fitness back to node 0.
- * The fitness is sent back with the same MPI_TAG that was received with the MovChain.
- * The slave will return once the first element of the MovChain received is equal 0xFF.
+ * Each call of the master starts with a header of the number of chains it has and the size of its first round.
+ *   Each round brings k chains, or the ones left in the last round (see EvalBatch_round), and the number of
+ *   chains of the next round.
+ * The chains of a round are evaluated by the N_THREADS threads of the slave (see Solution_evaluate_chains).
+ * The slave will return once a header has -1 chains.
+ * If batch->shared is set, chains and fitnesses go through shared memory instead (see EvalShared).
  */
 SOLUTION_PARALLEL_INLINE
-void Solution_calculate_fitness_slave(const HPElem *hpChain, int hpSize, MPI_Comm comm){
+void Solution_calculate_fitness_slave(const HPElem *hpChain, int hpSize, MPI_Comm comm, EvalBatch *batch){
+	if(batch->shared){
+		Solution_calculate_fitness_slave_shared(hpSize, batch->shared);
+		return;
+	}
+
 	int commSize;
 	MPI_Comm_size(comm, &commSize);
+	int myRank = EvalBatch_rank(batch, comm);
+	int nodeChains[commSize], blockSizes[commSize];
 
-	// Create scatter/gather buffers
-	int buffSize = commSize * (hpSize - 1);
-	MovElem *buff = malloc(buffSize);
-	double sendBuff[commSize];
+	// Create scatter/gather buffers, grown as rounds grow
+	int capacity = batch->k;
+	char *buff = malloc(commSize * EvalBatch_block_size(capacity, hpSize));
+	double *sendBuff = malloc(sizeof(double) * commSize * capacity);
 
 	while(true){
-		ElfTreeComm_scatter(buff, hpSize-1, MPI_CHAR, comm);
-		if(0xFF == buff[0]){ // Detect end of work
-			free(buff);
-			return;
+		int header[2];
+		EvalBatch_header(batch, header, comm);
+		if(header[1] < 0) // Detect end of work
+			break;
+
+		int i, k = header[0], nSols = header[1];
+		for(i = 0; i < nSols; ){
+			if(k > capacity){
+				capacity = k;
+				buff = realloc(buff, commSize * EvalBatch_block_size(capacity, hpSize));
+				sendBuff = realloc(sendBuff, sizeof(double) * commSize * capacity);
+			}
+
+			EvalBatch_round(k, nSols - i, commSize, hpSize, nodeChains, blockSizes);
+			EvalBatch_scatterv(batch, buff, blockSizes, comm);
+			MovElem *chains = (MovElem *) (buff + sizeof(int));
+
+			// Fitnesses of the slaves below come in while evaluating own chains
+			ElfTreeComm_Request gather;
+			EvalBatch_igatherv(batch, sendBuff, nodeChains, comm, &gather);
+			Solution_evaluate_chains(chains, nodeChains[myRank], hpSize, sendBuff);
+			ElfTreeComm_wait(&gather);
+
+			i += commSize * k;
+			memcpy(&k, buff, sizeof(int));
 		}
+	}
 
-		if(0xFE == buff[0]){ // Detect no-op
-			sendBuff[0] = 0;
+	free(buff);
+	free(sendBuff);
+}
+
+/** Sends the MovChain of 'sol' straight to node 'dest', to be evaluated by Solution_calculate_fitness_slave_async.
+ * The fitness will be sent back with the same 'tag'.
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_send_async(Solution sol, int hpSize, int dest, int tag, MPI_Comm comm){
+	MPI_Send(sol.chain, hpSize - 1, MPI_CHAR, dest, tag, comm);
+}
+
+/** Calculates the fitness for all solutions in the given vector, handing them to slaves
+ *   running Solution_calculate_fitness_slave_async one at a time, as each slave becomes free.
+ * If there are no slaves, node 0 calculates everything.
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_calculate_fitness_master_async(Solution *sols, int nSols, int hpSize, MPI_Comm comm){
+	int commSize;
+	MPI_Comm_size(comm, &commSize);
+
+	if(commSize == 1){
+		Solution_calculate_fitness(sols, nSols);
+		return;
+	}
+
+	int next, busy = 0;
+	for(next = 0; next < nSols && next < commSize - 1; next++){
+		Solution_send_async(sols[next], hpSize, next + 1, next, comm);
+		busy++;
+	}
+
+	while(busy > 0){
+		double fit;
+		MPI_Status status;
+		MPI_Recv(&fit, 1, MPI_DOUBLE, MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &status);
+		sols[status.MPI_TAG].fitness = fit;
+
+		if(next < nSols){
+			Solution_send_async(sols[next], hpSize, status.MPI_SOURCE, next, comm);
+			next++;
 		} else {
-			sendBuff[0] = FitnessCalc_run2(buff);
+			busy--;
 		}
+	}
+}
+
+/** Copies the chains of the 'nSols' solutions in 'sols' to 'buff', one after the other, and posts them to node 'dest'
+ *   with MPI_Isend, to be evaluated by Solution_calculate_fitness_slave_async.
+ * 'buff' must not be touched until 'request' completes. The fitnesses will be sent back with the same 'tag'.
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_send_batch_async(const Solution *sols, int nSols, int hpSize, MovElem *buff, int dest, int tag,
+		MPI_Comm comm, MPI_Request *request){
+	int i;
+	for(i = 0; i < nSols; i++)
+		memcpy(buff + i * (hpSize - 1), sols[i].chain, hpSize - 1);
+	MPI_Isend(buff, nSols * (hpSize - 1), MPI_CHAR, dest, tag, comm, request);
+}
+
+/** Calculates the fitness for all solutions in the given vector, handing chunks of them to slaves running
+ *   Solution_calculate_fitness_slave_async from a single queue, with up to 'depth' chunks in flight to each slave.
+ * There are no rounds: a slave returning the fitnesses of a chunk is asking for more work, and gets the next chunk
+ *   of the queue right away, while it works on the others it holds. Faster slaves thus take more chunks.
+ * If 'chunk' is positive, every chunk has 'chunk' solutions (the last one may have fewer).
+ *   Otherwise chunks are sized by guided self-scheduling: each takes 1/(2 * commSize) of the solutions not handed
+ *   out yet (at least one), so they shrink as the queue drains, and a slow slave can't hold back its end.
+ * Node 0 takes solutions from the end of the queue itself while it waits ('chunk' at a time, or N_THREADS at a time).
+ * If 'ready' is not NULL, it is called with 'arg' whenever the fitnesses of a further range of solutions,
+ *   from 'first' (inclusive) to 'last' (exclusive), are all set, so node 0 can apply them while slaves work
+ *   on the rest. Ranges are reported in order, and cover all solutions.
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_calculate_fitness_master_queue(Solution *sols, int nSols, int hpSize, MPI_Comm comm, int depth, int chunk,
+		void (*ready)(int first, int last, void *arg), void *arg){
+	int i, j, commSize;
+	MPI_Comm_size(comm, &commSize);
 
-		ElfTreeComm_gather(sendBuff, 1, MPI_DOUBLE, comm);
+	if(nSols == 0) return;
+	if(commSize == 1){
+		Solution_calculate_fitness(sols, nSols);
+		if(ready) ready(0, nSols, arg);
+		return;
 	}
+	if(depth < 1) depth = 1;
+
+	// There are at most as many chunks as solutions
+	int chainSize = hpSize - 1;
+	MovElem *buff = malloc((size_t) chainSize * nSols); // Each chunk is sent from its own place, as sends are in flight
+	double *fits = malloc(sizeof(double) * nSols);
+	bool *done = calloc(nSols, sizeof(bool));
+	MPI_Request *sendReqs = malloc(sizeof(MPI_Request) * nSols);
+	MPI_Request *recvReqs = malloc(sizeof(MPI_Request) * nSols);
+	int *chunkFirst = malloc(sizeof(int) * nSols);
+	int *chunkSize = malloc(sizeof(int) * nSols);
+	int *owner = malloc(sizeof(int) * nSols);
+	int *completed = malloc(sizeof(int) * nSols);
+
+	int head = 0;     // First solution not handed out yet
+	int tail = nSols; // Solutions from here on are taken by node 0
+	int nChunks = 0;  // Chunks handed out so far
+	int posted = 0;   // Chunks posted so far
+	int inFlight = 0;
+	int flushed = 0;  // Solutions already reported to 'ready'
+
+	// Prime every slave with 'depth' chunks
+	int *wanting = malloc(sizeof(int) * ((commSize - 1) * depth + nSols)); // Slaves to hand a chunk to
+	int nWanting = 0;
+	for(i = 0; i < depth; i++)
+		for(j = 1; j < commSize; j++)
+			wanting[nWanting++] = j;
+
+	while(inFlight > 0 || head < tail){
+		int nCompleted = 0;
+
+		// Hand out the next chunks of the queue
+		for(i = 0; i < nWanting && head < tail; i++){
+			int n = chunk > 0 ? chunk : (tail - head + 2 * commSize - 1) / (2 * commSize);
+			if(n > tail - head) n = tail - head;
+			chunkFirst[nChunks] = head;
+			chunkSize[nChunks] = n;
+			owner[nChunks++] = wanting[i];
+			head += n;
+		}
+		nWanting = 0;
+
+		// Post the chunks handed out so far. The receive is posted first, so the fitnesses never wait for it
+		for(; posted < nChunks; posted++){
+			int first = chunkFirst[posted];
+			MPI_Irecv(fits + first, chunkSize[posted], MPI_DOUBLE, owner[posted], posted, comm, &recvReqs[posted]);
+			Solution_send_batch_async(sols + first, chunkSize[posted], hpSize, buff + (size_t) first * chainSize,
+				owner[posted], posted, comm, &sendReqs[posted]);
+			inFlight++;
+		}
+
+		if(inFlight > 0){
+			if(head < tail){
+				MPI_Testsome(nChunks, recvReqs, &nCompleted, completed, MPI_STATUSES_IGNORE);
+			} else {
+				MPI_Waitsome(nChunks, recvReqs, &nCompleted, completed, MPI_STATUSES_IGNORE);
+			}
+			if(nCompleted == MPI_UNDEFINED) nCompleted = 0;
+		}
+
+		// The slaves that returned a chunk get the next one
+		for(i = 0; i < nCompleted; i++){
+			int c = completed[i];
+			for(j = chunkFirst[c]; j < chunkFirst[c] + chunkSize[c]; j++)
+				done[j] = true;
+			inFlight--;
+			wanting[nWanting++] = owner[c];
+		}
+
+		// Work on the end of the queue while the slaves work on theirs, with all threads of this node
+		if(head < tail && nCompleted == 0){
+			int n = chunk > 0 ? chunk : N_THREADS;
+			if(n > tail - head) n = tail - head;
+			tail -= n;
+			Solution_calculate_fitness(sols + tail, n);
+			for(j = tail; j < tail + n; j++){
+				fits[j] = sols[j].fitness;
+				done[j] = true;
+			}
+		}
+
+		// Report the solutions completed, in order
+		int first = flushed;
+		while(flushed < nSols && done[flushed])
+			flushed++;
+		if(flushed > first){
+			for(j = first; j < flushed; j++)
+				sols[j].fitness = fits[j];
+			if(ready) ready(first, flushed, arg);
+		}
+	}
+
+	MPI_Waitall(nChunks, sendReqs, MPI_STATUSES_IGNORE);
+
+	free(buff);
+	free(fits);
+	free(done);
+	free(sendReqs);
+	free(recvReqs);
+	free(chunkFirst);
+	free(chunkSize);
+	free(owner);
+	free(completed);
+	free(wanting);
+}
+
+/** Calculates the fitness for all solutions in the given vector, as Solution_calculate_fitness_master_queue does
+ *   with batches of the same size, so every node gets about 2 * 'depth' of them.
+ * Unlike Solution_calculate_fitness_master, there are no rounds: whenever a slave returns a batch, the next one
+ *   is packed and posted to it, while the slave is already working on the others it holds.
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_calculate_fitness_master_pipelined(Solution *sols, int nSols, int hpSize, MPI_Comm comm, int depth,
+		void (*ready)(int first, int last, void *arg), void *arg){
+	int commSize;
+	MPI_Comm_size(comm, &commSize);
+	if(depth < 1) depth = 1;
+
+	int batch = nSols / (2 * commSize * depth);
+	if(batch < 1) batch = 1;
+	Solution_calculate_fitness_master_queue(sols, nSols, hpSize, comm, depth, batch, ready, arg);
 }
 
+/** Tells slaves running Solution_calculate_fitness_slave_async to return. */
+SOLUTION_PARALLEL_INLINE
+void Solution_calculate_fitness_master_kill_slaves_async(int hpSize, MPI_Comm comm){
+	int i, commSize;
+	MPI_Comm_size(comm, &commSize);
 
+	MovElem buff[hpSize - 1];
+	memset(buff, 0xFF, hpSize - 1);
+
+	for(i = 1; i < commSize; i++)
+		MPI_Send(buff, hpSize - 1, MPI_CHAR, i, 0, comm);
+}
+
+/** Procedure that the slave nodes should execute when the master talks to them directly
+ *   (steady-state mode, or the pipelined protocol).
+ * Consists of waiting for messages from node 0 with any number of MovChains, calculating their fitness,
+ *   and sending the fitnesses back to node 0, in the same order and with the same MPI_TAG.
+ * The chains of a message are evaluated by the N_THREADS threads of the slave (see Solution_evaluate_chains).
+ * Fitnesses are sent with MPI_Isend, so the slave moves on to the next message while they travel.
+ * The slave will return once the first element of the MovChain received is equal 0xFF.
+ */
+SOLUTION_PARALLEL_INLINE
+void Solution_calculate_fitness_slave_async(const HPElem *hpChain, int hpSize, MPI_Comm comm){
+	int chainSize = hpSize - 1;
+
+	int capacity = 1;
+	MovElem *buff = malloc(chainSize * capacity);
+	double *fits[2] = { malloc(sizeof(double) * capacity), malloc(sizeof(double) * capacity) };
+	MPI_Request sendReqs[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL };
+	int cur = 0; // Fitness buffer to fill next, the other one may still be in flight
+
+	while(true){
+		MPI_Status status;
+		int count;
+		MPI_Probe(0, MPI_ANY_TAG, comm, &status);
+		MPI_Get_count(&status, MPI_CHAR, &count);
+
+		int nChains = count / chainSize;
+		if(nChains > capacity){
+			MPI_Waitall(2, sendReqs, MPI_STATUSES_IGNORE);
+			capacity = nChains;
+			buff = realloc(buff, chainSize * capacity);
+			fits[0] = realloc(fits[0], sizeof(double) * capacity);
+			fits[1] = realloc(fits[1], sizeof(double) * capacity);
+		}
+
+		MPI_Recv(buff, count, MPI_CHAR, 0, status.MPI_TAG, comm, MPI_STATUS_IGNORE);
+		if(0xFF == buff[0]) // Detect end of work
+			break;
+
+		MPI_Wait(&sendReqs[cur], MPI_STATUS_IGNORE);
+		Solution_evaluate_chains(buff, nChains, hpSize, fits[cur]);
+
+		MPI_Isend(fits[cur], nChains, MPI_DOUBLE, 0, status.MPI_TAG, comm, &sendReqs[cur]);
+		cur = 1 - cur;
+	}
+
+	MPI_Waitall(2, sendReqs, MPI_STATUSES_IGNORE);
+	free(buff);
+	free(fits[0]);
+	free(fits[1]);
+}
 
 #endif
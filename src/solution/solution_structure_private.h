@@ -6,5 +6,6 @@ typedef struct Solution_ {
 	MovElem *chain;       /**< Position of such solution */
 	double fitness;       /**< Fitness of such solution. Calculated lazily. */
 	int idle_iterations;  /**< Number of iterations through which the food didn't improve */
+	int move;             /**< Kind of move that generated the solution (see moves.h) */
 } Solution;
 